@@ -1,15 +1,16 @@
 #include <cxxopts.hpp>
+#include <ftslib/csv.hpp>
 #include <ftslib/indexer.hpp>
 #include <ftslib/parser.hpp>
 #include <ftslib/searcher.hpp>
+#include <ftslib/segment.hpp>
 #include <iostream>
-#include <rapidcsv.h>
 
-struct csvinfo {
-  size_t bookid;
-  std::string title;
-  std::string languagecode;
-};
+// A full build replaces the whole index, segments appended to the previous
+// one included; they would otherwise hide it from the searcher.
+static void remove_segments(const std::filesystem::path &index_path) {
+  std::filesystem::remove_all(index_path / fts::segments_directory);
+}
 
 int main(int argc, char **argv) {
   cxxopts::Options options("lab5", "indexer");
@@ -19,44 +20,74 @@ int main(int argc, char **argv) {
     // clang-format off
       options.add_options()
       ("csv", "json file", cxxopts::value<std::string>())
-      ("index", "text to parce", cxxopts::value<std::string>());
+      ("index", "text to parce", cxxopts::value<std::string>())
+      ("threads", "indexing threads", cxxopts::value<size_t>()->default_value("1"))
+      ("shards", "index shards searched in parallel", cxxopts::value<size_t>()->default_value("1"))
+      ("append", "add the documents as a new segment of the index")
+      ("delete", "book ids to delete from the segments", cxxopts::value<std::vector<size_t>>())
+      ("merge", "merge the segments until the merge policy is met")
+      ("memory", "build within this many MiB, spilling to disk", cxxopts::value<size_t>());
     // clang-format on
 
     const auto result = options.parse(argc, argv);
 
-    const auto csv_path = result["csv"].as<std::string>();
     const auto index_path = result["index"].as<std::string>();
+    const auto threads = result["threads"].as<size_t>();
+    const auto shards = result["shards"].as<size_t>();
 
-    rapidcsv::Document books(csv_path);
-
-    std::vector<csvinfo> parsed_csv_file;
-    std::vector<size_t> col_book_id = books.GetColumn<size_t>("bookID");
-    std::vector<std::string> col_title = books.GetColumn<std::string>("title");
-    std::vector<std::string> col_language_code =
-        books.GetColumn<std::string>("language_code");
-
-    fts::IndexBuilder idx;
-
-    auto vsize = col_book_id.size();
-
-    for (size_t i = 0; i < vsize; ++i) {
-      parsed_csv_file.push_back(
-          {col_book_id[i], col_title[i], col_language_code[i]});
+    if (result.count("append") != 0 || result.count("delete") != 0 ||
+        result.count("merge") != 0) {
+      fts::SegmentedIndex segmented(index_path, config,
+                                    fts::TieredMergePolicy(), threads);
+      if (result.count("delete") != 0) {
+        segmented.deleteDocuments(result["delete"].as<std::vector<size_t>>());
+      }
+      if (result.count("append") != 0) {
+        const auto documents =
+            fts::readCatalog(result["csv"].as<std::string>());
+        segmented.addDocuments(documents);
+        std::cout << documents.size() << " documents...\n";
+      }
+      if (result.count("merge") != 0) {
+        while (segmented.merge()) {
+        }
+      }
+      std::cout << segmented.segments().size() << " segments\n";
+      return 0;
     }
 
-    size_t count = 0;
+    // The catalog is parsed while earlier batches are indexed.
+    fts::CatalogReader catalog(result["csv"].as<std::string>());
+    size_t documents = 0;
+    const auto source = [&catalog, &documents](auto &batch) {
+      const bool read = catalog.read(batch);
+      documents += batch.size();
+      return read;
+    };
 
-    for (const auto &[book_id, title, language_code] : parsed_csv_file) {
-      if (language_code == "eng" || language_code == "en-US") {
-        idx.addDocument(book_id, title, config);
-        if (++count % 500 == 0) {
-          std::cout << count << " documents...\n";
-        }
+    if (result.count("memory") != 0) {
+      if (shards != 1) {
+        throw fts::ConfigurationException(
+            "A streaming build writes an unsharded index");
       }
+      fts::StreamingIndexBuilder builder(
+          index_path, result["memory"].as<size_t>() << 20);
+      builder.addDocuments(source, config);
+      builder.finish();
+      remove_segments(index_path);
+      std::cout << documents << " documents...\n";
+      return 0;
     }
 
-    fts::BinaryIndexWriter binary_writer;
+    fts::IndexBuilder idx;
+    idx.addDocuments(source, config, threads);
+    std::cout << documents << " documents...\n";
+
+    fts::BinaryIndexWriter binary_writer(fts::DictionaryVersion::FrontCoded,
+                                         fts::EntriesVersion::BlockMax,
+                                         threads, shards);
     binary_writer.write(index_path, idx.getIndex());
+    remove_segments(index_path);
 
   } catch (const std::exception &e) {
     std::cerr << e.what() << "\n";
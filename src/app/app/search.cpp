@@ -1,26 +1,21 @@
 #include <cxxopts.hpp>
+#include <ftslib/handle.hpp>
 #include <ftslib/indexer.hpp>
 #include <ftslib/parser.hpp>
 #include <ftslib/searcher.hpp>
 #include <iostream>
 #include <replxx.hxx>
 
-void start_search(const fts::Config &config,
-                  const std::filesystem::path &index_path,
-                  const std::string &query) {
+void start_search(const fts::IndexHandle &index, const std::string &query) {
   try {
-    const auto *index_data = fts::mmap_bin_file(index_path / "binary/binary");
-    fts::Header header(index_data);
-    fts::BinaryIndexAccessor acsor_to_idx(index_data, header);
-    const auto result = fts::search(config, acsor_to_idx, query);
+    const auto result = index.search(query, fts::printed_results_count);
     fts::printResult(result);
   } catch (const std::exception &e) {
     std::cerr << e.what() << "\n";
   }
 }
 
-void start_search_interactive(const fts::Config &config,
-                              const std::filesystem::path &index_path) {
+void start_search_interactive(const fts::IndexHandle &index) {
   replxx::Replxx editor;
   editor.clear_screen();
   while (true) {
@@ -39,7 +34,7 @@ void start_search_interactive(const fts::Config &config,
       continue;
     }
     try {
-      start_search(config, index_path, query);
+      start_search(index, query);
     } catch (const std::exception &e) {
       std::cerr << e.what() << "\n";
       break;
@@ -56,18 +51,25 @@ int main(int argc, char **argv) {
 
     options.add_options()
       ("index", "json file", cxxopts::value<std::string>())
-      ("query", "text to parce", cxxopts::value<std::string>()->default_value("__query_"));
+      ("query", "text to parce", cxxopts::value<std::string>()->default_value("__query_"))
+      ("ranking", "tfidf, bm25 or bm25f", cxxopts::value<std::string>()->default_value(""));
     // clang-format on
 
     const auto result = options.parse(argc, argv);
 
-    const auto index = result["index"].as<std::string>();
+    const auto index_path = result["index"].as<std::string>();
     const auto query = result["query"].as<std::string>();
+    const auto ranking = result["ranking"].as<std::string>();
+    if (!ranking.empty()) {
+      config.setRanking(fts::parseRanking(ranking));
+    }
+
+    const fts::IndexHandle index(config, index_path);
 
     if (query == "__query_") {
-      start_search_interactive(config, index);
+      start_search_interactive(index);
     } else {
-      start_search(config, index, query);
+      start_search(index, query);
     }
 
   } catch (const std::exception &e) {
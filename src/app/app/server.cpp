@@ -0,0 +1,90 @@
+#include <csignal>
+#include <cxxopts.hpp>
+#include <ftslib/cache.hpp>
+#include <ftslib/handle.hpp>
+#include <ftslib/parser.hpp>
+#include <ftslib/pool.hpp>
+#include <ftslib/server.hpp>
+#include <iostream>
+#include <pthread.h>
+#include <thread>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+  cxxopts::Options options("lab5", "query server");
+  fts::Config config(std::filesystem::current_path() / "config.json");
+
+  try {
+    // clang-format off
+    options.add_options()
+      ("index", "index directory", cxxopts::value<std::string>())
+      ("socket", "unix socket to listen on, stdin if empty", cxxopts::value<std::string>()->default_value(""))
+      ("threads", "query threads", cxxopts::value<size_t>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+      ("ranking", "tfidf, bm25 or bm25f", cxxopts::value<std::string>()->default_value(""))
+      ("cache", "result cache size in MiB, 0 for none", cxxopts::value<size_t>()->default_value("0"))
+      ("term-cache", "term cache size in MiB, 0 for none", cxxopts::value<size_t>()->default_value("0"))
+      ("warm-terms", "most frequent terms cached on start", cxxopts::value<size_t>()->default_value("0"));
+    // clang-format on
+
+    const auto result = options.parse(argc, argv);
+
+    const auto index_path = result["index"].as<std::string>();
+    const auto socket_path = result["socket"].as<std::string>();
+    const auto threads = result["threads"].as<size_t>();
+    const auto ranking = result["ranking"].as<std::string>();
+    const auto cache_size = result["cache"].as<size_t>();
+    fts::TermCacheOptions term_cache;
+    term_cache.capacity_bytes = result["term-cache"].as<size_t>() << 20;
+    term_cache.warm_terms = result["warm-terms"].as<size_t>();
+    if (!ranking.empty()) {
+      config.setRanking(fts::parseRanking(ranking));
+    }
+
+    // Clients that hang up must not kill the server. On a socket, SIGINT
+    // and SIGTERM are blocked in every thread and taken by one that stops
+    // the server, which then finishes the queries it has read.
+    std::signal(SIGPIPE, SIG_IGN);
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (!socket_path.empty()) {
+      pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    }
+
+    const fts::IndexHandle index(
+        config, index_path,
+        cache_size == 0 ? nullptr
+                        : std::make_shared<fts::ResultCache>(cache_size << 20),
+        term_cache);
+    fts::ThreadPool pool(threads);
+    fts::QueryServer server(index, pool);
+
+    if (socket_path.empty()) {
+      server.serve(STDIN_FILENO, STDOUT_FILENO);
+    } else {
+      std::thread stopper([&]() {
+        int received = 0;
+        sigwait(&stop_signals, &received);
+        server.stop();
+      });
+      // Joined however listen() returns, also if it can't bind the socket:
+      // a thread left joinable would terminate the process.
+      const auto join_stopper = [&stopper]() {
+        pthread_kill(stopper.native_handle(), SIGTERM);
+        stopper.join();
+      };
+      try {
+        server.listen(socket_path);
+      } catch (...) {
+        join_stopper();
+        throw;
+      }
+      join_stopper();
+    }
+
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}
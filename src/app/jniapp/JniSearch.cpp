@@ -1,32 +1,55 @@
 #include "JniSearch.h"
+#include <ftslib/cache.hpp>
+#include <ftslib/handle.hpp>
 #include <ftslib/indexer.hpp>
 #include <ftslib/parser.hpp>
 #include <ftslib/searcher.hpp>
 #include <iostream>
 #include <cstring>
 
+static std::string getString(JNIEnv *env, jstring str) {
+  const char *chars = env->GetStringUTFChars(str, NULL);
+  std::string result = chars;
+  env->ReleaseStringUTFChars(str, chars);
+  return result;
+}
+
+// Shared by every handle, so reopening an index that did not change keeps
+// its cached results; handles open on other indexes meanwhile keep theirs.
+static const auto result_cache =
+    std::make_shared<fts::ResultCache>(std::size_t{64} << 20);
+
+/*
+ * Class:     JniSearch
+ * Method:    open
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_JniSearch_open(JNIEnv *env, jclass cl,
+                                            jstring config_path,
+                                            jstring index_path) {
+  try {
+    fts::Config config(getString(env, config_path));
+    auto *handle = new fts::IndexHandle(config, getString(env, index_path),
+                                        result_cache);
+    return reinterpret_cast<jlong>(handle);
+  } catch (const std::exception &e) {
+    env->ThrowNew(env->FindClass("java/lang/RuntimeException"), e.what());
+    return 0;
+  }
+}
+
 /*
  * Class:     JniSearch
  * Method:    search
- * Signature:
- * (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ * Signature: (JLjava/lang/String;)Ljava/lang/String;
  */
 JNIEXPORT jstring JNICALL Java_JniSearch_search(JNIEnv *env, jclass cl,
-                                                jstring config_path,
-                                                jstring index_path,
-                                                jstring query) {
-  std::string c_path = env->GetStringUTFChars(config_path, NULL);
-  std::string i_path = env->GetStringUTFChars(index_path, NULL);
-  std::string q = env->GetStringUTFChars(query, NULL);
-
-  fts::Config config(c_path);
-
-  const auto *index_data = fts::mmap_bin_file(i_path + "/binary/binary");
-  fts::Header header(index_data);
-  fts::BinaryIndexAccessor index_accessor(index_data, header);
+                                                jlong handle, jstring query) {
+  const auto *index = reinterpret_cast<const fts::IndexHandle *>(handle);
   std::string result;
   try {
-    const auto results = fts::search(config, index_accessor, q);
+    const auto results =
+        index->search(getString(env, query), fts::printed_results_count);
     result = fts::getStringSearchResult(results);
   } catch (const std::exception &e) {
     result = e.what();
@@ -34,3 +57,29 @@ JNIEXPORT jstring JNICALL Java_JniSearch_search(JNIEnv *env, jclass cl,
 
   return env->NewStringUTF(result.c_str());
 }
+
+/*
+ * Class:     JniSearch
+ * Method:    close
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_JniSearch_close(JNIEnv *env, jclass cl,
+                                            jlong handle) {
+  delete reinterpret_cast<fts::IndexHandle *>(handle);
+}
+
+/*
+ * Class:     JniSearch
+ * Method:    cacheStats
+ * Signature: ()Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_JniSearch_cacheStats(JNIEnv *env, jclass cl) {
+  const auto stats = result_cache->stats();
+  const std::string result =
+      "hits=" + std::to_string(stats.hits) +
+      " misses=" + std::to_string(stats.misses) +
+      " evictions=" + std::to_string(stats.evictions) +
+      " entries=" + std::to_string(stats.entries) +
+      " bytes=" + std::to_string(stats.bytes);
+  return env->NewStringUTF(result.c_str());
+}
@@ -1,5 +1,11 @@
 public class JniSearch {
 
-	public static native String search(String config_path, String index_path, String query);
+	public static native long open(String config_path, String index_path);
+
+	public static native String search(long handle, String query);
+
+	public static native void close(long handle);
+
+	public static native String cacheStats();
 
 }
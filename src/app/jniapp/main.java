@@ -25,6 +25,8 @@ public class main {
 		    parameters.put(key, value);
 		}
 
+		long index = JniSearch.open("config.json", parameters.get("index"));
+
 		Scanner input = new Scanner(System.in);
 		if (args.length == 1) {
 		    System.out.print("\033[H\033[J");
@@ -34,14 +36,16 @@ public class main {
 			if (query.equals("!q")) {
 			  break;
 			}
-			var result = JniSearch.search("config.json", parameters.get("index"), query);
+			var result = JniSearch.search(index, query);
 			System.out.println(result);
 		    }
 		} else {
-		    var result = JniSearch.search("config.json", parameters.get("index"), parameters.get("query"));
+		    var result = JniSearch.search(index, parameters.get("query"));
 		    System.out.println(result);
 		}
 
+		JniSearch.close(index);
+
 	}
 
 }
@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+#include <ftslib/codec.hpp>
+#include <ftslib/searcher.hpp>
+#include <vector>
+
+// Decoding one block of 128 doc ids: the raw format read one uint32_t at a
+// time through BinaryReader against bit unpacking plus prefix sum.
+
+static std::vector<std::uint32_t> makeGaps(std::uint8_t bit_width) {
+  std::vector<std::uint32_t> gaps(fts::packed_block_size);
+  const std::uint64_t limit = std::uint64_t{1} << bit_width;
+  for (size_t i = 0; i < gaps.size(); ++i) {
+    gaps[i] = static_cast<std::uint32_t>((i * 2654435761U) % limit);
+  }
+  return gaps;
+}
+
+static void BM_ReadBinaryLoop(benchmark::State &state) {
+  const auto raw = makeGaps(static_cast<std::uint8_t>(state.range(0)));
+  std::vector<std::uint32_t> values(fts::packed_block_size);
+  for (auto _ : state) {
+    fts::BinaryReader reader(reinterpret_cast<const char *>(raw.data()));
+    for (auto &value : values) {
+      reader.readBinary(&value, sizeof(value));
+    }
+    benchmark::DoNotOptimize(values.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(fts::packed_block_size));
+}
+
+static void BM_UnpackPrefixSum(benchmark::State &state) {
+  const auto level = static_cast<fts::SimdLevel>(state.range(0));
+  if (!fts::simdSupported(level)) {
+    state.SkipWithError("SIMD level is not supported by this CPU");
+    return;
+  }
+  const auto &kernels = fts::codecKernels(level);
+  const auto bit_width = static_cast<std::uint8_t>(state.range(1));
+  const auto gaps = makeGaps(bit_width);
+  std::vector<std::uint32_t> packed(4 * static_cast<size_t>(bit_width));
+  fts::packBlock(gaps.data(), bit_width, packed.data());
+  std::vector<std::uint32_t> values(fts::packed_block_size);
+  for (auto _ : state) {
+    kernels.unpack_block(packed.data(), bit_width, values.data());
+    kernels.prefix_sum(values.data(), values.size(), 0);
+    benchmark::DoNotOptimize(values.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(fts::packed_block_size));
+}
+
+BENCHMARK(BM_ReadBinaryLoop)->Arg(8)->Arg(16);
+BENCHMARK(BM_UnpackPrefixSum)
+    ->ArgNames({"level", "bits"})
+    ->ArgsProduct({{static_cast<int64_t>(fts::SimdLevel::Scalar),
+                    static_cast<int64_t>(fts::SimdLevel::Sse41),
+                    static_cast<int64_t>(fts::SimdLevel::Avx2)},
+                   {3, 8, 16}});
+
+BENCHMARK_MAIN();
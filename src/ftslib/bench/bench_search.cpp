@@ -0,0 +1,238 @@
+#include "corpus.hpp"
+
+#include <benchmark/benchmark.h>
+#include <ftslib/csv.hpp>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <ftslib/parser.hpp>
+#include <ftslib/searcher.hpp>
+#include <memory>
+#include <optional>
+
+// Indexing and query paths over the books.csv catalog, read with
+// config.json from the working directory like the apps do. The index is
+// written once to a temporary directory and shared by the query benchmarks.
+
+namespace {
+
+struct Corpus {
+  fts::Config config;
+  std::vector<fts::Document> documents;
+  std::vector<std::string> queries;
+  // Every term of the queries, for the per-term benchmarks.
+  std::vector<std::string> terms;
+  std::filesystem::path index_path;
+};
+
+std::unique_ptr<Corpus> read_corpus() {
+  const auto directory = std::filesystem::current_path();
+  auto corpus = std::make_unique<Corpus>(
+      Corpus{fts::Config(directory / "config.json"),
+             fts::readCatalog(directory / "books.csv"),
+             {},
+             {},
+             std::filesystem::temp_directory_path() / "fts_bench"});
+  corpus->queries = bench::sampleQueries(corpus->documents, 1000);
+  fts::TokenizerContext context;
+  for (const auto &query : corpus->queries) {
+    fts::tokenize(query, corpus->config, context,
+                  [&](std::string_view term, size_t) {
+                    corpus->terms.emplace_back(term);
+                  });
+  }
+
+  fts::IndexBuilder idx;
+  for (const auto &document : corpus->documents) {
+    idx.addDocument(document.document_id, document.name_of_doc,
+                    corpus->config, document.authors);
+  }
+  std::filesystem::remove_all(corpus->index_path);
+  fts::BinaryIndexWriter().write(corpus->index_path, idx.getIndex());
+  return corpus;
+}
+
+// The corpus, or nothing with the benchmark skipped if it can't be read.
+const Corpus *load_corpus(benchmark::State &state) {
+  static std::unique_ptr<Corpus> corpus;
+  static std::string error;
+  if (!corpus && error.empty()) {
+    try {
+      corpus = read_corpus();
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+  }
+  if (!corpus) {
+    state.SkipWithError(error.c_str());
+  }
+  return corpus.get();
+}
+
+} // namespace
+
+static void BM_Parse(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  int64_t bytes = 0;
+  for (const auto &document : corpus->documents) {
+    bytes += static_cast<int64_t>(document.name_of_doc.size());
+  }
+  for (auto _ : state) {
+    for (const auto &document : corpus->documents) {
+      benchmark::DoNotOptimize(
+          fts::parse(document.name_of_doc, corpus->config));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(corpus->documents.size()));
+}
+
+static void BM_AddDocument(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  for (auto _ : state) {
+    fts::IndexBuilder idx;
+    for (const auto &document : corpus->documents) {
+      idx.addDocument(document.document_id, document.name_of_doc,
+                      corpus->config, document.authors);
+    }
+    benchmark::DoNotOptimize(&idx.getIndex());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(corpus->documents.size()));
+}
+
+static void BM_WriteIndex(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  fts::IndexBuilder idx;
+  for (const auto &document : corpus->documents) {
+    idx.addDocument(document.document_id, document.name_of_doc,
+                    corpus->config, document.authors);
+  }
+  fts::BinaryIndexWriter writer(
+      static_cast<fts::DictionaryVersion>(state.range(0)),
+      fts::EntriesVersion::BlockMax);
+  const auto path = corpus->index_path / "write";
+  for (auto _ : state) {
+    writer.write(path, idx.getIndex());
+  }
+  state.SetBytesProcessed(
+      state.iterations() *
+      static_cast<int64_t>(std::filesystem::file_size(path / "binary" /
+                                                      "binary")));
+}
+
+static void BM_DictionaryLookup(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  fts::IndexBuilder idx;
+  for (const auto &document : corpus->documents) {
+    idx.addDocument(document.document_id, document.name_of_doc,
+                    corpus->config, document.authors);
+  }
+  const auto path = corpus->index_path / "dictionary";
+  fts::BinaryIndexWriter(static_cast<fts::DictionaryVersion>(state.range(0)))
+      .write(path, idx.getIndex());
+  const fts::MappedIndex index(path / "binary" / "binary");
+  const fts::DictionaryAccessor dictionary(
+      index.section("dictionary").data(),
+      static_cast<fts::DictionaryVersion>(
+          index.header().sectionVersion("dictionary")));
+  for (auto _ : state) {
+    for (const auto &term : corpus->terms) {
+      benchmark::DoNotOptimize(dictionary.retrieve(term));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(corpus->terms.size()));
+}
+
+static void BM_PostingDecode(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  const bool with_positions = state.range(0) != 0;
+  const fts::MappedIndex index(corpus->index_path / "binary" / "binary");
+  const fts::DictionaryAccessor dictionary(
+      index.section("dictionary").data(),
+      static_cast<fts::DictionaryVersion>(
+          index.header().sectionVersion("dictionary")));
+  const fts::EntryAccessor entries(
+      index.section("entries").data(), index.section("entries").size(),
+      static_cast<fts::EntriesVersion>(
+          index.header().sectionVersion("entries")));
+  std::vector<std::uint32_t> offsets;
+  for (const auto &term : corpus->terms) {
+    const auto offset = dictionary.retrieve(term);
+    if (offset) {
+      offsets.push_back(*offset);
+    }
+  }
+  int64_t postings = 0;
+  std::vector<size_t> positions;
+  for (auto _ : state) {
+    for (const auto offset : offsets) {
+      auto cursor = entries.cursor(offset);
+      while (cursor.next()) {
+        benchmark::DoNotOptimize(cursor.document());
+        if (with_positions) {
+          cursor.positions(positions);
+        }
+        ++postings;
+      }
+    }
+  }
+  state.SetItemsProcessed(postings);
+}
+
+static void BM_Search(benchmark::State &state) {
+  const auto *corpus = load_corpus(state);
+  if (corpus == nullptr) {
+    return;
+  }
+  fts::Config config = corpus->config;
+  config.setRanking(static_cast<fts::Ranking>(state.range(0)));
+  const fts::IndexHandle handle(config, corpus->index_path);
+  size_t next = 0;
+  for (auto _ : state) {
+    try {
+      benchmark::DoNotOptimize(handle.search(
+          corpus->queries[next], fts::printed_results_count));
+    } catch (const fts::ConfigurationException &) {
+      // Queries of stop words only.
+    }
+    next = (next + 1) % corpus->queries.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_Parse)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AddDocument)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WriteIndex)
+    ->ArgName("dictionary")
+    ->Arg(static_cast<int64_t>(fts::DictionaryVersion::Trie))
+    ->Arg(static_cast<int64_t>(fts::DictionaryVersion::FrontCoded))
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DictionaryLookup)
+    ->ArgName("dictionary")
+    ->Arg(static_cast<int64_t>(fts::DictionaryVersion::Trie))
+    ->Arg(static_cast<int64_t>(fts::DictionaryVersion::FrontCoded));
+BENCHMARK(BM_PostingDecode)->ArgName("positions")->Arg(0)->Arg(1);
+BENCHMARK(BM_Search)
+    ->ArgName("ranking")
+    ->Arg(static_cast<int64_t>(fts::Ranking::TfIdf))
+    ->Arg(static_cast<int64_t>(fts::Ranking::Bm25))
+    ->Arg(static_cast<int64_t>(fts::Ranking::Bm25F));
+
+BENCHMARK_MAIN();
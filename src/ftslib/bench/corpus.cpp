@@ -0,0 +1,104 @@
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace bench {
+
+static std::vector<std::string> split_words(const std::string &text) {
+  std::vector<std::string> words;
+  std::istringstream stream(text);
+  std::string word;
+  while (stream >> word) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+std::vector<fts::Document>
+scaleCorpus(const std::vector<fts::Document> &documents, size_t factor,
+            unsigned seed) {
+  std::vector<fts::Document> scaled = documents;
+  if (documents.empty() || factor <= 1) {
+    return scaled;
+  }
+  std::vector<std::string> words;
+  size_t next_id = 0;
+  for (const auto &document : documents) {
+    const auto title_words = split_words(document.name_of_doc);
+    words.insert(words.end(), title_words.begin(), title_words.end());
+    next_id = std::max(next_id, document.document_id + 1);
+  }
+  if (words.empty()) {
+    return scaled;
+  }
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<size_t> pick_word(0, words.size() - 1);
+  std::uniform_int_distribution<size_t> pick_document(0, documents.size() - 1);
+  scaled.reserve(documents.size() * factor);
+  for (size_t copy = 1; copy < factor; ++copy) {
+    for (const auto &document : documents) {
+      const size_t length = split_words(document.name_of_doc).size();
+      std::string title;
+      for (size_t i = 0; i < length; ++i) {
+        title += (i == 0 ? "" : " ") + words[pick_word(random)];
+      }
+      scaled.push_back({next_id++, std::move(title),
+                        documents[pick_document(random)].authors});
+    }
+  }
+  return scaled;
+}
+
+std::vector<std::string> readQueryLog(const std::filesystem::path &log_path) {
+  std::ifstream log(log_path);
+  if (!log) {
+    throw std::runtime_error("Can`t open " + log_path.string());
+  }
+  std::vector<std::string> queries;
+  std::string line;
+  while (std::getline(log, line)) {
+    std::string query = line;
+    if (!line.empty() && line.front() == '{') {
+      const auto entry = nlohmann::json::parse(line);
+      query = entry.value("query", entry.value("title", std::string()));
+    }
+    if (query.find_first_not_of(" \t\r") != std::string::npos) {
+      queries.push_back(std::move(query));
+    }
+  }
+  return queries;
+}
+
+std::vector<std::string>
+sampleQueries(const std::vector<fts::Document> &documents, size_t count,
+              unsigned seed) {
+  std::vector<std::string> queries;
+  if (documents.empty()) {
+    return queries;
+  }
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<size_t> pick_document(0, documents.size() - 1);
+  while (queries.size() < count) {
+    const auto words =
+        split_words(documents[pick_document(random)].name_of_doc);
+    if (words.empty()) {
+      continue;
+    }
+    const size_t first = random() % words.size();
+    const size_t length = std::min<size_t>(1 + random() % 3,
+                                           words.size() - first);
+    std::string query;
+    for (size_t i = first; i < first + length; ++i) {
+      query += (i == first ? "" : " ") + words[i];
+    }
+    queries.push_back(std::move(query));
+  }
+  return queries;
+}
+
+} // namespace bench
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <filesystem>
+#include <ftslib/indexer.hpp>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// `documents` followed by factor - 1 synthetic copies of them. A copy of a
+// document gets a new id and as many title words as it had, drawn at random
+// from the titles of all documents, and the authors of a random document,
+// so title words keep their share of the corpus as the index grows.
+std::vector<fts::Document>
+scaleCorpus(const std::vector<fts::Document> &documents, size_t factor,
+            unsigned seed = 1);
+
+// Queries of a log, one per line. A JSON line gives its "query" field or,
+// for entries like those of requests.jsonl, its "title"; any other line is
+// a query as it is. Empty queries are skipped.
+std::vector<std::string> readQueryLog(const std::filesystem::path &log_path);
+
+// `count` queries of one to three consecutive words of random titles.
+std::vector<std::string>
+sampleQueries(const std::vector<fts::Document> &documents, size_t count,
+              unsigned seed = 1);
+
+} // namespace bench
@@ -0,0 +1,133 @@
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cxxopts.hpp>
+#include <ftslib/cache.hpp>
+#include <ftslib/csv.hpp>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// Replays a query log against an index built from a catalog, scaled up
+// with synthetic documents, and reports throughput and latency
+// percentiles. Every query runs on one of `threads` threads sharing one
+// handle, as in the server.
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Nearest-rank percentile of sorted latencies, in microseconds.
+static double percentile(const std::vector<Clock::duration> &latencies,
+                         double fraction) {
+  const auto rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(latencies.size())));
+  const auto &latency = latencies[std::max<size_t>(rank, 1) - 1];
+  return std::chrono::duration<double, std::micro>(latency).count();
+}
+
+int main(int argc, char **argv) {
+  cxxopts::Options options("lab5", "query log replay");
+  fts::Config config(std::filesystem::current_path() / "config.json");
+
+  try {
+    // clang-format off
+    options.add_options()
+      ("csv", "catalog to index", cxxopts::value<std::string>()->default_value("books.csv"))
+      ("queries", "query log, plain or JSON lines", cxxopts::value<std::string>())
+      ("index", "directory of the built index", cxxopts::value<std::string>()->default_value((std::filesystem::temp_directory_path() / "fts_replay").string()))
+      ("scale", "times the catalog size, with synthetic documents", cxxopts::value<size_t>()->default_value("1"))
+      ("repeat", "passes over the log", cxxopts::value<size_t>()->default_value("1"))
+      ("threads", "query threads", cxxopts::value<size_t>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+      ("k", "results per query", cxxopts::value<size_t>()->default_value(std::to_string(fts::printed_results_count)))
+      ("ranking", "tfidf, bm25 or bm25f", cxxopts::value<std::string>()->default_value(""))
+      ("cache", "result cache size in MiB, 0 for none", cxxopts::value<size_t>()->default_value("0"))
+      ("term-cache", "term cache size in MiB, 0 for none", cxxopts::value<size_t>()->default_value("0"));
+    // clang-format on
+
+    const auto result = options.parse(argc, argv);
+
+    const auto index_path = result["index"].as<std::string>();
+    const auto scale = result["scale"].as<size_t>();
+    const auto repeat = result["repeat"].as<size_t>();
+    const auto threads = std::max<size_t>(1, result["threads"].as<size_t>());
+    const auto k = result["k"].as<size_t>();
+    const auto ranking = result["ranking"].as<std::string>();
+    const auto cache_size = result["cache"].as<size_t>();
+    fts::TermCacheOptions term_cache;
+    term_cache.capacity_bytes = result["term-cache"].as<size_t>() << 20;
+    if (!ranking.empty()) {
+      config.setRanking(fts::parseRanking(ranking));
+    }
+
+    const auto log = bench::readQueryLog(result["queries"].as<std::string>());
+    std::vector<std::string> queries;
+    for (size_t pass = 0; pass < repeat; ++pass) {
+      queries.insert(queries.end(), log.begin(), log.end());
+    }
+    if (queries.empty()) {
+      throw std::runtime_error("The query log is empty");
+    }
+
+    auto start = Clock::now();
+    const auto documents = bench::scaleCorpus(
+        fts::readCatalog(result["csv"].as<std::string>()), scale);
+    fts::IndexBuilder idx;
+    idx.addDocuments(documents, config, threads);
+    fts::BinaryIndexWriter(fts::DictionaryVersion::FrontCoded,
+                           fts::EntriesVersion::BlockMax, threads)
+        .write(index_path, idx.getIndex());
+    std::cout << documents.size() << " documents indexed in "
+              << seconds_since(start) << " s\n";
+
+    const fts::IndexHandle index(
+        config, index_path,
+        cache_size == 0 ? nullptr
+                        : std::make_shared<fts::ResultCache>(cache_size << 20),
+        term_cache);
+    std::vector<Clock::duration> latencies(queries.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> errors{0};
+    start = Clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&]() {
+        for (size_t i = next++; i < queries.size(); i = next++) {
+          const auto query_start = Clock::now();
+          try {
+            index.search(queries[i], k);
+          } catch (const std::exception &) {
+            ++errors;
+          }
+          latencies[i] = Clock::now() - query_start;
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    const double elapsed = seconds_since(start);
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::fixed << std::setprecision(1) << queries.size()
+              << " queries on " << threads << " threads, " << errors
+              << " failed\n"
+              << "QPS " << static_cast<double>(queries.size()) / elapsed
+              << "\n"
+              << "latency us p50 " << percentile(latencies, 0.5) << " p99 "
+              << percentile(latencies, 0.99) << " p999 "
+              << percentile(latencies, 0.999) << " max "
+              << percentile(latencies, 1.0) << "\n";
+
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}
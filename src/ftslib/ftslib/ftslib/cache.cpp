@@ -0,0 +1,24 @@
+#include <ftslib/cache.hpp>
+
+namespace fts {
+
+// ResultCache
+
+void ResultCache::insert(std::uint64_t generation, const std::string &key,
+                         std::vector<Result> results) {
+  size_t bytes = results.capacity() * sizeof(Result);
+  for (const auto &result : results) {
+    bytes += result.name_of_doc.capacity();
+  }
+  lru.insert(generationKey(generation, key), std::move(results), bytes);
+}
+
+// TermCache
+
+void TermCache::insert(std::string_view term, CachedTerm cached) {
+  const size_t bytes =
+      sizeof(CachedTerm) + (cached.postings ? cached.postings->bytes() : 0);
+  lru.insert(term, std::move(cached), bytes);
+}
+
+} // namespace fts
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ftslib/searcher.hpp>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fts {
+
+struct CacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Bytes of an entry besides its key and value: the list node, the map node
+// and the bucket.
+constexpr size_t cache_entry_overhead = 128;
+
+// Values by string key, bounded by the sizes in bytes their callers give.
+// Keys are spread over independently locked LRU shards, so concurrent
+// threads rarely wait on each other. Values larger than a shard are not
+// cached.
+template <class Value> class ShardedLru {
+private:
+  struct Entry {
+    std::string key;
+    Value value;
+    size_t bytes;
+  };
+  struct Shard {
+    std::mutex mutex;
+    // Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator>
+        index;
+    size_t bytes = 0;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  size_t shard_capacity;
+  std::atomic<size_t> hits{0};
+  std::atomic<size_t> misses{0};
+  std::atomic<size_t> evictions{0};
+
+  Shard &shardOf(std::string_view key) const {
+    return *shards[std::hash<std::string_view>()(key) % shards.size()];
+  }
+
+public:
+  explicit ShardedLru(size_t capacity_bytes, size_t shard_count) {
+    shard_count = std::max<size_t>(1, shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+      shards.push_back(std::make_unique<Shard>());
+    }
+    shard_capacity = capacity_bytes / shard_count;
+  }
+  ShardedLru(const ShardedLru &) = delete;
+  ShardedLru &operator=(const ShardedLru &) = delete;
+
+  // Whether an entry of this size would be kept by insert().
+  bool fits(size_t key_size, size_t value_bytes) const {
+    return cache_entry_overhead + key_size + value_bytes <= shard_capacity;
+  }
+
+  std::optional<Value> find(std::string_view key) {
+    auto &shard = shardOf(key);
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+      misses.fetch_add(1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    hits.fetch_add(1, std::memory_order_relaxed);
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    return found->second->value;
+  }
+
+  // Replaces the value cached under the key, if any.
+  void insert(std::string_view key, Value value, size_t value_bytes) {
+    const size_t bytes = cache_entry_overhead + key.size() + value_bytes;
+    if (bytes > shard_capacity) {
+      return;
+    }
+    auto &shard = shardOf(key);
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+      shard.bytes -= found->second->bytes;
+      shard.entries.erase(found->second);
+      shard.index.erase(found);
+    }
+    while (shard.bytes + bytes > shard_capacity) {
+      const auto &last = shard.entries.back();
+      shard.bytes -= last.bytes;
+      shard.index.erase(last.key);
+      shard.entries.pop_back();
+      evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.entries.push_front({std::string(key), std::move(value), bytes});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.bytes += bytes;
+  }
+
+  void clear() {
+    for (const auto &shard : shards) {
+      const std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->index.clear();
+      shard->entries.clear();
+      shard->bytes = 0;
+    }
+  }
+
+  CacheStats stats() const {
+    CacheStats result;
+    result.hits = hits.load(std::memory_order_relaxed);
+    result.misses = misses.load(std::memory_order_relaxed);
+    result.evictions = evictions.load(std::memory_order_relaxed);
+    for (const auto &shard : shards) {
+      const std::lock_guard<std::mutex> lock(shard->mutex);
+      result.entries += shard->entries.size();
+      result.bytes += shard->bytes;
+    }
+    return result;
+  }
+};
+
+// Results of recent queries. Entries are keyed by the index generation
+// they were searched on as well (see IndexHandle::generation()), so the
+// results of an older index are never served; they age out as any unused
+// entry does. Handles of different indexes or generations can share one
+// cache without evicting each other's results.
+class ResultCache {
+private:
+  ShardedLru<std::vector<Result>> lru;
+
+  static std::string generationKey(std::uint64_t generation,
+                                   const std::string &key) {
+    return std::to_string(generation) + '|' + key;
+  }
+
+public:
+  explicit ResultCache(size_t capacity_bytes, size_t shard_count = 16)
+      : lru(capacity_bytes, shard_count) {}
+
+  std::optional<std::vector<Result>> find(std::uint64_t generation,
+                                          const std::string &key) {
+    return lru.find(generationKey(generation, key));
+  }
+  void insert(std::uint64_t generation, const std::string &key,
+              std::vector<Result> results);
+  void clear() { lru.clear(); }
+  CacheStats stats() const { return lru.stats(); }
+};
+
+// A term as found in the dictionary of one index file: the offset of its
+// entry, none if the term is not there, and its postings once decoded.
+struct CachedTerm {
+  std::optional<std::uint32_t> entry_offset;
+  std::shared_ptr<const DecodedPostings> postings;
+  // Set once the postings were iterated; they are decoded the next time.
+  bool iterated = false;
+  // Set if the decoded postings can't fit in the cache; they are streamed
+  // from the index every time then.
+  bool too_large = false;
+};
+
+// Dictionary lookups and decoded posting lists of the terms of one index
+// file, shared by every query searching it (see BinaryIndexAccessor).
+class TermCache {
+private:
+  ShardedLru<CachedTerm> lru;
+
+public:
+  explicit TermCache(size_t capacity_bytes, size_t shard_count = 16)
+      : lru(capacity_bytes, shard_count) {}
+
+  std::optional<CachedTerm> find(std::string_view term) {
+    return lru.find(term);
+  }
+  void insert(std::string_view term, CachedTerm cached);
+  // Whether the term would be kept with postings of this size.
+  bool fits(std::string_view term, size_t postings_bytes) const {
+    return lru.fits(term.size(), sizeof(CachedTerm) + postings_bytes);
+  }
+  CacheStats stats() const { return lru.stats(); }
+};
+
+} // namespace fts
@@ -0,0 +1,339 @@
+#include <array>
+#include <ftslib/codec.hpp>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FTS_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace fts {
+
+constexpr std::size_t lanes = 4;
+constexpr std::size_t lane_size = packed_block_size / lanes;
+
+static constexpr std::array<std::uint32_t, 256> makeCrc32Table() {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t byte = 0; byte < table.size(); ++byte) {
+    std::uint32_t crc = byte;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1U) != 0 ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+    }
+    table[byte] = crc;
+  }
+  return table;
+}
+
+constexpr auto crc32_table = makeCrc32Table();
+
+std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc) {
+  const auto *bytes = static_cast<const std::uint8_t *>(data);
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = crc32_table[(crc ^ bytes[i]) & 0xffU] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+std::size_t encodeVarint(std::uint32_t value, std::uint8_t *out) {
+  std::size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = static_cast<std::uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[size++] = static_cast<std::uint8_t>(value);
+  return size;
+}
+
+const char *decodeVarint(const char *in, std::uint32_t &value) {
+  value = 0;
+  for (std::uint32_t shift = 0;; shift += 7) {
+    const auto byte = static_cast<std::uint8_t>(*in++);
+    value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return in;
+    }
+  }
+}
+
+std::uint8_t maxBitWidth(const std::uint32_t *values) {
+  std::uint32_t all = 0;
+  for (std::size_t i = 0; i < packed_block_size; ++i) {
+    all |= values[i];
+  }
+  std::uint8_t bit_width = 0;
+  while (all != 0) {
+    ++bit_width;
+    all >>= 1;
+  }
+  return bit_width;
+}
+
+void packBlock(const std::uint32_t *values, std::uint8_t bit_width,
+               std::uint32_t *out) {
+  for (std::size_t i = 0; i < lanes * bit_width; ++i) {
+    out[i] = 0;
+  }
+  if (bit_width == 0) {
+    return;
+  }
+  for (std::size_t lane = 0; lane < lanes; ++lane) {
+    std::size_t bit = 0;
+    for (std::size_t i = 0; i < lane_size; ++i, bit += bit_width) {
+      const std::uint64_t value = values[i * lanes + lane];
+      const std::size_t word = bit / 32;
+      const std::size_t shift = bit % 32;
+      out[word * lanes + lane] |= static_cast<std::uint32_t>(value << shift);
+      if (shift + bit_width > 32) {
+        out[(word + 1) * lanes + lane] |=
+            static_cast<std::uint32_t>(value >> (32 - shift));
+      }
+    }
+  }
+}
+
+static void unpackBlockScalar(const std::uint32_t *in, std::uint8_t bit_width,
+                              std::uint32_t *values) {
+  if (bit_width == 0) {
+    for (std::size_t i = 0; i < packed_block_size; ++i) {
+      values[i] = 0;
+    }
+    return;
+  }
+  const std::uint32_t mask =
+      bit_width == 32 ? ~0U : (std::uint32_t{1} << bit_width) - 1;
+  for (std::size_t lane = 0; lane < lanes; ++lane) {
+    std::size_t bit = 0;
+    for (std::size_t i = 0; i < lane_size; ++i, bit += bit_width) {
+      const std::size_t word = bit / 32;
+      const std::size_t shift = bit % 32;
+      std::uint64_t value = in[word * lanes + lane] >> shift;
+      if (shift + bit_width > 32) {
+        value |= static_cast<std::uint64_t>(in[(word + 1) * lanes + lane])
+                 << (32 - shift);
+      }
+      values[i * lanes + lane] = static_cast<std::uint32_t>(value) & mask;
+    }
+  }
+}
+
+static void prefixSumScalar(std::uint32_t *values, std::size_t count,
+                            std::uint32_t base) {
+  for (std::size_t i = 0; i < count; ++i) {
+    base += values[i];
+    values[i] = base;
+  }
+}
+
+#ifdef FTS_X86_KERNELS
+
+using UnpackKernel = void (*)(const std::uint32_t *in, std::uint32_t *values);
+
+constexpr std::uint32_t lowBits(unsigned bit_width) {
+  return bit_width == 32 ? ~0U : (std::uint32_t{1} << bit_width) - 1;
+}
+
+// One 128-bit load holds word w of all four lanes, so a single shift and
+// mask yields values 4i .. 4i + 3 in output order.
+template <unsigned B>
+__attribute__((target("sse4.1"))) static void
+unpackSse41(const std::uint32_t *in, std::uint32_t *values) {
+  const auto *words = reinterpret_cast<const __m128i *>(in);
+  auto *out = reinterpret_cast<__m128i *>(values);
+  const __m128i mask = _mm_set1_epi32(static_cast<int>(lowBits(B)));
+  for (unsigned i = 0; i < lane_size; ++i) {
+    const unsigned word = i * B / 32;
+    const unsigned shift = i * B % 32;
+    __m128i value = _mm_srl_epi32(_mm_loadu_si128(words + word),
+                                  _mm_cvtsi32_si128(static_cast<int>(shift)));
+    if (shift + B > 32) {
+      value = _mm_or_si128(
+          value, _mm_sll_epi32(_mm_loadu_si128(words + word + 1),
+                               _mm_cvtsi32_si128(static_cast<int>(32 - shift))));
+    }
+    _mm_storeu_si128(out + i, _mm_and_si128(value, mask));
+  }
+}
+
+// Decodes two rows of four values per step; the per-element shifts of
+// AVX2 let each 128-bit half use its own word and shift. A left shift by
+// 32 yields zero, which covers values that do not straddle two words.
+template <unsigned B>
+__attribute__((target("avx2"))) static void
+unpackAvx2(const std::uint32_t *in, std::uint32_t *values) {
+  const auto *words = reinterpret_cast<const __m128i *>(in);
+  auto *out = reinterpret_cast<__m256i *>(values);
+  const __m256i mask = _mm256_set1_epi32(static_cast<int>(lowBits(B)));
+  for (unsigned i = 0; i < lane_size; i += 2) {
+    const unsigned lo_word = i * B / 32;
+    const auto lo_shift = static_cast<int>(i * B % 32);
+    const unsigned hi_word = (i + 1) * B / 32;
+    const auto hi_shift = static_cast<int>((i + 1) * B % 32);
+
+    const __m256i current = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(words + lo_word)),
+        _mm_loadu_si128(words + hi_word), 1);
+    __m256i value = _mm256_srlv_epi32(
+        current, _mm256_setr_epi32(lo_shift, lo_shift, lo_shift, lo_shift,
+                                   hi_shift, hi_shift, hi_shift, hi_shift));
+
+    const bool lo_spans = lo_shift + B > 32;
+    const bool hi_spans = hi_shift + B > 32;
+    if (lo_spans || hi_spans) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m256i next = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(
+              lo_spans ? _mm_loadu_si128(words + lo_word + 1) : zero),
+          hi_spans ? _mm_loadu_si128(words + hi_word + 1) : zero, 1);
+      const int lo_carry = 32 - lo_shift;
+      const int hi_carry = 32 - hi_shift;
+      value = _mm256_or_si256(
+          value, _mm256_sllv_epi32(
+                     next, _mm256_setr_epi32(lo_carry, lo_carry, lo_carry,
+                                             lo_carry, hi_carry, hi_carry,
+                                             hi_carry, hi_carry)));
+    }
+    _mm256_storeu_si256(out + i / 2, _mm256_and_si256(value, mask));
+  }
+}
+
+template <template <unsigned> class Kernel, std::size_t... B>
+constexpr std::array<UnpackKernel, sizeof...(B)>
+makeUnpackTable(std::index_sequence<B...> /*widths*/) {
+  return {&Kernel<B>::run...};
+}
+
+template <unsigned B> struct Sse41Unpack {
+  static void run(const std::uint32_t *in, std::uint32_t *values) {
+    unpackSse41<B>(in, values);
+  }
+};
+
+template <unsigned B> struct Avx2Unpack {
+  static void run(const std::uint32_t *in, std::uint32_t *values) {
+    unpackAvx2<B>(in, values);
+  }
+};
+
+static void unpackBlockSse41(const std::uint32_t *in, std::uint8_t bit_width,
+                             std::uint32_t *values) {
+  static constexpr auto table =
+      makeUnpackTable<Sse41Unpack>(std::make_index_sequence<33>());
+  if (bit_width == 0) {
+    unpackBlockScalar(in, bit_width, values);
+    return;
+  }
+  table[bit_width](in, values);
+}
+
+static void unpackBlockAvx2(const std::uint32_t *in, std::uint8_t bit_width,
+                            std::uint32_t *values) {
+  static constexpr auto table =
+      makeUnpackTable<Avx2Unpack>(std::make_index_sequence<33>());
+  if (bit_width == 0) {
+    unpackBlockScalar(in, bit_width, values);
+    return;
+  }
+  table[bit_width](in, values);
+}
+
+__attribute__((target("sse4.1"))) static void
+prefixSumSse41(std::uint32_t *values, std::size_t count, std::uint32_t base) {
+  __m128i carry = _mm_set1_epi32(static_cast<int>(base));
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    auto *ptr = reinterpret_cast<__m128i *>(values + i);
+    __m128i value = _mm_loadu_si128(ptr);
+    value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+    value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+    value = _mm_add_epi32(value, carry);
+    _mm_storeu_si128(ptr, value);
+    carry = _mm_shuffle_epi32(value, 0xff);
+  }
+  prefixSumScalar(values + i, count - i,
+                  static_cast<std::uint32_t>(_mm_cvtsi128_si32(carry)));
+}
+
+__attribute__((target("avx2"))) static void
+prefixSumAvx2(std::uint32_t *values, std::size_t count, std::uint32_t base) {
+  __m256i carry = _mm256_set1_epi32(static_cast<int>(base));
+  const __m256i last = _mm256_set1_epi32(7);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    auto *ptr = reinterpret_cast<__m256i *>(values + i);
+    __m256i value = _mm256_loadu_si256(ptr);
+    // Prefix sums inside each 128-bit half, then carry the low half's
+    // total into the high half.
+    value = _mm256_add_epi32(value, _mm256_slli_si256(value, 4));
+    value = _mm256_add_epi32(value, _mm256_slli_si256(value, 8));
+    const __m256i half_totals = _mm256_shuffle_epi32(value, 0xff);
+    value = _mm256_add_epi32(
+        value, _mm256_permute2x128_si256(half_totals, half_totals, 0x08));
+    value = _mm256_add_epi32(value, carry);
+    _mm256_storeu_si256(ptr, value);
+    carry = _mm256_permutevar8x32_epi32(value, last);
+  }
+  prefixSumScalar(
+      values + i, count - i,
+      static_cast<std::uint32_t>(
+          _mm_cvtsi128_si32(_mm256_castsi256_si128(carry))));
+}
+
+#endif
+
+bool simdSupported(SimdLevel level) {
+#ifdef FTS_X86_KERNELS
+  __builtin_cpu_init();
+  switch (level) {
+  case SimdLevel::Scalar:
+    return true;
+  case SimdLevel::Sse41:
+    return __builtin_cpu_supports("sse4.1") != 0;
+  case SimdLevel::Avx2:
+    return __builtin_cpu_supports("avx2") != 0;
+  }
+  return false;
+#else
+  return level == SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel activeSimdLevel() {
+  static const SimdLevel level = simdSupported(SimdLevel::Avx2) ? SimdLevel::Avx2
+                                 : simdSupported(SimdLevel::Sse41)
+                                     ? SimdLevel::Sse41
+                                     : SimdLevel::Scalar;
+  return level;
+}
+
+const CodecKernels &codecKernels(SimdLevel level) {
+  static constexpr CodecKernels scalar = {&unpackBlockScalar, &prefixSumScalar};
+  if (!simdSupported(level)) {
+    throw std::invalid_argument("SIMD level is not supported by this CPU");
+  }
+#ifdef FTS_X86_KERNELS
+  static constexpr CodecKernels sse41 = {&unpackBlockSse41, &prefixSumSse41};
+  static constexpr CodecKernels avx2 = {&unpackBlockAvx2, &prefixSumAvx2};
+  if (level == SimdLevel::Sse41) {
+    return sse41;
+  }
+  if (level == SimdLevel::Avx2) {
+    return avx2;
+  }
+#endif
+  return scalar;
+}
+
+void unpackBlock(const std::uint32_t *in, std::uint8_t bit_width,
+                 std::uint32_t *values) {
+  static const CodecKernels &kernels = codecKernels(activeSimdLevel());
+  kernels.unpack_block(in, bit_width, values);
+}
+
+void prefixSum(std::uint32_t *values, std::size_t count, std::uint32_t base) {
+  static const CodecKernels &kernels = codecKernels(activeSimdLevel());
+  kernels.prefix_sum(values, count, base);
+}
+
+} // namespace fts
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fts {
+
+// Integer codecs used by the compressed entries section, and the checksum
+// of the index container.
+
+// CRC-32 (IEEE 802.3) of `size` bytes, continuing from a previous `crc`.
+std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc = 0);
+
+// Number of integers in one bit-packed block.
+constexpr std::size_t packed_block_size = 128;
+
+// Bytes needed by the longest varint of a 32-bit value.
+constexpr std::size_t max_varint_size = 5;
+
+// LEB128: seven bits per byte, high bit set on every byte but the last.
+std::size_t encodeVarint(std::uint32_t value, std::uint8_t *out);
+const char *decodeVarint(const char *in, std::uint32_t &value);
+
+// Smallest bit width that holds every value of a block.
+std::uint8_t maxBitWidth(const std::uint32_t *values);
+
+// Blocks use the vertical layout of SIMD-BP128: value i belongs to lane
+// i % 4, and word w of lane l is stored at out[w * 4 + l], so a block of
+// width b takes 4 * b words.
+void packBlock(const std::uint32_t *values, std::uint8_t bit_width,
+               std::uint32_t *out);
+void unpackBlock(const std::uint32_t *in, std::uint8_t bit_width,
+                 std::uint32_t *values);
+
+// Turns gaps into absolute values: values[i] += values[i - 1], starting
+// from base.
+void prefixSum(std::uint32_t *values, std::size_t count, std::uint32_t base);
+
+// unpackBlock and prefixSum run the fastest kernels the CPU supports,
+// picked once at first use. The kernels of every level are also reachable
+// directly for tests and benchmarks.
+
+enum class SimdLevel { Scalar, Sse41, Avx2 };
+
+struct CodecKernels {
+  void (*unpack_block)(const std::uint32_t *in, std::uint8_t bit_width,
+                       std::uint32_t *values);
+  void (*prefix_sum)(std::uint32_t *values, std::size_t count,
+                     std::uint32_t base);
+};
+
+bool simdSupported(SimdLevel level);
+SimdLevel activeSimdLevel();
+// Throws std::invalid_argument if the CPU does not support the level.
+const CodecKernels &codecKernels(SimdLevel level);
+
+} // namespace fts
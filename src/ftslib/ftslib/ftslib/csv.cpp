@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <ftslib/csv.hpp>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace fts {
+
+// CsvReader
+
+CsvReader::CsvReader(const std::filesystem::path &path, size_t chunk_size)
+    : file_path(path), buffer(std::max<size_t>(1, chunk_size)) {
+  file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Can`t open " + path.string());
+  }
+  if (next()) {
+    header.assign(fields.begin(), fields.end());
+  }
+}
+
+CsvReader::~CsvReader() { close(file); }
+
+size_t CsvReader::column(std::string_view name) const {
+  const auto found = std::find(header.begin(), header.end(), name);
+  if (found == header.end()) {
+    throw std::runtime_error(file_path.string() + " has no column " +
+                             std::string(name));
+  }
+  return found - header.begin();
+}
+
+// Moves the unparsed bytes to the front, growing the buffer if they fill
+// it, and reads after them. Returns false at the end of the file.
+bool CsvReader::readMore() {
+  std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+  end -= begin;
+  begin = 0;
+  if (end == buffer.size()) {
+    buffer.resize(buffer.size() * 2);
+  }
+  ssize_t count = 0;
+  do {
+    count = read(file, buffer.data() + end, buffer.size() - end);
+  } while (count == -1 && errno == EINTR);
+  if (count == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Can`t read " + file_path.string());
+  }
+  end += static_cast<size_t>(count);
+  return count != 0;
+}
+
+// Splits the row [begin, row_end) into fields, unquoting them in place:
+// an unquoted field never gets longer.
+void CsvReader::splitRow(size_t row_end) {
+  fields.clear();
+  char *data = buffer.data();
+  size_t i = begin;
+  while (true) {
+    const size_t start = i;
+    size_t out = i;
+    if (i < row_end && data[i] == '"') {
+      ++i;
+      while (i < row_end) {
+        if (data[i] != '"') {
+          data[out++] = data[i++];
+        } else if (i + 1 < row_end && data[i + 1] == '"') {
+          data[out++] = '"';
+          i += 2;
+        } else {
+          ++i;
+          break;
+        }
+      }
+    }
+    while (i < row_end && data[i] != ',') {
+      data[out++] = data[i++];
+    }
+    fields.emplace_back(data + start, out - start);
+    if (i >= row_end) {
+      return;
+    }
+    ++i;
+  }
+}
+
+bool CsvReader::next() {
+  while (true) {
+    // A line break inside quotes does not end the row. Reading more moves
+    // the row to the front, and the scan goes on where it stopped.
+    size_t scan = begin;
+    bool quoted = false;
+    while (true) {
+      for (; scan < end; ++scan) {
+        if (buffer[scan] == '"') {
+          quoted = !quoted;
+        } else if (buffer[scan] == '\n' && !quoted) {
+          break;
+        }
+      }
+      if (scan < end || at_end) {
+        break;
+      }
+      const size_t scanned = scan - begin;
+      at_end = !readMore();
+      scan = begin + scanned;
+    }
+    if (begin == end) {
+      return false;
+    }
+    const size_t next_row = scan < end ? scan + 1 : end;
+    size_t row_end = scan;
+    if (row_end > begin && buffer[row_end - 1] == '\r') {
+      --row_end;
+    }
+    if (row_end > begin) {
+      splitRow(row_end);
+      begin = next_row;
+      return true;
+    }
+    begin = next_row;
+  }
+}
+
+// CatalogReader
+
+CatalogReader::CatalogReader(const std::filesystem::path &path)
+    : csv(path), book_id_column(csv.column("bookID")),
+      title_column(csv.column("title")),
+      authors_column(csv.column("authors")),
+      language_column(csv.column("language_code")),
+      columns(std::max({book_id_column, title_column, authors_column,
+                        language_column}) +
+              1) {}
+
+bool CatalogReader::read(std::vector<Document> &batch) {
+  const size_t first = batch.size();
+  while (batch.size() - first < batch_size && csv.next()) {
+    const auto &row = csv.row();
+    if (row.size() < columns) {
+      continue;
+    }
+    const auto language_code = row[language_column];
+    if (language_code != "eng" && language_code != "en-US") {
+      continue;
+    }
+    const auto book_id = row[book_id_column];
+    size_t id = 0;
+    const auto parsed =
+        std::from_chars(book_id.data(), book_id.data() + book_id.size(), id);
+    if (parsed.ec != std::errc() ||
+        parsed.ptr != book_id.data() + book_id.size()) {
+      throw std::runtime_error("Bad bookID " + std::string(book_id));
+    }
+    std::string authors(row[authors_column]);
+    std::replace(authors.begin(), authors.end(), '/', ' ');
+    batch.push_back({id, std::string(row[title_column]), std::move(authors)});
+  }
+  return batch.size() != first;
+}
+
+std::vector<Document> readCatalog(const std::filesystem::path &path) {
+  CatalogReader catalog(path);
+  std::vector<Document> documents;
+  while (catalog.read(documents)) {
+  }
+  return documents;
+}
+
+} // namespace fts
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <ftslib/indexer.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fts {
+
+// Reads a CSV file row by row through read() in chunks, so memory holds
+// the chunk being parsed rather than the file. Fields are separated by
+// commas; a field in double quotes may hold commas, line breaks and
+// doubled quotes. The first row names the columns.
+class CsvReader {
+private:
+  int file = -1;
+  std::filesystem::path file_path;
+  std::vector<char> buffer;
+  // Unparsed bytes of the buffer.
+  size_t begin = 0;
+  size_t end = 0;
+  bool at_end = false;
+  std::vector<std::string_view> fields;
+  std::vector<std::string> header;
+
+  bool readMore();
+  void splitRow(size_t row_end);
+
+public:
+  explicit CsvReader(const std::filesystem::path &path,
+                     size_t chunk_size = 1 << 20);
+  ~CsvReader();
+  CsvReader(const CsvReader &) = delete;
+  CsvReader &operator=(const CsvReader &) = delete;
+
+  // Position of the column named `name`; throws if there is none.
+  size_t column(std::string_view name) const;
+  // Reads the next row that is not empty; returns false at the end of the
+  // file. The fields point into the buffer and stay valid until the next
+  // call.
+  bool next();
+  const std::vector<std::string_view> &row() const { return fields; }
+};
+
+// Reads the English books of a catalog CSV, a books.csv with the bookID,
+// title, authors and language_code columns, in batches. Co-authors are
+// separated by slashes there and by spaces in the documents.
+class CatalogReader {
+private:
+  CsvReader csv;
+  size_t book_id_column;
+  size_t title_column;
+  size_t authors_column;
+  size_t language_column;
+  size_t columns;
+
+public:
+  static constexpr size_t batch_size = 1024;
+
+  explicit CatalogReader(const std::filesystem::path &path);
+
+  // A DocumentSource: adds up to batch_size documents to `batch`; returns
+  // false with nothing added at the end of the catalog. Throws on a bookID
+  // that is not a number.
+  bool read(std::vector<Document> &batch);
+};
+
+// Every English book of a catalog CSV, see CatalogReader.
+std::vector<Document> readCatalog(const std::filesystem::path &path);
+
+} // namespace fts
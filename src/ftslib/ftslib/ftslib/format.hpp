@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace fts {
+
+// Binary index container: a file header (magic, container version, section
+// count, CRC-32 of the section table), the section table, then the
+// sections. A table entry holds the zero-padded section name, the section
+// version, the CRC-32 of the section, and its 64-bit offset and size. Every
+// section starts at a multiple of section_alignment. Readers look sections
+// up by name and ignore the ones they do not know. As the table checksum
+// changes with the contents, it also serves as the generation of the file.
+
+constexpr char index_magic[8] = {'F', 'T', 'S', 'I', 'N', 'D', 'E', 'X'};
+constexpr std::uint32_t container_version = 1;
+constexpr std::size_t file_header_size = 24;
+constexpr std::size_t section_name_size = 16;
+constexpr std::size_t section_entry_size = 40;
+constexpr std::uint64_t section_alignment = 64;
+
+// Versions of the binary index sections, stored per section in the header.
+
+enum class DictionaryVersion : std::uint8_t {
+  // Serialized trie, one node per character with a linear child list.
+  Trie = 1,
+  // Sorted terms in front-coded blocks with a block offset table in front.
+  FrontCoded = 2,
+};
+
+enum class EntriesVersion : std::uint8_t {
+  // Every doc id, position count and position as a raw uint32_t.
+  Raw = 1,
+  // Blocks of posting_block_size postings: a header with the last doc id
+  // and the payload size, doc id gaps (bit-packed for full blocks, varint
+  // for the tail block), varint term frequencies, then varint position gaps.
+  Compressed = 2,
+  // The blocks of Compressed without their headers, behind a skip table of
+  // (last doc id, block offset) uint32_t pairs, so a cursor can jump to the
+  // block holding a doc id without reading the blocks before it. Terms with
+  // a single block have no skip table.
+  Skipped = 3,
+  // Skipped with the largest term frequency of the term after its doc count
+  // and the largest one of every block as a third skip table field, so
+  // that top-k evaluation can bound the scores of blocks it does not
+  // decode.
+  BlockMax = 4,
+};
+
+constexpr std::uint32_t posting_block_size = 128;
+
+constexpr std::uint8_t docs_version = 2;
+
+// Corpus statistics: uint32_t document, term and field counts and a
+// reserved uint32_t, the uint64_t sum of document lengths of every field,
+// the uint32_t length in words of every document by ordinal for every
+// field, then for every term in dictionary order its entry offset and
+// document frequency as uint32_t and its idf, log(N / df), as a double.
+// Version 1 has only the title field and no field count. Indexes without
+// the section fall back to statistics derived from the docs and entries
+// sections.
+constexpr std::uint32_t stats_version = 2;
+constexpr std::size_t stats_term_size = 16;
+
+// Position of a shard in a sharded index: uint32_t shard number, shard
+// count, ordinal of the first document of the shard in the whole index and
+// document count of the whole index. Shards hold contiguous runs of
+// documents in book id order, each in its own file with every other
+// section; unsharded indexes have no shard section.
+constexpr std::uint32_t shard_version = 1;
+
+struct ShardInfo {
+  std::uint32_t shard;
+  std::uint32_t shard_count;
+  std::uint32_t first_document;
+  std::uint32_t total_documents;
+};
+
+// Number of terms stored in one block of the front-coded dictionary.
+constexpr std::uint32_t dictionary_block_size = 16;
+
+class IndexFormatException : public std::runtime_error {
+public:
+  explicit IndexFormatException(const std::string &what_arg)
+      : std::runtime_error(what_arg) {}
+};
+
+} // namespace fts
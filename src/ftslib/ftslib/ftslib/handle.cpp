@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <ftslib/codec.hpp>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <ftslib/query.hpp>
+#include <ftslib/segment.hpp>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace fts {
+
+// MappedFile
+
+MappedFile::MappedFile(const std::filesystem::path &file_path) {
+  const int file = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Can`t open " + file_path.string());
+  }
+  struct stat file_stat {};
+  if (fstat(file, &file_stat) == -1) {
+    const int error = errno;
+    close(file);
+    throw std::system_error(error, std::generic_category(),
+                            "Can`t stat " + file_path.string());
+  }
+  file_size = static_cast<std::size_t>(file_stat.st_size);
+  if (file_size == 0) {
+    close(file);
+    return;
+  }
+  void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+  const int error = errno;
+  close(file);
+  if (mapped == MAP_FAILED) {
+    throw std::system_error(error, std::generic_category(),
+                            "Can`t map " + file_path.string());
+  }
+  file_data = static_cast<const char *>(mapped);
+}
+
+MappedFile::~MappedFile() {
+  if (file_data != nullptr) {
+    munmap(const_cast<char *>(file_data), file_size);
+  }
+}
+
+// MappedIndex
+
+MappedIndex::MappedIndex(const std::filesystem::path &file_path,
+                         bool verify_checksums)
+    : file(file_path), header_(file.data(), file.size()) {
+  if (verify_checksums) {
+    verifyChecksums();
+  }
+}
+
+std::string_view MappedIndex::section(const std::string &name) const {
+  const auto &info = header_.section(name);
+  return {file.data() + info.offset, info.size};
+}
+
+void MappedIndex::verifyChecksums() const {
+  for (const auto &[name, info] : header_.getSections()) {
+    if (crc32(file.data() + info.offset, info.size) != info.checksum) {
+      throw IndexFormatException("Section " + name + " checksum mismatch");
+    }
+  }
+}
+
+// IndexHandle
+
+IndexHandle::IndexHandle(Config c, const std::filesystem::path &index_path,
+                         std::shared_ptr<ResultCache> result_cache,
+                         TermCacheOptions term_cache)
+    : config(std::move(c)), cache(std::move(result_cache)) {
+  const auto binary_dir = index_path / "binary";
+  const auto segments_dir = index_path / segments_directory;
+  const bool segmented =
+      std::filesystem::exists(segments_dir / manifest_file);
+  if (segmented) {
+    openSegments(segments_dir);
+  } else if (!std::filesystem::exists(binary_dir / "binary") &&
+             std::filesystem::exists(binary_dir / shardFileName(0))) {
+    for (size_t shard = 0;
+         std::filesystem::exists(binary_dir / shardFileName(shard));
+         ++shard) {
+      mappings.push_back(
+          std::make_unique<MappedIndex>(binary_dir / shardFileName(shard)));
+    }
+  } else {
+    mappings.push_back(std::make_unique<MappedIndex>(binary_dir / "binary"));
+  }
+  shards.reserve(mappings.size());
+  for (size_t shard = 0; shard < mappings.size(); ++shard) {
+    shards.emplace_back(
+        mappings[shard]->data(), mappings[shard]->header(),
+        term_cache.capacity_bytes == 0
+            ? nullptr
+            : std::make_shared<TermCache>(term_cache.capacity_bytes /
+                                          mappings.size()));
+    shards.back().warmTermCache(term_cache.warm_terms);
+    const auto *file =
+        shard < deletion_files.size() ? deletion_files[shard].get() : nullptr;
+    deleted.push_back(file == nullptr
+                          ? DeletedDocuments()
+                          : DeletedDocuments(file->data(), file->size()));
+  }
+  // FNV-1a over the generations of the files.
+  generation_ = 14695981039346656037ULL;
+  const auto add_generation = [this](std::uint32_t file_generation) {
+    generation_ = (generation_ ^ file_generation) * 1099511628211ULL;
+  };
+  for (size_t shard = 0; shard < mappings.size(); ++shard) {
+    add_generation(mappings[shard]->header().generation());
+    const auto *file =
+        shard < deletion_files.size() ? deletion_files[shard].get() : nullptr;
+    add_generation(file == nullptr ? 0 : crc32(file->data(), file->size()));
+  }
+  options_key = std::to_string(static_cast<int>(config.getRanking()));
+  const auto add_option = [this](double value) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    options_key += ',';
+    options_key += std::to_string(bits);
+  };
+  add_option(config.getProximityWeight());
+  add_option(config.getBm25K1());
+  add_option(config.getBm25B());
+  for (size_t field = 0; field < field_count; ++field) {
+    add_option(config.getFieldWeight(static_cast<Field>(field)));
+  }
+  if (shards.size() > 1) {
+    if (!segmented) {
+      checkShards();
+    }
+    pool = std::make_unique<ThreadPool>(std::min<size_t>(
+        shards.size() - 1,
+        std::max<unsigned>(1, std::thread::hardware_concurrency())));
+  }
+}
+
+CacheStats IndexHandle::termCacheStats() const {
+  CacheStats total;
+  for (const auto &shard : shards) {
+    if (!shard.termCache()) {
+      continue;
+    }
+    const auto stats = shard.termCache()->stats();
+    total.hits += stats.hits;
+    total.misses += stats.misses;
+    total.evictions += stats.evictions;
+    total.entries += stats.entries;
+    total.bytes += stats.bytes;
+  }
+  return total;
+}
+
+// A writer may replace the manifest and remove the files it no longer
+// lists between reading the manifest and opening them; the manifest is
+// read again then.
+void IndexHandle::openSegments(const std::filesystem::path &directory) {
+  constexpr size_t open_attempts = 5;
+  for (size_t attempt = 1;; ++attempt) {
+    size_t next_generation = 0;
+    const auto segments = readManifest(directory, next_generation);
+    mappings.clear();
+    deletion_files.clear();
+    try {
+      for (const auto &segment : segments) {
+        mappings.push_back(
+            std::make_unique<MappedIndex>(directory / segment.name));
+        deletion_files.push_back(
+            segment.deletions.empty()
+                ? nullptr
+                : std::make_unique<MappedFile>(directory / segment.deletions));
+      }
+      return;
+    } catch (const std::system_error &error) {
+      if (error.code() != std::errc::no_such_file_or_directory ||
+          attempt == open_attempts) {
+        throw;
+      }
+    }
+  }
+}
+
+// Every shard has to come from the same build, in order and without gaps.
+void IndexHandle::checkShards() const {
+  std::uint32_t first_document = 0;
+  for (size_t shard = 0; shard < mappings.size(); ++shard) {
+    ShardInfo info{};
+    const auto &header = mappings[shard]->header();
+    const bool has_info = header.hasSection("shard") &&
+                          mappings[shard]->section("shard").size() ==
+                              sizeof(info);
+    if (has_info) {
+      std::memcpy(&info, mappings[shard]->section("shard").data(),
+                  sizeof(info));
+    }
+    if (!has_info || info.shard != shard ||
+        info.shard_count != mappings.size() ||
+        info.first_document != first_document) {
+      throw IndexFormatException("Shard " + std::to_string(shard) +
+                                 " does not belong to the index");
+    }
+    double docs = 0.0;
+    shards[shard].totalDocs(docs);
+    first_document += static_cast<std::uint32_t>(docs);
+    if (shard + 1 == mappings.size() &&
+        info.total_documents != first_document) {
+      throw IndexFormatException("Index shards are missing documents");
+    }
+  }
+}
+
+// The shards are ranked with the statistics of the whole index, so their
+// scores compare as in an unsharded index. Documents of a shard are stored
+// in book id order, so ties broken by book id break as by ordinal. Deleted
+// documents of segments still count in the statistics until their segment
+// is merged. The calling thread ranks the first shard itself.
+template <class Search>
+std::vector<Result> IndexHandle::searchShards(const std::string &query,
+                                              Search search_shard) const {
+  std::vector<std::string> terms;
+  for (const auto &term : parseQuery(query, config).terms) {
+    terms.push_back(term);
+    terms.push_back(fieldTerm(Field::Authors, term));
+  }
+  const auto corpus = corpusStats(shards, terms);
+
+  std::vector<std::future<std::vector<Result>>> parts;
+  for (size_t shard = 1; shard < shards.size(); ++shard) {
+    parts.push_back(pool->submit([this, &corpus, &search_shard, shard]() {
+      return search_shard(
+          ShardAccessor(shards, shard, corpus, deleted[shard]));
+    }));
+  }
+  std::vector<Result> results;
+  std::exception_ptr error;
+  try {
+    results = search_shard(ShardAccessor(shards, 0, corpus, deleted[0]));
+  } catch (...) {
+    error = std::current_exception();
+  }
+  // Every part refers to `corpus`, so all of them finish before returning.
+  for (auto &part : parts) {
+    try {
+      auto part_results = part.get();
+      std::move(part_results.begin(), part_results.end(),
+                std::back_inserter(results));
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  sortResults(results);
+  return results;
+}
+
+// Scores depend on the configuration only through options_key and the
+// parsed query, so equal keys get equal results from the same generation.
+template <class Search>
+std::vector<Result> IndexHandle::searchCached(const std::string &query,
+                                              const std::string &page,
+                                              Search search_index) const {
+  if (!cache) {
+    return search_index();
+  }
+  auto key = queryKey(parseQuery(query, config));
+  key += '|';
+  key += options_key;
+  key += '|';
+  key += page;
+  if (auto results = cache->find(generation_, key)) {
+    return std::move(*results);
+  }
+  auto results = search_index();
+  cache->insert(generation_, key, results);
+  return results;
+}
+
+std::vector<Result> IndexHandle::search(const std::string &query) const {
+  return searchCached(query, "all", [this, &query]() {
+    return searchIndex(query);
+  });
+}
+
+std::vector<Result> IndexHandle::search(const std::string &query, size_t k,
+                                        size_t offset) const {
+  return searchCached(query,
+                      std::to_string(k) + ',' + std::to_string(offset),
+                      [this, &query, k, offset]() {
+                        return searchIndex(query, k, offset);
+                      });
+}
+
+std::vector<Result> IndexHandle::searchIndex(const std::string &query) const {
+  if (shards.empty()) {
+    return {};
+  }
+  if (shards.size() == 1 && deleted.front().empty()) {
+    return fts::search(config, shards.front(), query);
+  }
+  return searchShards(query, [this, &query](const IndexAccessor &shard) {
+    return fts::search(config, shard, query);
+  });
+}
+
+std::vector<Result> IndexHandle::searchIndex(const std::string &query,
+                                             size_t k, size_t offset) const {
+  if (shards.empty()) {
+    return {};
+  }
+  if (shards.size() == 1 && deleted.front().empty()) {
+    return fts::search(config, shards.front(), query, k, offset);
+  }
+  auto results =
+      searchShards(query, [this, &query, k, offset](const IndexAccessor &shard) {
+        return fts::search(config, shard, query, offset + k);
+      });
+  results.erase(results.begin(),
+                results.begin() + static_cast<std::ptrdiff_t>(
+                                      std::min(offset, results.size())));
+  results.resize(std::min(k, results.size()));
+  return results;
+}
+
+} // namespace fts
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ftslib/cache.hpp>
+#include <ftslib/parser.hpp>
+#include <ftslib/pool.hpp>
+#include <ftslib/searcher.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fts {
+
+// Read-only mapping of a whole file, unmapped on destruction.
+class MappedFile {
+private:
+  const char *file_data = nullptr;
+  std::size_t file_size = 0;
+
+public:
+  explicit MappedFile(const std::filesystem::path &file_path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  const char *data() const { return file_data; }
+  std::size_t size() const { return file_size; }
+};
+
+// Read-only binary index file. The file header and the section table are
+// validated against the file size once, on construction, so the accessors
+// can trust every section to lie inside the mapping. With verify_checksums
+// the contents of every section are checked against their CRC-32 as well.
+class MappedIndex {
+private:
+  MappedFile file;
+  Header header_;
+
+public:
+  explicit MappedIndex(const std::filesystem::path &file_path,
+                       bool verify_checksums = false);
+  const char *data() const { return file.data(); }
+  std::size_t size() const { return file.size(); }
+  const Header &header() const { return header_; }
+  std::string_view section(const std::string &name) const;
+  // Throws IndexFormatException naming the first corrupted section.
+  void verifyChecksums() const;
+};
+
+// Term caches of a handle, one per index file (see BinaryIndexAccessor),
+// splitting capacity_bytes evenly. When the handle is opened, the postings
+// of the warm_terms terms with the most documents of every file are decoded
+// into them.
+struct TermCacheOptions {
+  size_t capacity_bytes = 0;
+  size_t warm_terms = 0;
+};
+
+// Long-lived handle to a binary index: owns the mappings, the parsed
+// headers, the section accessors and the configuration used to parse
+// queries. A sharded index is searched on every shard in parallel, on a
+// pool owned by the handle, and the shard rankings are merged; so is a
+// segmented index (see SegmentedIndex), as of its manifest when the handle
+// is opened. Everything is immutable after construction, so one handle can
+// be shared by any number of threads searching concurrently. With a result
+// cache, searches look their normalized query up there first; with term
+// caches, queries share the dictionary lookups and decoded postings of
+// their terms.
+class IndexHandle {
+private:
+  Config config;
+  std::vector<std::unique_ptr<MappedIndex>> mappings;
+  std::vector<BinaryIndexAccessor> shards;
+  // Deletion bitmaps of the segments, one per shard of a segmented index.
+  std::vector<std::unique_ptr<MappedFile>> deletion_files;
+  std::vector<DeletedDocuments> deleted;
+  std::unique_ptr<ThreadPool> pool;
+  std::shared_ptr<ResultCache> cache;
+  std::uint64_t generation_ = 0;
+  // Configuration that changes scores but not the parsed query.
+  std::string options_key;
+
+  void openSegments(const std::filesystem::path &directory);
+  void checkShards() const;
+  template <class Search>
+  std::vector<Result> searchShards(const std::string &query,
+                                   Search search_shard) const;
+  template <class Search>
+  std::vector<Result> searchCached(const std::string &query,
+                                   const std::string &page,
+                                   Search search_index) const;
+  std::vector<Result> searchIndex(const std::string &query) const;
+  std::vector<Result> searchIndex(const std::string &query, size_t k,
+                                  size_t offset) const;
+
+public:
+  explicit IndexHandle(Config c, const std::filesystem::path &index_path,
+                       std::shared_ptr<ResultCache> result_cache = nullptr,
+                       TermCacheOptions term_cache = TermCacheOptions());
+  const Config &getConfig() const { return config; }
+  size_t shardCount() const { return shards.size(); }
+  // Identifies the contents of the index files opened, from the table
+  // checksum of every file (see Header::generation()) and the deletions of
+  // every segment. A rebuilt index gets another generation unless its
+  // contents are the same.
+  std::uint64_t generation() const { return generation_; }
+  // Summed over the term caches of every file; all zero without them.
+  CacheStats termCacheStats() const;
+  std::vector<Result> search(const std::string &query) const;
+  std::vector<Result> search(const std::string &query, size_t k,
+                             size_t offset = 0) const;
+};
+
+} // namespace fts
@@ -1,51 +1,400 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <exception>
 #include <fstream>
+#include <ftslib/codec.hpp>
 #include <ftslib/indexer.hpp>
 #include <ftslib/parser.hpp>
+#include <ftslib/pool.hpp>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <picosha2.h>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
 
 namespace fts {
 
+// Index
+
+std::string_view Index::store(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  auto *data = static_cast<char *>(arena.allocate(text.size(), 1));
+  std::memcpy(data, text.data(), text.size());
+  return {data, text.size()};
+}
+
+std::optional<std::uint32_t> Index::addDocument(size_t document_id,
+                                                std::string_view name_of_doc) {
+  const std::uint32_t slot = docs.size();
+  if (!doc_slots.emplace(document_id, slot).second) {
+    return std::nullopt;
+  }
+  docs.push_back({document_id, store(name_of_doc)});
+  return slot;
+}
+
+std::uint32_t Index::internTerm(std::string_view term) {
+  const auto it = term_ids.find(term);
+  if (it != term_ids.end()) {
+    return it->second;
+  }
+  const std::uint32_t term_id = terms.size();
+  terms.push_back(store(term));
+  term_ids.emplace(terms.back(), term_id);
+  occurrences_.emplace_back();
+  return term_id;
+}
+
+std::vector<std::uint32_t> Index::sortedDocuments() const {
+  std::vector<std::uint32_t> slots(docs.size());
+  std::iota(slots.begin(), slots.end(), 0);
+  std::sort(slots.begin(), slots.end(), [&](auto lhs, auto rhs) {
+    return docs[lhs].document_id < docs[rhs].document_id;
+  });
+  return slots;
+}
+
+std::vector<std::uint32_t> Index::sortedTerms() const {
+  std::vector<std::uint32_t> term_order(terms.size());
+  std::iota(term_order.begin(), term_order.end(), 0);
+  std::sort(term_order.begin(), term_order.end(),
+            [&](auto lhs, auto rhs) { return terms[lhs] < terms[rhs]; });
+  return term_order;
+}
+
+void Index::clear() {
+  // The containers drop their arena storage first, then the arena hands all
+  // of it back at once.
+  occurrences_ = decltype(occurrences_)(&arena);
+  terms = decltype(terms)(&arena);
+  term_ids = decltype(term_ids)(&arena);
+  doc_slots = decltype(doc_slots)(&arena);
+  docs = decltype(docs)(&arena);
+  arena.release();
+}
+
+std::map<size_t, std::string> Index::getDocs() const {
+  std::map<size_t, std::string> result;
+  for (const auto &doc : docs) {
+    result.emplace(doc.document_id, doc.name_of_doc);
+  }
+  return result;
+}
+
+std::map<std::string, std::map<size_t, std::vector<size_t>>>
+Index::getEntries() const {
+  std::map<std::string, std::map<size_t, std::vector<size_t>>> result;
+  for (std::uint32_t term_id = 0; term_id < terms.size(); ++term_id) {
+    auto &entry = result[std::string(terms[term_id])];
+    for (const auto &occurrence : occurrences_[term_id]) {
+      entry[docs[occurrence.document].document_id].push_back(
+          occurrence.position);
+    }
+  }
+  return result;
+}
+
 // IndexBuilder
 
 void IndexBuilder::addDocument(size_t document_id,
                                const std::string &name_of_doc,
-                               const Config &config) {
-  if (index_.getDocs().find(document_id) == index_.getDocs().end()) {
-    index_.getDocs()[document_id] = name_of_doc;
-    const std::vector<ParsedString> parsed_text = parse(name_of_doc, config);
-    for (const auto &word : parsed_text) {
-      for (const auto &term : word.word_ngrams) {
-        index_.getEntries()[term][document_id].push_back(word.word_position);
+                               const Config &config,
+                               std::string_view authors) {
+  const auto slot = index_.addDocument(document_id, name_of_doc);
+  if (!slot) {
+    return;
+  }
+  tokenize(name_of_doc, config, tokenizer_context,
+           [&](std::string_view term, size_t word_position) {
+             index_.addOccurrence(term, *slot, word_position);
+           });
+  tokenize(authors, config, tokenizer_context,
+           [&](std::string_view term, size_t word_position) {
+             author_term.assign(author_prefix);
+             author_term += term;
+             index_.addOccurrence(author_term, *slot, word_position);
+           });
+}
+
+// Runs fn(begin, end, part) on `threads` threads over contiguous parts of
+// [0, count).
+template <class Function>
+static void parallel_for(size_t count, size_t threads, Function fn) {
+  threads = std::max<size_t>(1, std::min(threads, count));
+  std::vector<std::thread> workers;
+  for (size_t part = 0; part < threads; ++part) {
+    const size_t begin = count * part / threads;
+    const size_t end = count * (part + 1) / threads;
+    if (part + 1 == threads) {
+      fn(begin, end, part);
+    } else {
+      workers.emplace_back(fn, begin, end, part);
+    }
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void IndexBuilder::addDocuments(const std::vector<Document> &documents,
+                                const Config &config, size_t threads) {
+  threads = std::max<size_t>(1, std::min(threads, documents.size()));
+  std::vector<IndexBuilder> partial(threads);
+  parallel_for(documents.size(), threads,
+               [&](size_t begin, size_t end, size_t part) {
+                 for (size_t i = begin; i < end; ++i) {
+                   partial[part].addDocument(documents[i].document_id,
+                                             documents[i].name_of_doc, config,
+                                             documents[i].authors);
+                 }
+               });
+  for (auto &builder : partial) {
+    merge(builder.getIndex());
+  }
+}
+
+// Pushes the batches of `source` to `batches` until either ends, then
+// closes the queue so the workers finish. Returns what `source` threw.
+template <class Batch, class MakeItem>
+static std::exception_ptr readBatches(const DocumentSource &source,
+                                      BoundedQueue<Batch> &batches,
+                                      MakeItem make_item) {
+  std::exception_ptr error;
+  try {
+    std::vector<Document> batch;
+    for (size_t sequence = 0; source(batch); ++sequence) {
+      if (!batches.push(make_item(sequence, std::move(batch)))) {
+        break;
+      }
+      batch.clear();
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  batches.close();
+  return error;
+}
+
+void IndexBuilder::addDocuments(const DocumentSource &source,
+                                const Config &config, size_t threads,
+                                size_t queued_batches) {
+  using Batch = std::pair<size_t, std::vector<Document>>;
+  BoundedQueue<Batch> batches(queued_batches);
+  std::mutex merge_mutex;
+  std::condition_variable merged;
+  size_t next_merge = 0;
+  std::exception_ptr error;
+
+  const auto work = [&]() {
+    IndexBuilder partial;
+    while (auto batch = batches.pop()) {
+      std::exception_ptr batch_error;
+      try {
+        for (const auto &document : batch->second) {
+          partial.addDocument(document.document_id, document.name_of_doc,
+                              config, document.authors);
+        }
+      } catch (...) {
+        batch_error = std::current_exception();
+        batches.close();
+      }
+      // Every batch takes its turn, so a failed one does not hold up the
+      // batches after it.
+      std::unique_lock<std::mutex> lock(merge_mutex);
+      merged.wait(lock, [&]() { return next_merge == batch->first; });
+      if (batch_error && !error) {
+        error = batch_error;
       }
+      if (!error) {
+        merge(partial.getIndex());
+      }
+      partial.getIndex().clear();
+      ++next_merge;
+      merged.notify_all();
     }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < std::max<size_t>(1, threads); ++i) {
+    workers.emplace_back(work);
+  }
+  const auto read_error =
+      readBatches(source, batches, [](size_t sequence, auto batch) {
+        return Batch(sequence, std::move(batch));
+      });
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (read_error) {
+    std::rethrow_exception(read_error);
+  }
+  if (error) {
+    std::rethrow_exception(error);
   }
 }
 
+void IndexBuilder::merge(Index &other) {
+  // Documents already indexed here win; their occurrences in `other` are
+  // dropped, and so are terms left without occurrences.
+  std::vector<std::optional<std::uint32_t>> slots(other.docCount());
+  for (std::uint32_t slot = 0; slot < other.docCount(); ++slot) {
+    const auto &doc = other.document(slot);
+    slots[slot] = index_.addDocument(doc.document_id, doc.name_of_doc);
+  }
+  for (std::uint32_t term_id = 0; term_id < other.termCount(); ++term_id) {
+    std::optional<std::uint32_t> local_id;
+    for (const auto &occurrence : other.occurrences(term_id)) {
+      const auto slot = slots[occurrence.document];
+      if (!slot) {
+        continue;
+      }
+      if (!local_id) {
+        local_id = index_.internTerm(other.term(term_id));
+      }
+      index_.addOccurrence(*local_id, *slot, occurrence.position);
+    }
+  }
+  other.clear();
+}
+
+// Writers
+
+// Maps document slots to dense ordinals given the slots in book id order.
+static std::vector<std::uint32_t>
+documentOrdinals(const std::vector<std::uint32_t> &sorted_docs) {
+  std::vector<std::uint32_t> doc_ordinal(sorted_docs.size());
+  for (std::uint32_t ordinal = 0; ordinal < sorted_docs.size(); ++ordinal) {
+    doc_ordinal[sorted_docs[ordinal]] = ordinal;
+  }
+  return doc_ordinal;
+}
+
+// Fills `postings` with the term's occurrences as (ordinal, position) pairs
+// ordered by ordinal, then position.
+static void collectPostings(const Index &index, std::uint32_t term_id,
+                            const std::vector<std::uint32_t> &doc_ordinal,
+                            std::vector<Occurrence> &postings) {
+  postings.clear();
+  for (const auto &occurrence : index.occurrences(term_id)) {
+    postings.push_back({doc_ordinal[occurrence.document], occurrence.position});
+  }
+  const auto by_document = [](const Occurrence &lhs, const Occurrence &rhs) {
+    return lhs.document < rhs.document;
+  };
+  if (!std::is_sorted(postings.begin(), postings.end(), by_document)) {
+    std::stable_sort(postings.begin(), postings.end(), by_document);
+  }
+}
+
+// End of the run of postings of the same document starting at `begin`.
+static size_t documentEnd(const std::vector<Occurrence> &postings,
+                          size_t begin) {
+  size_t end = begin;
+  while (end < postings.size() &&
+         postings[end].document == postings[begin].document) {
+    ++end;
+  }
+  return end;
+}
+
+static std::uint32_t countDocuments(const std::vector<Occurrence> &postings) {
+  std::uint32_t doc_count = 0;
+  for (size_t i = 0; i < postings.size(); i = documentEnd(postings, i)) {
+    ++doc_count;
+  }
+  return doc_count;
+}
+
+using FieldLengths = std::array<std::vector<std::uint32_t>, field_count>;
+
+// Number of words each field of each document spans, by ordinal: one past
+// the last position of any of the field's terms.
+static FieldLengths
+documentLengths(const Index &index,
+                const std::vector<std::uint32_t> &doc_ordinal) {
+  FieldLengths lengths;
+  for (auto &field_lengths : lengths) {
+    field_lengths.assign(doc_ordinal.size(), 0);
+  }
+  for (std::uint32_t term_id = 0; term_id < index.termCount(); ++term_id) {
+    auto &field_lengths =
+        lengths[static_cast<size_t>(termField(index.term(term_id)))];
+    for (const auto &occurrence : index.occurrences(term_id)) {
+      auto &length = field_lengths[doc_ordinal[occurrence.document]];
+      length = std::max(length, occurrence.position + 1);
+    }
+  }
+  return lengths;
+}
+
+// The occurrences of one document are adjacent in insertion order too.
+static std::uint32_t documentFrequency(const Index &index,
+                                       std::uint32_t term_id) {
+  const auto &occurrences = index.occurrences(term_id);
+  std::uint32_t doc_count = 0;
+  for (size_t i = 0; i < occurrences.size(); ++i) {
+    if (i == 0 || occurrences[i].document != occurrences[i - 1].document) {
+      ++doc_count;
+    }
+  }
+  return doc_count;
+}
+
 // TextIndexWrite
 
 void TextIndexWriter::write(const std::filesystem::path &path_of_doc,
                             Index &index) {
   std::filesystem::create_directories(path_of_doc / "text");
   std::filesystem::create_directories(path_of_doc / "text/docs");
-  for (const auto &[doc_id, doc] : index.getDocs()) {
-    std::ofstream file(path_of_doc / "text/docs" / std::to_string(doc_id));
-    file << doc;
+  const auto sorted_docs = index.sortedDocuments();
+  const auto doc_ordinal = documentOrdinals(sorted_docs);
+  std::ofstream ids_file(path_of_doc / "text/ids");
+  for (std::uint32_t ordinal = 0; ordinal < sorted_docs.size(); ++ordinal) {
+    const auto &doc = index.document(sorted_docs[ordinal]);
+    std::ofstream file(path_of_doc / "text/docs" / std::to_string(ordinal));
+    file << doc.name_of_doc;
+    ids_file << doc.document_id << '\n';
+  }
+
+  // Document count, then a line per field with the total length and the
+  // length of every document.
+  const auto lengths = documentLengths(index, doc_ordinal);
+  std::ofstream stats_file(path_of_doc / "text/stats");
+  stats_file << sorted_docs.size();
+  for (const auto &field_lengths : lengths) {
+    stats_file << ' '
+               << std::accumulate(field_lengths.begin(), field_lengths.end(),
+                                  std::uint64_t{0});
+    for (const auto length : field_lengths) {
+      stats_file << ' ' << length;
+    }
+    stats_file << '\n';
   }
 
   std::filesystem::create_directories(path_of_doc / "text/entries");
-  for (auto &[term, entry] : index.getEntries()) {
+  std::vector<Occurrence> postings;
+  for (const auto term_id : index.sortedTerms()) {
+    const auto term = index.term(term_id);
+    collectPostings(index, term_id, doc_ordinal, postings);
     std::string hash_hex_term;
-    picosha2::hash256_hex_string(term, hash_hex_term);
+    picosha2::hash256_hex_string(term.begin(), term.end(), hash_hex_term);
     std::ofstream file(path_of_doc / "text/entries" /
                        hash_hex_term.substr(0, 6));
 
-    file << term + ' ' + std::to_string(entry.size());
-    for (const auto &[doc_id, position] : entry) {
-      file << ' ' + std::to_string(doc_id) + ' ' +
-                  std::to_string(position.size());
-      for (const auto &pos : position) {
-        file << ' ' + std::to_string(pos);
+    file << term << ' ' << countDocuments(postings);
+    for (size_t i = 0; i < postings.size();) {
+      const size_t end = documentEnd(postings, i);
+      file << ' ' << postings[i].document << ' ' << end - i;
+      for (; i < end; ++i) {
+        file << ' ' << postings[i].position;
       }
     }
   }
@@ -53,107 +402,960 @@ void TextIndexWriter::write(const std::filesystem::path &path_of_doc,
 
 // BinaryIndexWrite
 
-static void writeHeader(BinaryBuffer &bin_buf) {
-  const std::uint8_t section_count = 3;
-  const std::uint32_t section_offset = 3;
-  bin_buf.write(&section_count, sizeof(section_count));
-  std::vector<std::string> section_name = {"dictionary", "entries", "docs"};
+struct Section {
+  std::string name;
+  std::uint32_t version;
+  const BinaryBuffer &data;
+};
 
-  for (const auto &section : section_name) {
-    const std::uint8_t section_size = section.size() + 1;
+// Section table entry of a section already encoded or streamed to disk.
+struct SectionEntry {
+  std::string name;
+  std::uint32_t version;
+  std::uint32_t checksum;
+  std::uint64_t size;
+};
+
+static std::uint64_t alignSection(std::uint64_t offset) {
+  return (offset + section_alignment - 1) / section_alignment *
+         section_alignment;
+}
 
-    bin_buf.write(&section_size, sizeof(section_size));
-    bin_buf.write(section.data(), section_size - 1);
-    bin_buf.write(&section_offset, sizeof(section_offset));
+// Writes the file header and the section table; the sections follow at the
+// offsets recorded in the table.
+static void writeHeader(BinaryBuffer &bin_buf,
+                        const std::vector<SectionEntry> &sections) {
+  BinaryBuffer table;
+  std::uint64_t section_offset = alignSection(
+      file_header_size + sections.size() * section_entry_size);
+  for (const auto &section : sections) {
+    if (section.name.size() >= section_name_size) {
+      throw IndexFormatException("Section name is too long: " + section.name);
+    }
+    char name[section_name_size] = {};
+    std::memcpy(name, section.name.data(), section.name.size());
+    table.write(name, sizeof(name));
+    table.write(&section.version, sizeof(section.version));
+    table.write(&section.checksum, sizeof(section.checksum));
+    table.write(&section_offset, sizeof(section_offset));
+    table.write(&section.size, sizeof(section.size));
+    section_offset = alignSection(section_offset + section.size);
   }
+
+  const std::uint32_t section_count = sections.size();
+  const std::uint32_t table_checksum =
+      crc32(table.data().data(), table.size());
+  const std::uint32_t reserved = 0;
+  bin_buf.write(index_magic, sizeof(index_magic));
+  bin_buf.write(&container_version, sizeof(container_version));
+  bin_buf.write(&section_count, sizeof(section_count));
+  bin_buf.write(&table_checksum, sizeof(table_checksum));
+  bin_buf.write(&reserved, sizeof(reserved));
+  bin_buf.write(table.data().data(), table.size());
 }
 
-static std::unordered_map<size_t, std::uint32_t>
-writeDocs(BinaryBuffer &bin_buf, Index &index) {
-  std::unordered_map<size_t, std::uint32_t> doc_offset;
-  const std::uint32_t docs_size = index.getDocs().size();
+// Sections address their own contents with uint32_t offsets.
+static void checkSectionSize(const std::string &name, std::uint64_t size) {
+  if (size > std::numeric_limits<std::uint32_t>::max()) {
+    throw IndexFormatException("Section " + name + " exceeds 4 GiB");
+  }
+}
+
+// Documents get dense ordinal ids in book id order; the section keeps the
+// ordinal -> book id table and the title offsets in front of the titles.
+static void writeDocs(BinaryBuffer &bin_buf, const Index &index,
+                      const std::vector<std::uint32_t> &sorted_docs) {
+  const std::uint32_t docs_size = sorted_docs.size();
   bin_buf.write(&docs_size, sizeof(docs_size));
 
-  for (const auto &[docs_id, docs] : index.getDocs()) {
-    doc_offset[docs_id] = bin_buf.size();
-    const std::uint8_t doc_size = docs.size() + 1;
-    bin_buf.write(&doc_size, sizeof(doc_size));
-    bin_buf.write(docs.data(), doc_size - 1);
+  for (const auto slot : sorted_docs) {
+    const std::uint64_t book_id = index.document(slot).document_id;
+    bin_buf.write(&book_id, sizeof(book_id));
+  }
+
+  std::uint32_t title_offset = bin_buf.size() +
+                               (docs_size + 1) * sizeof(title_offset);
+  bin_buf.write(&title_offset, sizeof(title_offset));
+  for (const auto slot : sorted_docs) {
+    title_offset += index.document(slot).name_of_doc.size();
+    bin_buf.write(&title_offset, sizeof(title_offset));
+  }
+  for (const auto slot : sorted_docs) {
+    const auto title = index.document(slot).name_of_doc;
+    bin_buf.write(title.data(), title.size());
   }
-  return doc_offset;
 }
 
-static void writeDictionary(
-    BinaryBuffer &bin_buf, Index &index,
-    std::unordered_map<std::string, std::uint32_t> &entry_offset) {
+static void
+writeTrieDictionary(BinaryBuffer &bin_buf, const Index &index,
+                    const std::vector<std::uint32_t> &sorted_terms,
+                    const std::vector<std::uint32_t> &entry_offset) {
   Trie trie;
-  for (const auto &[term, entry] : index.getEntries()) {
-    trie.add(term, 0);
+  for (size_t i = 0; i < sorted_terms.size(); ++i) {
+    trie.add(index.term(sorted_terms[i]), entry_offset[i]);
   }
-  trie.serialize(bin_buf, entry_offset);
+  trie.serialize(bin_buf);
 }
 
-static std::unordered_map<std::string, std::uint32_t>
-writeEntries(BinaryBuffer &bin_buf, Index &index,
-             std::unordered_map<size_t, std::uint32_t> &doc_offset) {
-  std::unordered_map<std::string, std::uint32_t> entry_offset;
-  for (auto &[term, entry] : index.getEntries()) {
-    entry_offset[term] = bin_buf.size();
+// Term records follow the dictionary order, so their entry offsets ascend
+// and a reader can binary-search them.
+static void writeStats(BinaryBuffer &bin_buf, const Index &index,
+                       const std::vector<std::uint32_t> &sorted_terms,
+                       const std::vector<std::uint32_t> &doc_ordinal,
+                       const std::vector<std::uint32_t> &entry_offset) {
+  const auto lengths = documentLengths(index, doc_ordinal);
+  const std::uint32_t docs_size = doc_ordinal.size();
+  const std::uint32_t terms_size = sorted_terms.size();
+  const std::uint32_t fields_size = field_count;
+  const std::uint32_t reserved = 0;
+  bin_buf.write(&docs_size, sizeof(docs_size));
+  bin_buf.write(&terms_size, sizeof(terms_size));
+  bin_buf.write(&fields_size, sizeof(fields_size));
+  bin_buf.write(&reserved, sizeof(reserved));
+  for (const auto &field_lengths : lengths) {
+    const std::uint64_t total_length = std::accumulate(
+        field_lengths.begin(), field_lengths.end(), std::uint64_t{0});
+    bin_buf.write(&total_length, sizeof(total_length));
+  }
+  for (const auto &field_lengths : lengths) {
+    bin_buf.write(field_lengths.data(),
+                  field_lengths.size() * sizeof(std::uint32_t));
+  }
+
+  for (size_t i = 0; i < sorted_terms.size(); ++i) {
+    const std::uint32_t df = documentFrequency(index, sorted_terms[i]);
+    const double idf =
+        std::log(static_cast<double>(docs_size) / static_cast<double>(df));
+    bin_buf.write(&entry_offset[i], sizeof(std::uint32_t));
+    bin_buf.write(&df, sizeof(df));
+    bin_buf.write(&idf, sizeof(idf));
+  }
+}
+
+// Terms come sorted out of the index, so each block stores its first term in
+// full and every following term as (shared prefix length, suffix).
+static void
+writeFrontCodedDictionary(BinaryBuffer &bin_buf, const Index &index,
+                          const std::vector<std::uint32_t> &sorted_terms,
+                          const std::vector<std::uint32_t> &entry_offset) {
+  const std::uint32_t term_count = sorted_terms.size();
+  const std::uint32_t block_count =
+      (term_count + dictionary_block_size - 1) / dictionary_block_size;
+  bin_buf.write(&term_count, sizeof(term_count));
+  bin_buf.write(&block_count, sizeof(block_count));
+
+  std::size_t block_offset_pos = bin_buf.size();
+  const std::uint32_t zero = 0;
+  for (std::uint32_t i = 0; i < block_count; ++i) {
+    bin_buf.write(&zero, sizeof(zero));
+  }
+
+  std::string_view prev_term;
+  for (std::uint32_t i = 0; i < term_count; ++i) {
+    const auto term = index.term(sorted_terms[i]);
+    if (term.size() > std::numeric_limits<std::uint8_t>::max()) {
+      throw IndexFormatException("Term is too long for dictionary: " +
+                                 std::string(term));
+    }
+    std::uint8_t shared = 0;
+    if (i % dictionary_block_size == 0) {
+      const std::uint32_t block_offset = bin_buf.size();
+      bin_buf.writeTo(&block_offset, sizeof(block_offset), block_offset_pos);
+      block_offset_pos += sizeof(block_offset);
+    } else {
+      const auto mismatch = std::mismatch(term.begin(), term.end(),
+                                          prev_term.begin(), prev_term.end());
+      shared = mismatch.first - term.begin();
+    }
+    const std::uint8_t suffix_size = term.size() - shared;
+    bin_buf.write(&shared, sizeof(shared));
+    bin_buf.write(&suffix_size, sizeof(suffix_size));
+    bin_buf.write(term.data() + shared, suffix_size);
+    bin_buf.write(&entry_offset[i], sizeof(std::uint32_t));
+    prev_term = term;
+  }
+}
+
+static void writeRawPostings(BinaryBuffer &bin_buf,
+                             const std::vector<Occurrence> &postings) {
+  const std::uint32_t doc_count = countDocuments(postings);
+  bin_buf.write(&doc_count, sizeof(doc_count));
+
+  for (size_t i = 0; i < postings.size();) {
+    const size_t end = documentEnd(postings, i);
+    const std::uint32_t pos_count = end - i;
+    bin_buf.write(&postings[i].document, sizeof(std::uint32_t));
+    bin_buf.write(&pos_count, sizeof(pos_count));
+
+    for (; i < end; ++i) {
+      bin_buf.write(&postings[i].position, sizeof(std::uint32_t));
+    }
+  }
+}
+
+static void writeVarint(BinaryBuffer &bin_buf, std::uint32_t value) {
+  std::uint8_t bytes[max_varint_size];
+  bin_buf.write(bytes, encodeVarint(value, bytes));
+}
+
+static void writeCompressedPostings(BinaryBuffer &bin_buf,
+                                    const std::vector<Occurrence> &postings,
+                                    EntriesVersion version) {
+  writeVarint(bin_buf, countDocuments(postings));
+
+  std::vector<std::uint32_t> block_last_docs;
+  std::vector<std::uint32_t> block_max_frequencies;
+  std::vector<BinaryBuffer> payloads;
+  std::uint32_t prev_doc = 0;
+  size_t i = 0;
+  while (i < postings.size()) {
+    // Start of every document run in the block, plus the end of the last.
+    std::vector<std::uint32_t> gaps;
+    std::vector<size_t> starts;
+    for (; i < postings.size() && gaps.size() < posting_block_size;
+         i = documentEnd(postings, i)) {
+      gaps.push_back(postings[i].document - prev_doc);
+      starts.push_back(i);
+      prev_doc = postings[i].document;
+    }
+    starts.push_back(i);
+
+    BinaryBuffer &payload = payloads.emplace_back();
+    if (gaps.size() == posting_block_size) {
+      const std::uint8_t bit_width = maxBitWidth(gaps.data());
+      std::vector<std::uint32_t> packed(4 * static_cast<size_t>(bit_width));
+      packBlock(gaps.data(), bit_width, packed.data());
+      payload.write(&bit_width, sizeof(bit_width));
+      payload.write(packed.data(), packed.size() * sizeof(std::uint32_t));
+    } else {
+      for (const auto gap : gaps) {
+        writeVarint(payload, gap);
+      }
+    }
+    std::uint32_t max_frequency = 0;
+    for (size_t doc = 0; doc < gaps.size(); ++doc) {
+      const auto frequency =
+          static_cast<std::uint32_t>(starts[doc + 1] - starts[doc]);
+      writeVarint(payload, frequency);
+      max_frequency = std::max(max_frequency, frequency);
+    }
+    for (size_t doc = 0; doc < gaps.size(); ++doc) {
+      std::uint32_t prev_pos = 0;
+      for (size_t pos = starts[doc]; pos < starts[doc + 1]; ++pos) {
+        writeVarint(payload, postings[pos].position - prev_pos);
+        prev_pos = postings[pos].position;
+      }
+    }
+    block_last_docs.push_back(prev_doc);
+    block_max_frequencies.push_back(max_frequency);
+  }
+
+  if (version == EntriesVersion::Compressed) {
+    for (size_t block = 0; block < payloads.size(); ++block) {
+      writeVarint(bin_buf, block_last_docs[block]);
+      writeVarint(bin_buf, payloads[block].size());
+      bin_buf.write(payloads[block].data().data(), payloads[block].size());
+    }
+    return;
+  }
+  const bool block_max = version == EntriesVersion::BlockMax;
+  if (block_max) {
+    writeVarint(bin_buf, *std::max_element(block_max_frequencies.begin(),
+                                           block_max_frequencies.end()));
+  }
+  if (payloads.size() > 1) {
+    std::uint32_t block_offset = 0;
+    for (size_t block = 0; block < payloads.size(); ++block) {
+      bin_buf.write(&block_last_docs[block], sizeof(std::uint32_t));
+      bin_buf.write(&block_offset, sizeof(block_offset));
+      if (block_max) {
+        bin_buf.write(&block_max_frequencies[block], sizeof(std::uint32_t));
+      }
+      block_offset += payloads[block].size();
+    }
+  }
+  for (const auto &payload : payloads) {
+    bin_buf.write(payload.data().data(), payload.size());
+  }
+}
 
-    const std::uint32_t doc_count = entry.size();
-    bin_buf.write(&doc_count, sizeof(doc_count));
+// Terms are split into contiguous ranges encoded on separate threads, then
+// the per-thread buffers are concatenated in term order. Returns the entry
+// offset of every term in `sorted_terms` order.
+static std::vector<std::uint32_t>
+writeEntries(BinaryBuffer &bin_buf, const Index &index,
+             const std::vector<std::uint32_t> &sorted_terms,
+             const std::vector<std::uint32_t> &doc_ordinal,
+             EntriesVersion version, size_t threads) {
+  threads = std::max<size_t>(1, std::min(threads, sorted_terms.size()));
+  std::vector<BinaryBuffer> parts(threads);
+  std::vector<std::uint32_t> offsets(sorted_terms.size());
+  parallel_for(sorted_terms.size(), threads,
+               [&](size_t begin, size_t end, size_t part) {
+                 std::vector<Occurrence> postings;
+                 for (size_t i = begin; i < end; ++i) {
+                   collectPostings(index, sorted_terms[i], doc_ordinal,
+                                   postings);
+                   offsets[i] = parts[part].size();
+                   if (version == EntriesVersion::Raw) {
+                     writeRawPostings(parts[part], postings);
+                   } else {
+                     writeCompressedPostings(parts[part], postings,
+                                             version);
+                   }
+                 }
+               });
 
-    for (const auto &[doc_id, position] : entry) {
+  for (size_t part = 0; part < threads; ++part) {
+    const std::uint32_t part_offset = bin_buf.size();
+    for (size_t i = sorted_terms.size() * part / threads;
+         i < sorted_terms.size() * (part + 1) / threads; ++i) {
+      offsets[i] += part_offset;
+    }
+    bin_buf.write(parts[part].data().data(), parts[part].size());
+  }
+  return offsets;
+}
 
-      const std::uint32_t pos_count = position.size();
-      bin_buf.write(&doc_offset[doc_id], sizeof(doc_offset[doc_id]));
-      bin_buf.write(&pos_count, sizeof(pos_count));
+std::string shardFileName(size_t shard) {
+  return "shard." + std::to_string(shard);
+}
 
-      for (const auto &pos : position) {
-        const std::uint32_t position = pos;
-        bin_buf.write(&position, sizeof(position));
+// Copies the documents sorted_docs[begin, end) of `index` with their
+// occurrences into `shard`.
+static void copyShard(const Index &index,
+                      const std::vector<std::uint32_t> &sorted_docs,
+                      size_t begin, size_t end, Index &shard) {
+  constexpr auto absent = std::numeric_limits<std::uint32_t>::max();
+  std::vector<std::uint32_t> shard_slot(index.docCount(), absent);
+  for (size_t i = begin; i < end; ++i) {
+    const auto &document = index.document(sorted_docs[i]);
+    shard_slot[sorted_docs[i]] =
+        *shard.addDocument(document.document_id, document.name_of_doc);
+  }
+  for (std::uint32_t term_id = 0; term_id < index.termCount(); ++term_id) {
+    std::optional<std::uint32_t> shard_term;
+    for (const auto &occurrence : index.occurrences(term_id)) {
+      const auto slot = shard_slot[occurrence.document];
+      if (slot == absent) {
+        continue;
+      }
+      if (!shard_term) {
+        shard_term = shard.internTerm(index.term(term_id));
       }
+      shard.addOccurrence(*shard_term, slot, occurrence.position);
     }
   }
-  return entry_offset;
 }
 
+// Shards are built and written one at a time, so at most one copy of a
+// shard is held next to the index.
 void BinaryIndexWriter::write(const std::filesystem::path &path_of_doc,
                               Index &index) {
-  std::filesystem::create_directories(path_of_doc / "binary");
-  std::ofstream binfile(path_of_doc / "binary/binary", std::ios_base::binary);
+  const auto binary_dir = path_of_doc / "binary";
+  std::filesystem::create_directories(binary_dir);
+  const size_t shard_count =
+      std::max<size_t>(1, std::min(shards, index.docCount()));
+  for (size_t shard = shard_count == 1 ? 0 : shard_count;
+       std::filesystem::exists(binary_dir / shardFileName(shard)); ++shard) {
+    std::filesystem::remove(binary_dir / shardFileName(shard));
+  }
+  if (shard_count == 1) {
+    writeFile(binary_dir / "binary", index, std::nullopt);
+    return;
+  }
+  std::filesystem::remove(binary_dir / "binary");
+
+  const auto sorted_docs = index.sortedDocuments();
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    const size_t begin = sorted_docs.size() * shard / shard_count;
+    const size_t end = sorted_docs.size() * (shard + 1) / shard_count;
+    Index shard_index;
+    copyShard(index, sorted_docs, begin, end, shard_index);
+    const ShardInfo info{static_cast<std::uint32_t>(shard),
+                         static_cast<std::uint32_t>(shard_count),
+                         static_cast<std::uint32_t>(begin),
+                         static_cast<std::uint32_t>(sorted_docs.size())};
+    writeFile(binary_dir / shardFileName(shard), shard_index, info);
+  }
+}
+
+void BinaryIndexWriter::writeFile(const std::filesystem::path &file_path,
+                                  const Index &index,
+                                  const std::optional<ShardInfo> &shard) const {
+  std::ofstream binfile(file_path, std::ios_base::binary);
 
   BinaryBuffer header_buf;
   BinaryBuffer dictionary_buf;
   BinaryBuffer docs_buf;
   BinaryBuffer entries_buf;
+  BinaryBuffer stats_buf;
 
-  writeHeader(header_buf);
-  auto doc_offset = writeDocs(docs_buf, index);
-  auto entry_offset = writeEntries(entries_buf, index, doc_offset);
-  writeDictionary(dictionary_buf, index, entry_offset);
-
-  const std::uint32_t dictionary_offset = header_buf.size();
-  header_buf.writeTo(&dictionary_offset, sizeof(dictionary_offset),
-                     static_cast<size_t>(12));
-
-  const std::uint32_t entries_offset =
-      dictionary_offset + dictionary_buf.size();
-  header_buf.writeTo(&entries_offset, sizeof(entries_offset),
-                     static_cast<size_t>(24));
+  const auto sorted_docs = index.sortedDocuments();
+  const auto sorted_terms = index.sortedTerms();
+  const auto doc_ordinal = documentOrdinals(sorted_docs);
+  writeDocs(docs_buf, index, sorted_docs);
+  const auto entry_offset = writeEntries(entries_buf, index, sorted_terms,
+                                         doc_ordinal, entries_version, threads);
+  writeStats(stats_buf, index, sorted_terms, doc_ordinal, entry_offset);
+  if (dictionary_version == DictionaryVersion::Trie) {
+    writeTrieDictionary(dictionary_buf, index, sorted_terms, entry_offset);
+  } else {
+    writeFrontCodedDictionary(dictionary_buf, index, sorted_terms,
+                              entry_offset);
+  }
 
-  const std::uint32_t docs_offset = entries_offset + entries_buf.size();
-  header_buf.writeTo(&docs_offset, sizeof(docs_offset),
-                     static_cast<size_t>(33));
+  std::vector<Section> sections = {
+      {"dictionary", static_cast<std::uint32_t>(dictionary_version),
+       dictionary_buf},
+      {"entries", static_cast<std::uint32_t>(entries_version), entries_buf},
+      {"docs", docs_version, docs_buf},
+      {"stats", stats_version, stats_buf}};
+  BinaryBuffer shard_buf;
+  if (shard) {
+    shard_buf.write(&*shard, sizeof(ShardInfo));
+    sections.push_back({"shard", shard_version, shard_buf});
+  }
+  std::vector<SectionEntry> entries;
+  for (const auto &section : sections) {
+    checkSectionSize(section.name, section.data.size());
+    entries.push_back(
+        {section.name, section.version,
+         crc32(section.data.data().data(), section.data.size()),
+         section.data.size()});
+  }
+  writeHeader(header_buf, entries);
 
   binfile.write(header_buf.data().data(),
                 static_cast<std::streamsize>(header_buf.size()));
-  binfile.write(dictionary_buf.data().data(),
-                static_cast<std::streamsize>(dictionary_buf.size()));
-  binfile.write(entries_buf.data().data(),
-                static_cast<std::streamsize>(entries_buf.size()));
-  binfile.write(docs_buf.data().data(),
-                static_cast<std::streamsize>(docs_buf.size()));
+  std::uint64_t written = header_buf.size();
+  const char padding[section_alignment] = {};
+  for (const auto &section : sections) {
+    const std::uint64_t padding_size = alignSection(written) - written;
+    binfile.write(padding, static_cast<std::streamsize>(padding_size));
+    binfile.write(section.data.data().data(),
+                  static_cast<std::streamsize>(section.data.size()));
+    written += padding_size + section.data.size();
+  }
+}
+
+// StreamingIndexBuilder
+
+namespace {
+
+// Output file written through a fixed-size buffer. Keeps the CRC-32 of the
+// bytes written since the last resetChecksum().
+class BufferedFile {
+private:
+  std::filesystem::path file_path;
+  std::ofstream file;
+  std::vector<char> buffer;
+  std::uint64_t written = 0;
+  std::uint32_t crc = 0;
+
+public:
+  explicit BufferedFile(const std::filesystem::path &path,
+                        size_t buffer_size = 1 << 16)
+      : file_path(path), file(path, std::ios::binary | std::ios::trunc) {
+    if (!file) {
+      throw std::runtime_error("Can`t create " + file_path.string());
+    }
+    buffer.reserve(buffer_size);
+  }
+
+  void write(const void *data, size_t size) {
+    crc = crc32(data, size, crc);
+    written += size;
+    const auto *bytes = static_cast<const char *>(data);
+    if (buffer.size() + size > buffer.capacity()) {
+      flush();
+    }
+    if (size >= buffer.capacity()) {
+      file.write(bytes, static_cast<std::streamsize>(size));
+      return;
+    }
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+  void write(const BinaryBuffer &bin_buf) {
+    write(bin_buf.data().data(), bin_buf.size());
+  }
+  // Appends the whole file at `path`.
+  void append(const std::filesystem::path &path) {
+    std::ifstream input(path, std::ios::binary);
+    std::vector<char> chunk(1 << 16);
+    while (input) {
+      input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+      write(chunk.data(), static_cast<size_t>(input.gcount()));
+    }
+  }
+  // Replaces bytes already written; the checksum is left alone.
+  void overwrite(std::uint64_t offset, const void *data, size_t size) {
+    flush();
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(static_cast<const char *>(data),
+               static_cast<std::streamsize>(size));
+    file.seekp(0, std::ios::end);
+  }
+  void flush() {
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+    if (!file) {
+      throw std::runtime_error("Can`t write " + file_path.string());
+    }
+  }
+  void close() {
+    flush();
+    file.close();
+  }
+  std::uint64_t size() const { return written; }
+  std::uint32_t checksum() const { return crc; }
+  void resetChecksum() { crc = 0; }
+};
+
+template <class Value>
+void readValue(std::ifstream &file, Value &value) {
+  file.read(reinterpret_cast<char *>(&value), sizeof(value));
+}
+
+// Spilled occurrences, in term, book id and position order: groups of a
+// term (uint8_t size and bytes) and the uint32_t count of the
+// (uint64_t book id, uint32_t position) records that follow.
+class OccurrenceRun {
+private:
+  std::ifstream file;
+  std::string term_;
+  std::uint32_t left = 0;
+  std::uint64_t document_id_ = 0;
+  std::uint32_t position_ = 0;
+
+public:
+  explicit OccurrenceRun(const std::filesystem::path &path)
+      : file(path, std::ios::binary) {}
+  bool next() {
+    if (left == 0) {
+      std::uint8_t size = 0;
+      readValue(file, size);
+      if (!file) {
+        return false;
+      }
+      term_.resize(size);
+      file.read(term_.data(), size);
+      readValue(file, left);
+    }
+    readValue(file, document_id_);
+    readValue(file, position_);
+    if (!file) {
+      throw IndexFormatException("Broken spill run");
+    }
+    --left;
+    return true;
+  }
+  const std::string &term() const { return term_; }
+  std::uint64_t documentId() const { return document_id_; }
+  std::uint32_t position() const { return position_; }
+};
+
+// Spilled documents in book id order: uint64_t book id, uint32_t title size
+// and the title.
+class DocumentRun {
+private:
+  std::ifstream file;
+  std::uint64_t document_id_ = 0;
+  std::string title_;
+
+public:
+  explicit DocumentRun(const std::filesystem::path &path)
+      : file(path, std::ios::binary) {}
+  bool next() {
+    readValue(file, document_id_);
+    if (!file) {
+      return false;
+    }
+    std::uint32_t size = 0;
+    readValue(file, size);
+    title_.resize(size);
+    file.read(title_.data(), size);
+    if (!file) {
+      throw IndexFormatException("Broken spill run");
+    }
+    return true;
+  }
+  std::uint64_t documentId() const { return document_id_; }
+  const std::string &title() const { return title_; }
+};
+
+// Opens every run file and queues the runs that are not empty, smallest
+// first by `later`.
+template <class Run, class Later>
+std::priority_queue<Run *, std::vector<Run *>, Later>
+openRuns(const std::filesystem::path &spill_dir, const std::string &prefix,
+         size_t runs, std::vector<std::unique_ptr<Run>> &readers,
+         Later later) {
+  std::priority_queue<Run *, std::vector<Run *>, Later> queue(later);
+  for (size_t run = 0; run < runs; ++run) {
+    readers.push_back(std::make_unique<Run>(
+        spill_dir / (prefix + "." + std::to_string(run))));
+    if (readers.back()->next()) {
+      queue.push(readers.back().get());
+    }
+  }
+  return queue;
+}
+
+} // namespace
+
+StreamingIndexBuilder::StreamingIndexBuilder(
+    const std::filesystem::path &index_path, size_t memory_budget_bytes,
+    EntriesVersion entries_v)
+    : index_dir(index_path), spill_dir(index_path / "binary" / "spill"),
+      memory_budget(memory_budget_bytes), entries_version(entries_v) {
+  std::filesystem::remove_all(spill_dir);
+}
+
+StreamingIndexBuilder::~StreamingIndexBuilder() {
+  std::error_code error;
+  std::filesystem::remove_all(spill_dir, error);
+}
+
+void StreamingIndexBuilder::addOccurrence(std::string_view term,
+                                          size_t document_id,
+                                          size_t position) {
+  auto it = run_term_ids.find(term);
+  if (it == run_term_ids.end()) {
+    const std::uint32_t term_id = run_terms.size();
+    run_terms.emplace_back(term);
+    it = run_term_ids.emplace(run_terms.back(), term_id).first;
+    // The string, its map node and its bucket.
+    run_bytes += term.size() + 64;
+  }
+  run_occurrences.push_back({document_id, it->second,
+                             static_cast<std::uint32_t>(position)});
+  run_bytes += sizeof(RunOccurrence);
+}
+
+void StreamingIndexBuilder::addDocument(size_t document_id,
+                                        const std::string &name_of_doc,
+                                        const Config &config,
+                                        std::string_view authors) {
+  if (!document_ids.insert(document_id).second) {
+    return;
+  }
+  run_documents.emplace_back(document_id, name_of_doc);
+  run_bytes += sizeof(run_documents.back()) + name_of_doc.size();
+  tokenize(name_of_doc, config, tokenizer_context,
+           [&](std::string_view term, size_t word_position) {
+             addOccurrence(term, document_id, word_position);
+           });
+  tokenize(authors, config, tokenizer_context,
+           [&](std::string_view term, size_t word_position) {
+             author_term.assign(author_prefix);
+             author_term += term;
+             addOccurrence(author_term, document_id, word_position);
+           });
+  if (run_bytes >= memory_budget) {
+    spill();
+  }
+}
+
+void StreamingIndexBuilder::addDocuments(const DocumentSource &source,
+                                         const Config &config,
+                                         size_t queued_batches) {
+  BoundedQueue<std::vector<Document>> batches(queued_batches);
+  std::exception_ptr error;
+  std::thread worker([&]() {
+    try {
+      while (auto batch = batches.pop()) {
+        for (const auto &document : *batch) {
+          addDocument(document.document_id, document.name_of_doc, config,
+                      document.authors);
+        }
+      }
+    } catch (...) {
+      error = std::current_exception();
+      batches.close();
+    }
+  });
+  const auto read_error = readBatches(
+      source, batches, [](size_t, auto batch) { return batch; });
+  worker.join();
+  if (read_error) {
+    std::rethrow_exception(read_error);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Writes the buffered run sorted, as terms.<run> and docs.<run>.
+void StreamingIndexBuilder::spill() {
+  if (run_documents.empty()) {
+    return;
+  }
+  std::filesystem::create_directories(spill_dir);
+  std::vector<std::uint32_t> term_rank(run_terms.size());
+  {
+    std::vector<std::uint32_t> term_order(run_terms.size());
+    std::iota(term_order.begin(), term_order.end(), 0);
+    std::sort(term_order.begin(), term_order.end(), [&](auto lhs, auto rhs) {
+      return run_terms[lhs] < run_terms[rhs];
+    });
+    for (std::uint32_t rank = 0; rank < term_order.size(); ++rank) {
+      term_rank[term_order[rank]] = rank;
+    }
+  }
+  std::sort(run_occurrences.begin(), run_occurrences.end(),
+            [&](const auto &lhs, const auto &rhs) {
+              return std::tie(term_rank[lhs.term], lhs.document_id,
+                              lhs.position) <
+                     std::tie(term_rank[rhs.term], rhs.document_id,
+                              rhs.position);
+            });
+
+  const auto run = std::to_string(runs);
+  BufferedFile terms_file(spill_dir / ("terms." + run));
+  for (size_t i = 0; i < run_occurrences.size();) {
+    const auto term_id = run_occurrences[i].term;
+    size_t end = i;
+    while (end < run_occurrences.size() &&
+           run_occurrences[end].term == term_id) {
+      ++end;
+    }
+    const auto &term = run_terms[term_id];
+    if (term.size() > std::numeric_limits<std::uint8_t>::max()) {
+      throw IndexFormatException("Term is too long for dictionary: " + term);
+    }
+    const std::uint8_t term_size = term.size();
+    const std::uint32_t count = end - i;
+    terms_file.write(&term_size, sizeof(term_size));
+    terms_file.write(term.data(), term.size());
+    terms_file.write(&count, sizeof(count));
+    for (; i < end; ++i) {
+      terms_file.write(&run_occurrences[i].document_id,
+                       sizeof(std::uint64_t));
+      terms_file.write(&run_occurrences[i].position, sizeof(std::uint32_t));
+    }
+  }
+  terms_file.close();
+
+  std::sort(run_documents.begin(), run_documents.end(),
+            [](const auto &lhs, const auto &rhs) {
+              return lhs.first < rhs.first;
+            });
+  BufferedFile docs_file(spill_dir / ("docs." + run));
+  for (const auto &[document_id, title] : run_documents) {
+    const std::uint64_t book_id = document_id;
+    const std::uint32_t title_size = title.size();
+    docs_file.write(&book_id, sizeof(book_id));
+    docs_file.write(&title_size, sizeof(title_size));
+    docs_file.write(title.data(), title.size());
+  }
+  docs_file.close();
+
+  ++runs;
+  run_term_ids.clear();
+  run_terms.clear();
+  run_occurrences.clear();
+  run_documents.clear();
+  run_bytes = 0;
+}
+
+// The sections are laid out as BinaryIndexWriter::writeFile lays them out.
+// Their parts known only once every term is merged (the dictionary block
+// table, the document lengths) are kept in memory, the rest is spilled and
+// appended behind them.
+void StreamingIndexBuilder::finish() {
+  spill();
+  std::filesystem::create_directories(spill_dir);
+
+  std::vector<std::uint64_t> book_ids;
+  std::vector<std::uint32_t> title_ends;
+  {
+    std::vector<std::unique_ptr<DocumentRun>> readers;
+    auto queue = openRuns(spill_dir, "docs", runs, readers,
+                          [](const DocumentRun *lhs, const DocumentRun *rhs) {
+                            return lhs->documentId() > rhs->documentId();
+                          });
+    BufferedFile titles(spill_dir / "titles");
+    std::uint32_t title_end = 0;
+    while (!queue.empty()) {
+      auto *run = queue.top();
+      queue.pop();
+      book_ids.push_back(run->documentId());
+      titles.write(run->title().data(), run->title().size());
+      title_end += run->title().size();
+      title_ends.push_back(title_end);
+      if (run->next()) {
+        queue.push(run);
+      }
+    }
+    titles.close();
+  }
+
+  const std::uint32_t docs_size = book_ids.size();
+  FieldLengths lengths;
+  for (auto &field_lengths : lengths) {
+    field_lengths.assign(docs_size, 0);
+  }
+  std::uint32_t term_count = 0;
+  std::vector<std::uint32_t> block_offsets;
+  {
+    std::vector<std::unique_ptr<OccurrenceRun>> readers;
+    // Every document is in one run, so the occurrences of a term in a
+    // document come from one run in position order.
+    auto queue = openRuns(
+        spill_dir, "terms", runs, readers,
+        [](const OccurrenceRun *lhs, const OccurrenceRun *rhs) {
+          if (lhs->term() != rhs->term()) {
+            return lhs->term() > rhs->term();
+          }
+          return lhs->documentId() > rhs->documentId();
+        });
+    BufferedFile entries(spill_dir / "entries");
+    BufferedFile dictionary(spill_dir / "dictionary");
+    BufferedFile term_stats(spill_dir / "terms");
+    std::vector<Occurrence> postings;
+    BinaryBuffer encoded;
+    std::string term;
+    std::string prev_term;
+    while (!queue.empty()) {
+      term = queue.top()->term();
+      postings.clear();
+      while (!queue.empty() && queue.top()->term() == term) {
+        auto *run = queue.top();
+        queue.pop();
+        const auto ordinal = static_cast<std::uint32_t>(
+            std::lower_bound(book_ids.begin(), book_ids.end(),
+                             run->documentId()) -
+            book_ids.begin());
+        postings.push_back({ordinal, run->position()});
+        if (run->next()) {
+          queue.push(run);
+        }
+      }
+
+      auto &field_lengths = lengths[static_cast<size_t>(termField(term))];
+      for (const auto &occurrence : postings) {
+        auto &length = field_lengths[occurrence.document];
+        length = std::max(length, occurrence.position + 1);
+      }
+
+      checkSectionSize("entries", entries.size());
+      const std::uint32_t entry_offset = entries.size();
+      encoded.data().clear();
+      if (entries_version == EntriesVersion::Raw) {
+        writeRawPostings(encoded, postings);
+      } else {
+        writeCompressedPostings(encoded, postings, entries_version);
+      }
+      entries.write(encoded);
+
+      // Front-coded as by writeFrontCodedDictionary, with block offsets
+      // relative to the first block.
+      std::uint8_t shared = 0;
+      if (term_count % dictionary_block_size == 0) {
+        block_offsets.push_back(dictionary.size());
+      } else {
+        const auto mismatch = std::mismatch(term.begin(), term.end(),
+                                            prev_term.begin(),
+                                            prev_term.end());
+        shared = mismatch.first - term.begin();
+      }
+      const std::uint8_t suffix_size = term.size() - shared;
+      dictionary.write(&shared, sizeof(shared));
+      dictionary.write(&suffix_size, sizeof(suffix_size));
+      dictionary.write(term.data() + shared, suffix_size);
+      dictionary.write(&entry_offset, sizeof(entry_offset));
+      prev_term = term;
+
+      const std::uint32_t df = countDocuments(postings);
+      const double idf =
+          std::log(static_cast<double>(docs_size) / static_cast<double>(df));
+      term_stats.write(&entry_offset, sizeof(entry_offset));
+      term_stats.write(&df, sizeof(df));
+      term_stats.write(&idf, sizeof(idf));
+      ++term_count;
+    }
+    entries.close();
+    dictionary.close();
+    term_stats.close();
+  }
+
+  const auto binary_dir = index_dir / "binary";
+  std::filesystem::create_directories(binary_dir);
+  for (size_t shard = 0;
+       std::filesystem::exists(binary_dir / shardFileName(shard)); ++shard) {
+    std::filesystem::remove(binary_dir / shardFileName(shard));
+  }
+  constexpr size_t section_count = 4;
+  BufferedFile file(binary_dir / "binary");
+  const std::vector<char> header_space(file_header_size +
+                                       section_count * section_entry_size);
+  file.write(header_space.data(), header_space.size());
+  std::vector<SectionEntry> sections;
+  const char padding[section_alignment] = {};
+  const auto write_section = [&](const std::string &name,
+                                 std::uint32_t version, const auto &contents) {
+    file.write(padding, alignSection(file.size()) - file.size());
+    file.resetChecksum();
+    const std::uint64_t begin = file.size();
+    contents();
+    checkSectionSize(name, file.size() - begin);
+    sections.push_back({name, version, file.checksum(), file.size() - begin});
+  };
+
+  write_section(
+      "dictionary", static_cast<std::uint32_t>(DictionaryVersion::FrontCoded),
+      [&]() {
+        const std::uint32_t block_count = block_offsets.size();
+        const std::uint32_t table_size =
+            (2 + block_count) * sizeof(std::uint32_t);
+        file.write(&term_count, sizeof(term_count));
+        file.write(&block_count, sizeof(block_count));
+        for (const auto offset : block_offsets) {
+          const std::uint32_t block_offset = table_size + offset;
+          file.write(&block_offset, sizeof(block_offset));
+        }
+        file.append(spill_dir / "dictionary");
+      });
+  write_section("entries", static_cast<std::uint32_t>(entries_version),
+                [&]() { file.append(spill_dir / "entries"); });
+  write_section("docs", docs_version, [&]() {
+    file.write(&docs_size, sizeof(docs_size));
+    file.write(book_ids.data(), book_ids.size() * sizeof(std::uint64_t));
+    const std::uint32_t first_title =
+        sizeof(docs_size) + docs_size * sizeof(std::uint64_t) +
+        (docs_size + 1) * sizeof(std::uint32_t);
+    file.write(&first_title, sizeof(first_title));
+    for (const auto title_end : title_ends) {
+      const std::uint32_t title_offset = first_title + title_end;
+      file.write(&title_offset, sizeof(title_offset));
+    }
+    file.append(spill_dir / "titles");
+  });
+  write_section("stats", stats_version, [&]() {
+    const std::uint32_t fields_size = field_count;
+    const std::uint32_t reserved = 0;
+    file.write(&docs_size, sizeof(docs_size));
+    file.write(&term_count, sizeof(term_count));
+    file.write(&fields_size, sizeof(fields_size));
+    file.write(&reserved, sizeof(reserved));
+    for (const auto &field_lengths : lengths) {
+      const std::uint64_t total_length = std::accumulate(
+          field_lengths.begin(), field_lengths.end(), std::uint64_t{0});
+      file.write(&total_length, sizeof(total_length));
+    }
+    for (const auto &field_lengths : lengths) {
+      file.write(field_lengths.data(),
+                 field_lengths.size() * sizeof(std::uint32_t));
+    }
+    file.append(spill_dir / "terms");
+  });
+
+  BinaryBuffer header_buf;
+  writeHeader(header_buf, sections);
+  file.overwrite(0, header_buf.data().data(), header_buf.size());
+  file.close();
+  std::filesystem::remove_all(spill_dir);
 }
 
 // BinaryBuffer
@@ -173,30 +1375,30 @@ void BinaryBuffer::writeTo(const void *src, size_t size, size_t offset) {
 
 // Trie
 
-void Trie::add(const std::string &word, std::uint32_t entry_offset) {
-  TrieNode *next_p = root.get();
+TrieNode *Trie::newNode() {
+  std::pmr::polymorphic_allocator<TrieNode> allocator(&arena);
+  TrieNode *node = allocator.allocate(1);
+  allocator.construct(node, &arena);
+  return node;
+}
+
+void Trie::add(std::string_view word, std::uint32_t entry_offset) {
+  TrieNode *next_p = root;
   for (const auto &ch : word) {
-    const auto search_it = next_p->children_node.find(ch);
-    if (search_it == next_p->children_node.end()) {
-      next_p->children_node[ch] = std::make_unique<TrieNode>();
+    auto &child = next_p->children_node[ch];
+    if (child == nullptr) {
+      child = newNode();
     }
-    next_p = next_p->children_node[ch].get();
+    next_p = child;
   }
   next_p->is_leaf = 1;
   next_p->entry_offset = entry_offset;
 }
 
-void Trie::serialize(BinaryBuffer &bin_buf,
-                     const std::unordered_map<std::string, std::uint32_t>
-                         &entry_offset) const {
-  std::string term;
-  serialize_(root.get(), bin_buf, entry_offset, term);
-}
+void Trie::serialize(BinaryBuffer &bin_buf) const { serialize_(root, bin_buf); }
 
-std::uint32_t Trie::serialize_(
-    const TrieNode *next_p, BinaryBuffer &bin_buf,
-    const std::unordered_map<std::string, std::uint32_t> &entry_offset,
-    std::string &term) const {
+std::uint32_t Trie::serialize_(const TrieNode *next_p,
+                               BinaryBuffer &bin_buf) const {
   const std::uint32_t start_pos_write = bin_buf.size();
   const std::uint32_t childs_count = next_p->children_node.size();
   const std::uint32_t zero = 0xffffffff;
@@ -213,19 +1415,13 @@ std::uint32_t Trie::serialize_(
   }
   bin_buf.write(&is_leaf, sizeof(is_leaf));
   if (is_leaf == 1) {
-    const std::uint32_t offset = entry_offset.at(term);
-    bin_buf.write(&offset, sizeof(offset));
+    bin_buf.write(&next_p->entry_offset, sizeof(next_p->entry_offset));
   }
   for (const auto &[key, trie_node] : next_p->children_node) {
-    term.push_back(key);
-    const std::uint32_t child_offset =
-        serialize_(trie_node.get(), bin_buf, entry_offset, term);
+    const std::uint32_t child_offset = serialize_(trie_node, bin_buf);
     bin_buf.writeTo(&child_offset, sizeof(child_offset), start_child_offset);
     start_child_offset += sizeof(child_offset);
   }
-  if (!std::empty(term)) {
-    term.pop_back();
-  }
   return start_pos_write;
 }
 
@@ -1,34 +1,122 @@
 #pragma once
 
+#include <deque>
 #include <filesystem>
+#include <ftslib/format.hpp>
 #include <ftslib/parser.hpp>
+#include <functional>
 #include <map>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace fts {
 
+// Occurrence of a term: the document slot (its position in insertion order)
+// and the word position inside the document.
+struct Occurrence {
+  std::uint32_t document;
+  std::uint32_t position;
+};
+
+struct DocumentRef {
+  size_t document_id;
+  std::string_view name_of_doc;
+};
+
+// In-memory index owned by a monotonic arena: titles and terms are copied
+// into it once, terms are interned to dense ids and every term appends its
+// occurrences to a flat buffer. Nothing is freed until clear() or
+// destruction, which release the whole arena at once.
 class Index {
 private:
-  std::map<size_t, std::string> docs;
-  std::map<std::string, std::map<size_t, std::vector<size_t>>> entries;
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::vector<DocumentRef> docs{&arena};
+  std::pmr::unordered_map<size_t, std::uint32_t> doc_slots{&arena};
+  std::pmr::unordered_map<std::string_view, std::uint32_t> term_ids{&arena};
+  std::pmr::vector<std::string_view> terms{&arena};
+  std::pmr::vector<std::pmr::vector<Occurrence>> occurrences_{&arena};
+
+  std::string_view store(std::string_view text);
 
 public:
   explicit Index() = default;
-  std::map<size_t, std::string> &getDocs() { return docs; }
-  std::map<std::string, std::map<size_t, std::vector<size_t>>> &getEntries() {
-    return entries;
+  Index(const Index &) = delete;
+  Index &operator=(const Index &) = delete;
+
+  // Returns the slot of the new document, or nothing if the id is indexed.
+  std::optional<std::uint32_t> addDocument(size_t document_id,
+                                           std::string_view name_of_doc);
+  std::uint32_t internTerm(std::string_view term);
+  void addOccurrence(std::uint32_t term_id, std::uint32_t document,
+                     std::uint32_t position) {
+    occurrences_[term_id].push_back({document, position});
+  }
+  void addOccurrence(std::string_view term, std::uint32_t document,
+                     std::uint32_t position) {
+    addOccurrence(internTerm(term), document, position);
   }
+
+  size_t docCount() const { return docs.size(); }
+  size_t termCount() const { return terms.size(); }
+  const DocumentRef &document(std::uint32_t slot) const { return docs[slot]; }
+  std::string_view term(std::uint32_t term_id) const {
+    return terms[term_id];
+  }
+  // Occurrences of the term in insertion order.
+  const std::pmr::vector<Occurrence> &
+  occurrences(std::uint32_t term_id) const {
+    return occurrences_[term_id];
+  }
+  // Document slots in book id order.
+  std::vector<std::uint32_t> sortedDocuments() const;
+  // Term ids in term order.
+  std::vector<std::uint32_t> sortedTerms() const;
+  void clear();
+
+  // Copies of the index as ordered maps keyed by book id, for inspection.
+  std::map<size_t, std::string> getDocs() const;
+  std::map<std::string, std::map<size_t, std::vector<size_t>>>
+  getEntries() const;
+};
+
+struct Document {
+  size_t document_id;
+  std::string name_of_doc;
+  std::string authors;
 };
 
+// Fills `batch`, given empty, with the next documents; returns false with
+// nothing added once there are none left.
+using DocumentSource = std::function<bool(std::vector<Document> &batch)>;
+
 class IndexBuilder {
 private:
   Index index_;
+  TokenizerContext tokenizer_context;
+  std::string author_term;
 
 public:
   explicit IndexBuilder() { Index index_; };
+  // Author words are indexed as author terms, see fieldTerm().
   void addDocument(size_t document_id, const std::string &name_of_doc,
-                   const Config &config);
+                   const Config &config, std::string_view authors = {});
+  // Splits the documents between `threads` workers that build partial
+  // indexes, then merges them in order, so the result is the same as
+  // adding the documents one by one.
+  void addDocuments(const std::vector<Document> &documents,
+                    const Config &config, size_t threads);
+  // Reads batches from `source` on the calling thread while `threads`
+  // workers index the batches read before, at most queued_batches ahead.
+  // The workers merge their batches in reading order, so the result is
+  // the same as well.
+  void addDocuments(const DocumentSource &source, const Config &config,
+                    size_t threads, size_t queued_batches = 4);
+  // Moves every document of `other` that is not indexed yet into this index.
+  void merge(Index &other);
   Index &getIndex() { return index_; }
 };
 
@@ -40,6 +128,7 @@ public:
   void write(const void *src, size_t size);
   void writeTo(const void *src, size_t size, size_t offset);
   std::vector<char> &data() { return binary_data; };
+  const std::vector<char> &data() const { return binary_data; };
   std::size_t size() const { return binary_data.size(); };
 };
 
@@ -54,32 +143,112 @@ public:
   void write(const std::filesystem::path &path_of_doc, Index &index) override;
 };
 
+// Writes binary/binary, or with more than one shard binary/shard.<i> for
+// every shard, see ShardInfo. Files of the other layout are removed.
 class BinaryIndexWriter : public IndexWriter {
+private:
+  DictionaryVersion dictionary_version;
+  EntriesVersion entries_version;
+  size_t threads;
+  size_t shards;
+
 public:
+  explicit BinaryIndexWriter(
+      DictionaryVersion dictionary_v = DictionaryVersion::FrontCoded,
+      EntriesVersion entries_v = EntriesVersion::BlockMax,
+      size_t threads_count = 1, size_t shards_count = 1)
+      : dictionary_version(dictionary_v), entries_version(entries_v),
+        threads(threads_count), shards(shards_count) {}
   void write(const std::filesystem::path &path_of_doc, Index &index) override;
+  // Writes the whole index as one container file, as a shard if given.
+  void writeFile(const std::filesystem::path &file_path, const Index &index,
+                 const std::optional<ShardInfo> &shard = std::nullopt) const;
 };
 
+// Builds the binary index of a catalog larger than memory. Occurrences and
+// titles are buffered until they take about memory_budget bytes, then
+// sorted and spilled to a run file in <index>/binary/spill. finish() merges
+// the runs and streams every section to binary/binary through a buffered
+// writer, with the same contents BinaryIndexWriter writes for the same
+// documents and a front-coded dictionary. Besides the budget, the builder
+// holds a few words per document (book id, title offset, field lengths)
+// and the postings of one term at a time.
+class StreamingIndexBuilder {
+private:
+  struct RunOccurrence {
+    std::uint64_t document_id;
+    std::uint32_t term;
+    std::uint32_t position;
+  };
+
+  std::filesystem::path index_dir;
+  std::filesystem::path spill_dir;
+  size_t memory_budget;
+  EntriesVersion entries_version;
+  TokenizerContext tokenizer_context;
+  std::string author_term;
+  std::unordered_set<size_t> document_ids;
+  size_t runs = 0;
+
+  // The run being buffered; terms are interned per run.
+  std::deque<std::string> run_terms;
+  std::unordered_map<std::string_view, std::uint32_t> run_term_ids;
+  std::vector<RunOccurrence> run_occurrences;
+  std::vector<std::pair<size_t, std::string>> run_documents;
+  size_t run_bytes = 0;
+
+  void addOccurrence(std::string_view term, size_t document_id,
+                     size_t position);
+  void spill();
+
+public:
+  explicit StreamingIndexBuilder(
+      const std::filesystem::path &index_path, size_t memory_budget_bytes,
+      EntriesVersion entries_v = EntriesVersion::BlockMax);
+  ~StreamingIndexBuilder();
+  StreamingIndexBuilder(const StreamingIndexBuilder &) = delete;
+  StreamingIndexBuilder &operator=(const StreamingIndexBuilder &) = delete;
+
+  // Later documents with an id already added are ignored, as by
+  // IndexBuilder.
+  void addDocument(size_t document_id, const std::string &name_of_doc,
+                   const Config &config, std::string_view authors = {});
+  // Reads batches from `source` on the calling thread while a worker
+  // indexes the batches read before, at most queued_batches ahead.
+  void addDocuments(const DocumentSource &source, const Config &config,
+                    size_t queued_batches = 4);
+  void finish();
+};
+
+// Name of the file of a shard inside the binary directory.
+std::string shardFileName(size_t shard);
+
 struct TrieNode {
-  std::map<char, std::unique_ptr<TrieNode>> children_node;
+  std::pmr::map<char, TrieNode *> children_node;
   std::uint32_t entry_offset = 0;
   std::uint8_t is_leaf = 0;
+
+  explicit TrieNode(std::pmr::memory_resource *arena)
+      : children_node(arena) {}
 };
 
+// Nodes and their child maps live in the trie's arena and are released
+// together with it.
 class Trie {
 private:
-  std::unique_ptr<TrieNode> root;
+  std::pmr::monotonic_buffer_resource arena;
+  TrieNode *root;
 
-  std::uint32_t serialize_(
-      const TrieNode *next_p, BinaryBuffer &bin_buf,
-      const std::unordered_map<std::string, std::uint32_t> &entry_offset,
-      std::string &term) const;
+  TrieNode *newNode();
+  std::uint32_t serialize_(const TrieNode *next_p,
+                           BinaryBuffer &bin_buf) const;
 
 public:
-  explicit Trie() : root(std::make_unique<TrieNode>()){};
-  void add(const std::string &word, std::uint32_t entry_offset);
-  void serialize(BinaryBuffer &bin_buf,
-                 const std::unordered_map<std::string, std::uint32_t>
-                     &entry_offset) const;
+  explicit Trie() : root(newNode()){};
+  Trie(const Trie &) = delete;
+  Trie &operator=(const Trie &) = delete;
+  void add(std::string_view word, std::uint32_t entry_offset);
+  void serialize(BinaryBuffer &bin_buf) const;
 };
 
 } // namespace fts
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <fstream>
@@ -23,60 +24,116 @@ Config::Config(const std::filesystem::path &pathJsonFile) {
         "Incorrect ngram size. Max length can`t be less than min length");
   }
 
+  proximity_weight = json_.value("proximity_weight", 0.0);
+  if (proximity_weight < 0.0) {
+    throw ConfigurationException("Proximity weight can`t be negative");
+  }
+
+  ranking = parseRanking(json_.value("ranking", std::string("tfidf")));
+  bm25_k1 = json_.value("bm25_k1", 1.2);
+  bm25_b = json_.value("bm25_b", 0.75);
+  if (bm25_k1 < 0.0 || bm25_b < 0.0 || bm25_b > 1.0) {
+    throw ConfigurationException(
+        "Incorrect BM25 parameters. Need k1 >= 0 and b in [0, 1]");
+  }
+  field_weights[static_cast<size_t>(Field::Title)] =
+      json_.value("title_weight", 1.0);
+  field_weights[static_cast<size_t>(Field::Authors)] =
+      json_.value("author_weight", 0.5);
+  if (field_weights[0] < 0.0 || field_weights[1] < 0.0) {
+    throw ConfigurationException("Field weights can`t be negative");
+  }
+
   stop_words = json_["stop_words"].get<std::vector<std::string>>();
+  stop_word_filter = StopWords(stop_words);
 }
 
-static void split_string(std::string const &str, const char delim,
-                         std::vector<std::string> &out) {
-  size_t start = 0;
-  size_t end = 0;
-
-  while ((start = str.find_first_not_of(delim, end)) != std::string::npos) {
-    end = str.find(delim, start);
-    out.push_back(str.substr(start, end - start));
+Ranking parseRanking(const std::string &name) {
+  if (name == "tfidf") {
+    return Ranking::TfIdf;
   }
+  if (name == "bm25") {
+    return Ranking::Bm25;
+  }
+  if (name == "bm25f") {
+    return Ranking::Bm25F;
+  }
+  throw ConfigurationException("Unknown ranking " + name +
+                               ". Use tfidf, bm25 or bm25f");
 }
 
-std::vector<ParsedString> parse(std::string text, const Config &config) {
-  std::vector<ParsedString> parsed_ngrams;
-
-  //удаление пунктуации
-  auto it = std::remove_if(text.begin(), text.end(), ::ispunct);
-  text.erase(it, text.end());
+// StopWords
 
-  //приведение к нижнему регистру
-  std::transform(text.begin(), text.end(), text.begin(), tolower);
+// Slot value of an empty slot; filled slots store the word index + 1.
+constexpr std::uint32_t empty_slot = 0;
 
-  //разбиение строки на слова
-  std::vector<std::string> splited_string;
-  split_string(text, ' ', splited_string);
-
-  //удаление стоп-слов
-  long i = 0;
-  for (const auto &word : splited_string) {
-    for (const auto &stop_word : config.getStopWords()) {
-      if (word == stop_word) {
-        splited_string.erase(splited_string.begin() + i);
-      }
+StopWords::StopWords(std::vector<std::string> stop_words)
+    : words(std::move(stop_words)) {
+  size_t capacity = 1;
+  while (capacity < 2 * words.size()) {
+    capacity *= 2;
+  }
+  slots.assign(capacity, empty_slot);
+  for (std::uint32_t i = 0; i < words.size(); ++i) {
+    if (contains(words[i])) {
+      continue;
+    }
+    max_length = std::max(max_length, words[i].size());
+    size_t slot = hash(words[i]) & (slots.size() - 1);
+    while (slots[slot] != empty_slot) {
+      slot = (slot + 1) & (slots.size() - 1);
     }
-    i++;
+    slots[slot] = i + 1;
   }
+}
 
-  //деление на термы
-  for (size_t i = 0; i < splited_string.size(); ++i) {
-    ParsedString current_word;
-    for (size_t j = config.getNgramMinLength(); j <= config.getNgramMaxLength();
-         ++j) {
-      if (splited_string[i].length() < j) {
-        break;
-      }
-      current_word.word_ngrams.push_back(splited_string[i].substr(0, j));
+bool StopWords::contains(std::string_view word) const {
+  if (word.size() > max_length) {
+    return false;
+  }
+  size_t slot = hash(word) & (slots.size() - 1);
+  while (slots[slot] != empty_slot) {
+    if (words[slots[slot] - 1] == word) {
+      return true;
     }
-    if (!current_word.word_ngrams.empty()) {
-      current_word.word_position = i;
-      parsed_ngrams.push_back(current_word);
+    slot = (slot + 1) & (slots.size() - 1);
+  }
+  return false;
+}
+
+// FNV-1a
+std::uint32_t StopWords::hash(std::string_view word) {
+  std::uint32_t result = 2166136261U;
+  for (const char symbol : word) {
+    result ^= static_cast<unsigned char>(symbol);
+    result *= 16777619U;
+  }
+  return result;
+}
+
+// TokenizerContext
+
+std::string_view TokenizerContext::normalize(std::string_view text) {
+  normalized.clear();
+  for (const char symbol : text) {
+    const auto byte = static_cast<unsigned char>(symbol);
+    if (std::ispunct(byte) == 0) {
+      normalized.push_back(static_cast<char>(std::tolower(byte)));
     }
   }
+  return normalized;
+}
+
+std::vector<ParsedString> parse(std::string_view text, const Config &config) {
+  std::vector<ParsedString> parsed_ngrams;
+  TokenizerContext context;
+  tokenize(text, config, context, [&](std::string_view term, size_t position) {
+    if (parsed_ngrams.empty() ||
+        parsed_ngrams.back().word_position != position) {
+      parsed_ngrams.push_back({{}, position});
+    }
+    parsed_ngrams.back().word_ngrams.emplace_back(term);
+  });
   return parsed_ngrams;
 }
 
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <filesystem>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace fts {
@@ -10,17 +15,79 @@ struct ParsedString {
   size_t word_position;
 };
 
+// Open-addressing hash set of stop words, built once. Slots hold indexes
+// into `words`, so copies stay valid; longer words than any stop word are
+// rejected before hashing.
+class StopWords {
+public:
+  explicit StopWords(std::vector<std::string> stop_words = {});
+  bool contains(std::string_view word) const;
+
+private:
+  std::vector<std::string> words;
+  std::vector<std::uint32_t> slots;
+  size_t max_length = 0;
+
+  static std::uint32_t hash(std::string_view word);
+};
+
+enum class Ranking { TfIdf, Bm25, Bm25F };
+
+// Parses "tfidf", "bm25" or "bm25f"; throws ConfigurationException
+// otherwise.
+Ranking parseRanking(const std::string &name);
+
+// Fields of a document. Title terms are indexed as they are and author
+// terms behind author_prefix, which tokenized text never contains since
+// punctuation is removed from it.
+enum class Field : std::uint8_t { Title = 0, Authors = 1 };
+constexpr size_t field_count = 2;
+constexpr std::string_view author_prefix = "author:";
+
+inline Field termField(std::string_view term) {
+  return term.substr(0, author_prefix.size()) == author_prefix ? Field::Authors
+                                                               : Field::Title;
+}
+
+inline std::string fieldTerm(Field field, std::string_view term) {
+  std::string result(field == Field::Authors ? author_prefix : "");
+  result += term;
+  return result;
+}
+
 class Config {
 public:
   explicit Config(const std::filesystem::path &pathJsonFile);
   const std::vector<std::string> &getStopWords() const { return stop_words; }
+  bool isStopWord(std::string_view word) const {
+    return stop_word_filter.contains(word);
+  }
   size_t getNgramMinLength() const { return ngram_min_length; }
   size_t getNgramMaxLength() const { return ngram_max_length; }
+  // Weight of the proximity boost; 0 ranks by tf-idf alone.
+  double getProximityWeight() const { return proximity_weight; }
+  // Function scoring a term in a document: tf * idf by default, BM25 with
+  // saturation k1 and length normalization b, or BM25F, which also
+  // searches the authors and weighs each field's frequencies before the
+  // saturation.
+  Ranking getRanking() const { return ranking; }
+  void setRanking(Ranking r) { ranking = r; }
+  double getBm25K1() const { return bm25_k1; }
+  double getBm25B() const { return bm25_b; }
+  double getFieldWeight(Field field) const {
+    return field_weights[static_cast<size_t>(field)];
+  }
 
 private:
   std::vector<std::string> stop_words;
+  StopWords stop_word_filter;
   size_t ngram_min_length;
   size_t ngram_max_length;
+  double proximity_weight;
+  Ranking ranking;
+  double bm25_k1;
+  double bm25_b;
+  std::array<double, field_count> field_weights;
 };
 
 class ConfigurationException : public std::runtime_error {
@@ -29,6 +96,46 @@ public:
       : std::runtime_error(what_arg) {}
 };
 
-std::vector<ParsedString> parse(std::string text, const Config &config);
+// Scratch space of tokenize(). It keeps its capacity between calls, so a
+// context reused for many texts stops allocating once it has seen the
+// longest one.
+class TokenizerContext {
+public:
+  // Copies `text` without punctuation and in lower case into the buffer.
+  std::string_view normalize(std::string_view text);
+
+private:
+  std::string normalized;
+};
+
+// Calls on_term(term, word_position) for every ngram prefix of every word
+// that is not a stop word. Words are separated by spaces once punctuation is
+// removed and the text is lower-cased; positions count the kept words. The
+// terms point into `context` and are valid until it is used again.
+template <class OnTerm>
+void tokenize(std::string_view text, const Config &config,
+              TokenizerContext &context, OnTerm &&on_term) {
+  const std::string_view normalized = context.normalize(text);
+  size_t word_position = 0;
+  size_t start = 0;
+  size_t end = 0;
+  while ((start = normalized.find_first_not_of(' ', end)) !=
+         std::string_view::npos) {
+    end = std::min(normalized.find(' ', start), normalized.size());
+    const auto word = normalized.substr(start, end - start);
+    if (config.isStopWord(word)) {
+      continue;
+    }
+    const size_t max_length = std::min(config.getNgramMaxLength(), word.size());
+    for (size_t length = config.getNgramMinLength(); length <= max_length;
+         ++length) {
+      on_term(word.substr(0, length), word_position);
+    }
+    ++word_position;
+  }
+}
+
+// Collects the terms of tokenize() grouped by word.
+std::vector<ParsedString> parse(std::string_view text, const Config &config);
 
 } // namespace fts
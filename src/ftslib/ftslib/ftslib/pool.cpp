@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <ftslib/pool.hpp>
+#include <limits>
+
+namespace fts {
+
+// ThreadPool
+
+namespace {
+// The pool and index of the worker running on this thread, if any.
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_worker = std::numeric_limits<size_t>::max();
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  threads = std::max<size_t>(1, threads);
+  for (size_t i = 0; i < threads; ++i) {
+    queues.push_back(std::make_unique<TaskQueue>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this, i]() { run(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+  const size_t queue = current_pool == this
+                           ? current_worker
+                           : next_queue.fetch_add(1) % queues.size();
+  {
+    const std::lock_guard<std::mutex> lock(sleep_mutex);
+    pending.fetch_add(1);
+  }
+  {
+    const std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+    queues[queue]->tasks.push_back(std::move(task));
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::take(size_t worker, std::function<void()> &task) {
+  {
+    auto &own = *queues[worker];
+    const std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      pending.fetch_sub(1);
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    auto &victim = *queues[(worker + i) % queues.size()];
+    const std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      pending.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t worker) {
+  current_pool = this;
+  current_worker = worker;
+  std::function<void()> task;
+  while (true) {
+    if (take(worker, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    // A task counted in pending but not queued yet is picked up on the
+    // next pass.
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [this]() { return stopping || pending.load() != 0; });
+    if (stopping && pending.load() == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace fts
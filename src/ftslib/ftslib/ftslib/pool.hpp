@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace fts {
+
+// Fixed set of workers, each with its own task deque. A worker runs the
+// newest task of its own deque first and, when that is empty, steals the
+// oldest task of another one, so short tasks queued behind a long one are
+// picked up by idle workers. Tasks submitted from a worker go to its own
+// deque; others are spread round-robin. The destructor runs every queued
+// task before joining the workers.
+class ThreadPool {
+private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<TaskQueue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  // Tasks queued and not yet taken; raised before a task is queued, so it
+  // never drops below the number of tasks in the deques.
+  std::atomic<size_t> pending{0};
+  std::atomic<size_t> next_queue{0};
+  bool stopping = false;
+
+  void push(std::function<void()> task);
+  bool take(size_t worker, std::function<void()> &task);
+  void run(size_t worker);
+
+public:
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  template <class Function>
+  std::future<std::invoke_result_t<Function>> submit(Function function) {
+    using Value = std::invoke_result_t<Function>;
+    auto task =
+        std::make_shared<std::packaged_task<Value()>>(std::move(function));
+    auto result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+};
+
+// FIFO queue of at most `capacity` items between producer and consumer
+// threads: push() waits while it is full and pop() while it is empty.
+// After close(), push() drops its item and pop() drains what is left.
+template <class Item> class BoundedQueue {
+private:
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+  std::deque<Item> items;
+  size_t capacity;
+  bool closed = false;
+
+public:
+  explicit BoundedQueue(size_t max_items)
+      : capacity(std::max<size_t>(1, max_items)) {}
+
+  // Returns false if the queue is closed.
+  bool push(Item item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock,
+                  [this]() { return closed || items.size() < capacity; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    lock.unlock();
+    not_empty.notify_one();
+    return true;
+  }
+  // Returns nothing once the queue is closed and empty.
+  std::optional<Item> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+    if (items.empty()) {
+      return std::nullopt;
+    }
+    Item item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return item;
+  }
+  void close() {
+    {
+      const std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+};
+
+} // namespace fts
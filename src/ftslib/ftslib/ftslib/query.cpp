@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cctype>
+#include <ftslib/query.hpp>
+
+namespace fts {
+
+struct QueryToken {
+  enum class Kind { Word, Phrase, Near, And, Or, Not, Open, Close };
+  Kind kind;
+  std::string_view text;
+  size_t distance = 0;
+};
+
+// Parses "NEAR/k"; anything else is not an operator.
+static std::optional<size_t> nearDistance(std::string_view token) {
+  constexpr std::string_view near_prefix = "NEAR/";
+  if (token.size() <= near_prefix.size() ||
+      token.substr(0, near_prefix.size()) != near_prefix) {
+    return std::nullopt;
+  }
+  size_t distance = 0;
+  for (const char symbol : token.substr(near_prefix.size())) {
+    if (std::isdigit(static_cast<unsigned char>(symbol)) == 0) {
+      return std::nullopt;
+    }
+    distance = distance * 10 + static_cast<size_t>(symbol - '0');
+  }
+  return distance;
+}
+
+static QueryToken wordToken(std::string_view token) {
+  using Kind = QueryToken::Kind;
+  if (token == "AND") {
+    return {Kind::And, token};
+  }
+  if (token == "OR") {
+    return {Kind::Or, token};
+  }
+  if (token == "NOT") {
+    return {Kind::Not, token};
+  }
+  const auto distance = nearDistance(token);
+  if (distance) {
+    return {Kind::Near, token, *distance};
+  }
+  return {Kind::Word, token};
+}
+
+static std::vector<QueryToken> splitQuery(std::string_view text) {
+  using Kind = QueryToken::Kind;
+  std::vector<QueryToken> tokens;
+  size_t i = 0;
+  while (i < text.size()) {
+    if (text[i] == ' ') {
+      ++i;
+    } else if (text[i] == '(' || text[i] == ')') {
+      tokens.push_back(
+          {text[i] == '(' ? Kind::Open : Kind::Close, text.substr(i, 1)});
+      ++i;
+    } else if (text[i] == '"') {
+      const size_t end = std::min(text.find('"', i + 1), text.size());
+      tokens.push_back({Kind::Phrase, text.substr(i + 1, end - i - 1)});
+      i = end + 1;
+    } else {
+      const size_t end = std::min(text.find_first_of(" \"()", i), text.size());
+      tokens.push_back(wordToken(text.substr(i, end - i)));
+      i = end;
+    }
+  }
+  return tokens;
+}
+
+// Recursive descent over the tokens. Words without terms, such as stop
+// words, drop out of the tree, and so do operators left without operands.
+class QueryParser {
+private:
+  using Kind = QueryToken::Kind;
+
+  const std::vector<QueryToken> &tokens;
+  const Config &config;
+  Query &query;
+  TokenizerContext context;
+  size_t pos = 0;
+  // Odd while parsing inside an odd number of NOTs.
+  size_t negations = 0;
+
+  bool at(Kind kind) const {
+    return pos < tokens.size() && tokens[pos].kind == kind;
+  }
+  bool atOperand() const {
+    return at(Kind::Word) || at(Kind::Phrase) || at(Kind::Not) ||
+           at(Kind::Open);
+  }
+
+  // Tokenizes a word or phrase; the longest ngram of each word, reported
+  // last, is the one positions are matched on.
+  PhraseQuery operand(std::string_view text, std::vector<std::string> *terms) {
+    PhraseQuery phrase;
+    auto &words = phrase.words;
+    tokenize(text, config, context,
+             [&](std::string_view term, size_t word_position) {
+               if (negations % 2 == 0) {
+                 query.terms.emplace_back(term);
+               }
+               if (terms != nullptr) {
+                 terms->emplace_back(term);
+               }
+               if (words.empty() || words.back().offset != word_position) {
+                 words.push_back({std::string(term), word_position});
+               } else {
+                 words.back().term = term;
+               }
+             });
+    if (negations % 2 == 0) {
+      for (const auto &word : words) {
+        query.words.push_back(word.term);
+      }
+    }
+    return phrase;
+  }
+
+  static std::optional<QueryNode>
+  join(QueryNode::Kind kind, std::vector<QueryNode> children) {
+    if (children.empty()) {
+      return std::nullopt;
+    }
+    if (children.size() == 1) {
+      return std::move(children.front());
+    }
+    return QueryNode{kind, {}, {}, 0, std::move(children)};
+  }
+
+  std::optional<QueryNode> parsePrimary() {
+    if (at(Kind::Open)) {
+      ++pos;
+      auto node = parseOr();
+      if (at(Kind::Close)) {
+        ++pos;
+      }
+      if (node) {
+        node->grouped = true;
+      }
+      return node;
+    }
+    if (!at(Kind::Word) && !at(Kind::Phrase)) {
+      ++pos;
+      return std::nullopt;
+    }
+
+    // An operand followed by NEAR/k chains: a NEAR/1 b NEAR/2 c requires
+    // both pairs.
+    std::vector<QueryNode> nears;
+    std::optional<QueryNode> first;
+    PhraseQuery left = primaryOperand(first);
+    while (at(Kind::Near) && pos + 1 < tokens.size() &&
+           (tokens[pos + 1].kind == Kind::Word ||
+            tokens[pos + 1].kind == Kind::Phrase)) {
+      const size_t distance = tokens[pos].distance;
+      ++pos;
+      std::optional<QueryNode> ignored;
+      PhraseQuery right = primaryOperand(ignored);
+      if (!left.words.empty() && !right.words.empty()) {
+        nears.push_back(
+            QueryNode{QueryNode::Kind::Near, {}, {left, right}, distance, {}});
+      }
+      left = std::move(right);
+    }
+    if (!nears.empty()) {
+      return join(QueryNode::Kind::And, std::move(nears));
+    }
+    return first;
+  }
+
+  // Parses the word or phrase at `pos` into `node`, unless it has no terms.
+  PhraseQuery primaryOperand(std::optional<QueryNode> &node) {
+    const auto &token = tokens[pos++];
+    if (token.kind == Kind::Word) {
+      std::vector<std::string> terms;
+      auto phrase = operand(token.text, &terms);
+      if (!terms.empty()) {
+        node = QueryNode{QueryNode::Kind::Word, std::move(terms), {}, 0, {}};
+      }
+      return phrase;
+    }
+    auto phrase = operand(token.text, nullptr);
+    if (!phrase.words.empty()) {
+      node = QueryNode{QueryNode::Kind::Phrase, {}, {phrase}, 0, {}};
+    }
+    return phrase;
+  }
+
+  std::optional<QueryNode> parseUnary() {
+    if (!at(Kind::Not)) {
+      return parsePrimary();
+    }
+    ++pos;
+    ++negations;
+    auto child = parseUnary();
+    --negations;
+    if (!child) {
+      return std::nullopt;
+    }
+    return QueryNode{QueryNode::Kind::Not, {}, {}, 0, {std::move(*child)}};
+  }
+
+  std::optional<QueryNode> parseAnd() {
+    std::vector<QueryNode> children;
+    auto node = parseUnary();
+    if (node) {
+      children.push_back(std::move(*node));
+    }
+    while (at(Kind::And)) {
+      ++pos;
+      if (!atOperand()) {
+        continue;
+      }
+      node = parseUnary();
+      if (node) {
+        children.push_back(std::move(*node));
+      }
+    }
+    return join(QueryNode::Kind::And, std::move(children));
+  }
+
+  // Operands written next to each other. Phrases, NEAR, groups and the
+  // operands of AND and NOT are required; of the bare words, as in plain
+  // queries, a document needs any one, and each adds to the score.
+  std::optional<QueryNode> parseSequence() {
+    std::vector<QueryNode> required;
+    std::vector<QueryNode> optional;
+    while (pos < tokens.size() && !at(Kind::Or) && !at(Kind::Close)) {
+      if (!atOperand()) {
+        ++pos;
+        continue;
+      }
+      auto node = parseAnd();
+      if (!node) {
+        continue;
+      }
+      if (node->kind == QueryNode::Kind::Word && !node->grouped) {
+        optional.push_back(std::move(*node));
+      } else {
+        required.push_back(std::move(*node));
+      }
+    }
+    auto words = join(QueryNode::Kind::Or, std::move(optional));
+    if (words) {
+      required.insert(required.begin(), std::move(*words));
+    }
+    return join(QueryNode::Kind::And, std::move(required));
+  }
+
+public:
+  QueryParser(const std::vector<QueryToken> &t, const Config &c, Query &q)
+      : tokens(t), config(c), query(q) {}
+
+  std::optional<QueryNode> parseOr() {
+    std::vector<QueryNode> children;
+    while (pos < tokens.size() && !at(Kind::Close)) {
+      if (at(Kind::Or)) {
+        ++pos;
+        continue;
+      }
+      auto node = parseSequence();
+      if (node) {
+        children.push_back(std::move(*node));
+      }
+    }
+    return join(QueryNode::Kind::Or, std::move(children));
+  }
+
+  // Parses everything, skipping unmatched closing parentheses.
+  std::optional<QueryNode> parse() {
+    std::vector<QueryNode> children;
+    while (pos < tokens.size()) {
+      auto node = parseOr();
+      if (node) {
+        children.push_back(std::move(*node));
+      }
+      if (at(Kind::Close)) {
+        ++pos;
+      }
+    }
+    return join(QueryNode::Kind::Or, std::move(children));
+  }
+};
+
+// A group is one too when it only joins words: required or not, it matches
+// the documents holding one of them.
+static bool isDisjunction(const QueryNode &node) {
+  if (node.kind == QueryNode::Kind::Word) {
+    return true;
+  }
+  return node.kind == QueryNode::Kind::Or &&
+         std::all_of(node.children.begin(), node.children.end(),
+                     [](const QueryNode &child) {
+                       return isDisjunction(child);
+                     });
+}
+
+bool Query::isDisjunction() const {
+  return !root || fts::isDisjunction(*root);
+}
+
+// Strings are written with their length in front and lists with their size,
+// so different queries never run together into the same key.
+static void appendKey(std::string &key, std::string_view text) {
+  key += std::to_string(text.size());
+  key += ':';
+  key += text;
+}
+
+static void appendKey(std::string &key, const std::vector<std::string> &terms) {
+  key += std::to_string(terms.size());
+  key += '[';
+  for (const auto &term : terms) {
+    appendKey(key, term);
+  }
+}
+
+static void appendKey(std::string &key, const QueryNode &node) {
+  key += std::to_string(static_cast<int>(node.kind));
+  appendKey(key, node.terms);
+  key += std::to_string(node.phrases.size());
+  key += '[';
+  for (const auto &phrase : node.phrases) {
+    key += std::to_string(phrase.words.size());
+    key += '[';
+    for (const auto &word : phrase.words) {
+      appendKey(key, word.term);
+      key += std::to_string(word.offset);
+      key += ',';
+    }
+  }
+  key += std::to_string(node.distance);
+  key += ',';
+  key += std::to_string(node.children.size());
+  key += '[';
+  for (const auto &child : node.children) {
+    appendKey(key, child);
+  }
+}
+
+std::string queryKey(const Query &query) {
+  std::string key;
+  appendKey(key, query.terms);
+  appendKey(key, query.words);
+  if (query.root) {
+    appendKey(key, *query.root);
+  } else {
+    key += '-';
+  }
+  return key;
+}
+
+Query parseQuery(std::string_view text, const Config &config) {
+  Query query;
+  const auto tokens = splitQuery(text);
+  QueryParser parser(tokens, config, query);
+  query.root = parser.parse();
+  return query;
+}
+
+} // namespace fts
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <ftslib/parser.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fts {
+
+// Query words that must occur at fixed distances from each other: a quoted
+// phrase, or a single word. A word is matched by its longest ngram.
+struct PhraseQuery {
+  struct Word {
+    std::string term;
+    // Position relative to the first word of the phrase.
+    size_t offset;
+  };
+  std::vector<Word> words;
+
+  // Number of word positions the phrase spans.
+  size_t length() const { return words.empty() ? 0 : words.back().offset + 1; }
+};
+
+// A node of the boolean query tree.
+struct QueryNode {
+  enum class Kind { Word, Phrase, Near, And, Or, Not };
+  Kind kind;
+  // Word: every ngram of the word; a document matches any of them.
+  std::vector<std::string> terms;
+  // Phrase: the phrase; Near: both operands.
+  std::vector<PhraseQuery> phrases;
+  // Near: at most `distance` words from one operand to the other, 1 for
+  // neighbours.
+  size_t distance = 0;
+  // And, Or: the operands; Not: the negated node.
+  std::vector<QueryNode> children;
+  // Written in parentheses, so required next to other operands even if it
+  // is a single word or only joins words.
+  bool grouped = false;
+};
+
+struct Query {
+  // Every ngram of every query word outside NOT, in query order; each adds
+  // tf * idf.
+  std::vector<std::string> terms;
+  // Longest ngram of every query word outside NOT, in query order.
+  std::vector<std::string> words;
+  // Nothing if no query word has terms.
+  std::optional<QueryNode> root;
+
+  // True if the tree only joins words with OR, so every document holding
+  // one of `terms` matches.
+  bool isDisjunction() const;
+};
+
+// Operands written next to each other must all match, except bare words:
+// a document needs only one of those, and each adds to the score. OR
+// joins such sequences, AND binds tighter than juxtaposition, NOT tighter
+// than AND, and parentheses group. "quoted text" is a phrase, and
+// `a NEAR/k b` requires a and b, each a word or a phrase, to be at most k
+// words apart. Operators are upper case; misplaced ones are ignored.
+Query parseQuery(std::string_view text, const Config &config);
+
+// Encodes everything a parsed query is searched by, so query texts that
+// differ only in case, spacing or ignored operators get the same key.
+std::string queryKey(const Query &query);
+
+} // namespace fts
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ftslib/parser.hpp>
+#include <ftslib/searcher.hpp>
+
+namespace fts {
+
+// Frequencies of one query term in a document, and its statistics, by
+// field. Policies that read only the title leave the other fields alone.
+using FieldFrequencies = std::array<size_t, field_count>;
+using FieldStats = std::array<TermStats, field_count>;
+
+// Ranking policies. The scoring loops of the searcher are instantiated once
+// per policy, so scoring a posting costs no virtual call or branch on the
+// configured ranking. A policy has:
+//   fields                   - how many fields it reads, the title first;
+//   weight(stats, N)         - the factor of a term, taken once per query;
+//   score(tf, weight, doc)   - the score of the term in a document;
+//   bound(max_tf, weight)    - the largest score of any document whose
+//                              frequencies are at most max_tf, for pruning.
+// The scores of the query terms are summed.
+
+class TfIdfRanking {
+public:
+  static constexpr size_t fields = 1;
+
+  explicit TfIdfRanking(const Config &, const IndexAccessor &) {}
+  double weight(const FieldStats &stats, double) const {
+    return stats[0].idf;
+  }
+  double score(const FieldFrequencies &tf, double weight, size_t) const {
+    return static_cast<double>(tf[0]) * weight;
+  }
+  double bound(const FieldFrequencies &max_tf, double weight) const {
+    return static_cast<double>(max_tf[0]) * weight;
+  }
+};
+
+// BM25 idf, which unlike log(N / df) stays positive for common terms.
+inline double bm25_idf(size_t df, double N) {
+  const auto frequency = static_cast<double>(df);
+  return std::log(1.0 + (N - frequency + 0.5) / (frequency + 0.5));
+}
+
+class Bm25Ranking {
+private:
+  DocumentLengths lengths;
+  double k1;
+  double b;
+
+public:
+  static constexpr size_t fields = 1;
+
+  explicit Bm25Ranking(const Config &config, const IndexAccessor &index)
+      : lengths(index.documentLengths(Field::Title)), k1(config.getBm25K1()),
+        b(config.getBm25B()) {}
+  double weight(const FieldStats &stats, double N) const {
+    return bm25_idf(stats[0].df, N);
+  }
+  double score(const FieldFrequencies &tf, double weight,
+               size_t document) const {
+    const auto frequency = static_cast<double>(tf[0]);
+    const double norm =
+        1.0 - b + b * lengths.length(document) / lengths.average();
+    return weight * frequency * (k1 + 1.0) / (frequency + k1 * norm);
+  }
+  // BM25 grows with tf and shrinks with the length, which is at least 0.
+  double bound(const FieldFrequencies &max_tf, double weight) const {
+    const auto frequency = static_cast<double>(max_tf[0]);
+    if (frequency == 0.0) {
+      return 0.0;
+    }
+    return weight * frequency * (k1 + 1.0) / (frequency + k1 * (1.0 - b));
+  }
+};
+
+// BM25F over the title and the authors: the frequency of every field is
+// normalized by the field length and weighted, and the sum saturates once,
+// so a word found in both fields does not count as two unrelated terms.
+// The idf is taken from the larger document frequency of the two fields.
+class Bm25FRanking {
+private:
+  std::array<DocumentLengths, field_count> lengths;
+  std::array<double, field_count> field_weights;
+  double k1;
+  double b;
+
+  double saturate(double frequency, double weight) const {
+    return frequency == 0.0 ? 0.0
+                            : weight * frequency * (k1 + 1.0) /
+                                  (frequency + k1);
+  }
+
+public:
+  static constexpr size_t fields = 2;
+
+  explicit Bm25FRanking(const Config &config, const IndexAccessor &index)
+      : k1(config.getBm25K1()), b(config.getBm25B()) {
+    for (size_t f = 0; f < field_count; ++f) {
+      lengths[f] = index.documentLengths(static_cast<Field>(f));
+      field_weights[f] = config.getFieldWeight(static_cast<Field>(f));
+    }
+  }
+  double weight(const FieldStats &stats, double N) const {
+    return bm25_idf(std::max(stats[0].df, stats[1].df), N);
+  }
+  double score(const FieldFrequencies &tf, double weight,
+               size_t document) const {
+    double frequency = 0.0;
+    for (size_t f = 0; f < field_count; ++f) {
+      if (tf[f] != 0) {
+        const double norm = 1.0 - b + b * lengths[f].length(document) /
+                                          lengths[f].average();
+        frequency += field_weights[f] * static_cast<double>(tf[f]) / norm;
+      }
+    }
+    return saturate(frequency, weight);
+  }
+  // With b = 1 a field of length 0 has no upper bound on its normalized
+  // frequency, but the saturated score stays below weight * (k1 + 1).
+  double bound(const FieldFrequencies &max_tf, double weight) const {
+    if (b >= 1.0) {
+      return max_tf[0] + max_tf[1] == 0 ? 0.0 : weight * (k1 + 1.0);
+    }
+    double frequency = 0.0;
+    for (size_t f = 0; f < field_count; ++f) {
+      frequency +=
+          field_weights[f] * static_cast<double>(max_tf[f]) / (1.0 - b);
+    }
+    return saturate(frequency, weight);
+  }
+};
+
+} // namespace fts
@@ -2,56 +2,852 @@
 #include <cmath>
 #include <cstring>
 #include <dirent.h>
-#include <fcntl.h>
+#include <ftslib/cache.hpp>
+#include <ftslib/codec.hpp>
+#include <ftslib/handle.hpp>
 #include <ftslib/indexer.hpp>
+#include <ftslib/query.hpp>
+#include <ftslib/ranking.hpp>
 #include <ftslib/searcher.hpp>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <picosha2.h>
-#include <sys/mman.h>
+#include <tuple>
 
 namespace fts {
 
 // Searcher
 
-static void sort_by_score(std::vector<Result> &search_result) {
+static bool better_result(size_t lhs_id, double lhs_score, size_t rhs_id,
+                          double rhs_score) {
+  return lhs_score != rhs_score ? lhs_score > rhs_score : lhs_id < rhs_id;
+}
+
+void sortResults(std::vector<Result> &search_result) {
   std::sort(search_result.begin(), search_result.end(),
             [](const auto &lhs, const auto &rhs) {
-              return lhs.score != rhs.score ? lhs.score > rhs.score
-                                            : lhs.document_id < rhs.document_id;
+              return better_result(lhs.document_id, lhs.score,
+                                   rhs.document_id, rhs.score);
             });
 }
 
-std::vector<Result> search(const Config &config,
-                           const fts::IndexAccessor &index,
-                           const std::string &query) {
-  const auto parsed_query = parse(query, config);
-  std::map<size_t, double> result;
+// The table only grows, so threads that score shards of different sizes
+// keep reusing it.
+void ScoreAccumulator::reset(size_t doc_count) {
+  if (scores.size() < doc_count) {
+    scores.assign(doc_count, 0.0);
+    is_touched.assign(doc_count, false);
+    touched.clear();
+    return;
+  }
+  for (const auto identifier : touched) {
+    scores[identifier] = 0.0;
+    is_touched[identifier] = false;
+  }
+  touched.clear();
+}
+
+// Query evaluation
+
+// Index of the first element at or after `from` whose key is not below
+// `target`. The step doubles until it passes the target, then a binary
+// search finishes inside the last step, so skipping far ahead is cheap.
+template <class T, class Key>
+static size_t gallop(const std::vector<T> &items, size_t from, size_t target,
+                     Key key) {
+  size_t low = from;
+  size_t high = from;
+  for (size_t step = 1; high < items.size() && key(items[high]) < target;
+       step *= 2) {
+    low = high + 1;
+    high += step;
+  }
+  high = std::min(high, items.size());
+  return std::partition_point(
+             items.begin() + static_cast<std::ptrdiff_t>(low),
+             items.begin() + static_cast<std::ptrdiff_t>(high),
+             [&](const T &item) { return key(item) < target; }) -
+         items.begin();
+}
+
+static size_t posting_document(const Posting &posting) {
+  return posting.document_id;
+}
+
+// Smallest number of words from a span of `lhs_length` words starting at a
+// position of `lhs` to a span of `rhs_length` words starting at one of
+// `rhs`: 1 for neighbours, 0 for overlapping spans. Both are sorted, and
+// only the nearest start of `rhs` on either side of each start of `lhs` can
+// be the closest.
+static size_t span_distance(const std::vector<size_t> &lhs, size_t lhs_length,
+                            const std::vector<size_t> &rhs,
+                            size_t rhs_length) {
+  const auto gap = [](size_t distance, size_t length) {
+    return distance > length - 1 ? distance - (length - 1) : 0;
+  };
+  size_t distance = std::numeric_limits<size_t>::max();
+  size_t j = 0;
+  for (const auto start : lhs) {
+    while (j < rhs.size() && rhs[j] < start) {
+      ++j;
+    }
+    if (j < rhs.size()) {
+      distance = std::min(distance, gap(rhs[j] - start, lhs_length));
+    }
+    if (j > 0) {
+      distance = std::min(distance, gap(start - rhs[j - 1], rhs_length));
+    }
+  }
+  return distance;
+}
+
+// Documents matching a query node, in increasing order. An iterator starts
+// before its first document; advance() moves it to the first document not
+// below the target and never moves it back.
+class DocIterator {
+private:
+  size_t current = 0;
+  bool started = false;
+  bool exhausted = false;
+
+protected:
+  // Returns the first document not below `target`, which is past the
+  // current one, or nothing at the end.
+  virtual std::optional<size_t> seek(size_t target) = 0;
+
+public:
+  virtual ~DocIterator() = default;
+  // Upper bound of the number of documents, so intersections can be led by
+  // their rarest operand.
+  virtual size_t cost() const = 0;
+  size_t document() const { return current; }
+  bool advance(size_t target) {
+    if (exhausted) {
+      return false;
+    }
+    if (started && current >= target) {
+      return true;
+    }
+    started = true;
+    const auto document = seek(target);
+    exhausted = !document;
+    current = document.value_or(current);
+    return !exhausted;
+  }
+  bool next() { return advance(started ? current + 1 : 0); }
+};
+
+using DocIteratorPtr = std::unique_ptr<DocIterator>;
+
+class PostingDocs : public DocIterator {
+private:
+  PostingIterator postings;
+
+protected:
+  std::optional<size_t> seek(size_t target) override {
+    if (!postings.advance(target)) {
+      return std::nullopt;
+    }
+    return postings.document();
+  }
+
+public:
+  explicit PostingDocs(PostingIterator p) : postings(std::move(p)) {}
+  size_t cost() const override { return postings.size(); }
+};
+
+// Documents precomputed in a sorted vector, such as phrase matches.
+class ListDocs : public DocIterator {
+private:
+  std::vector<size_t> documents;
+  size_t cursor = 0;
+
+protected:
+  std::optional<size_t> seek(size_t target) override {
+    cursor = gallop(documents, cursor, target,
+                    [](size_t document) { return document; });
+    if (cursor == documents.size()) {
+      return std::nullopt;
+    }
+    return documents[cursor];
+  }
+
+public:
+  explicit ListDocs(std::vector<size_t> d) : documents(std::move(d)) {}
+  size_t cost() const override { return documents.size(); }
+};
+
+// Every document of the index, the base of a negation with nothing to
+// subtract from.
+class AllDocs : public DocIterator {
+private:
+  size_t count;
+
+protected:
+  std::optional<size_t> seek(size_t target) override {
+    if (target >= count) {
+      return std::nullopt;
+    }
+    return target;
+  }
+
+public:
+  explicit AllDocs(size_t c) : count(c) {}
+  size_t cost() const override { return count; }
+};
+
+class OrDocs : public DocIterator {
+private:
+  std::vector<DocIteratorPtr> children;
+
+protected:
+  std::optional<size_t> seek(size_t target) override {
+    std::optional<size_t> first;
+    for (auto &child : children) {
+      if (child->advance(target)) {
+        first = std::min(first.value_or(child->document()), child->document());
+      }
+    }
+    return first;
+  }
+
+public:
+  explicit OrDocs(std::vector<DocIteratorPtr> c) : children(std::move(c)) {}
+  size_t cost() const override {
+    size_t total = 0;
+    for (const auto &child : children) {
+      total += child->cost();
+    }
+    return total;
+  }
+};
+
+// Documents in every one of `required` and in none of `excluded`. The
+// rarest required operand proposes a candidate and the others advance to
+// it; whoever overshoots proposes the next candidate, so long lists are
+// skipped through rather than walked.
+class AndDocs : public DocIterator {
+private:
+  std::vector<DocIteratorPtr> required;
+  std::vector<DocIteratorPtr> excluded;
+
+protected:
+  std::optional<size_t> seek(size_t target) override {
+    while (required.front()->advance(target)) {
+      size_t candidate = required.front()->document();
+      bool agreed = true;
+      for (size_t i = 1; i < required.size() && agreed; ++i) {
+        if (!required[i]->advance(candidate)) {
+          return std::nullopt;
+        }
+        agreed = required[i]->document() == candidate;
+        candidate = required[i]->document();
+      }
+      for (size_t i = 0; i < excluded.size() && agreed; ++i) {
+        agreed = !excluded[i]->advance(candidate) ||
+                 excluded[i]->document() != candidate;
+        candidate += agreed ? 0 : 1;
+      }
+      if (agreed) {
+        return candidate;
+      }
+      target = candidate;
+    }
+    return std::nullopt;
+  }
+
+public:
+  AndDocs(std::vector<DocIteratorPtr> r, std::vector<DocIteratorPtr> e)
+      : required(std::move(r)), excluded(std::move(e)) {
+    std::sort(required.begin(), required.end(),
+              [](const auto &lhs, const auto &rhs) {
+                return lhs->cost() < rhs->cost();
+              });
+  }
+  size_t cost() const override { return required.front()->cost(); }
+};
+
+// Document and phrase start positions of every document containing the
+// phrase, in document order.
+using PhraseMatches = std::vector<std::pair<size_t, std::vector<size_t>>>;
+
+// The rarest word of the phrase proposes documents and the others advance
+// to them; positions are only decoded for documents holding every word.
+static PhraseMatches match_phrase(const PhraseQuery &phrase,
+                                  const IndexAccessor &index) {
+  std::vector<PostingIterator> lists;
+  size_t lead = 0;
+  for (size_t i = 0; i < phrase.words.size(); ++i) {
+    lists.push_back(index.iteratePostings(phrase.words[i].term));
+    if (lists[i].size() < lists[lead].size()) {
+      lead = i;
+    }
+  }
+
+  PhraseMatches matches;
+  std::vector<std::vector<size_t>> positions(lists.size());
+  size_t target = 0;
+  while (lists[lead].advance(target)) {
+    const size_t document = lists[lead].document();
+    target = document + 1;
+    bool in_all = true;
+    for (size_t i = 0; i < lists.size() && in_all; ++i) {
+      if (!lists[i].advance(document)) {
+        return matches;
+      }
+      in_all = lists[i].document() == document;
+      target = std::max(target, lists[i].document());
+    }
+    if (!in_all) {
+      continue;
+    }
+
+    for (size_t i = 0; i < lists.size(); ++i) {
+      lists[i].positions(positions[i]);
+    }
+    std::vector<size_t> starts;
+    const size_t lead_offset = phrase.words[lead].offset;
+    for (const auto position : positions[lead]) {
+      if (position < lead_offset) {
+        continue;
+      }
+      const size_t start = position - lead_offset;
+      bool matched = true;
+      for (size_t i = 0; i < lists.size() && matched; ++i) {
+        matched = std::binary_search(positions[i].begin(), positions[i].end(),
+                                     start + phrase.words[i].offset);
+      }
+      if (matched) {
+        starts.push_back(start);
+      }
+    }
+    if (!starts.empty()) {
+      matches.emplace_back(document, std::move(starts));
+    }
+  }
+  return matches;
+}
+
+static std::vector<size_t> match_near(const QueryNode &near,
+                                      const IndexAccessor &index) {
+  const auto &left_phrase = near.phrases[0];
+  const auto &right_phrase = near.phrases[1];
+  const auto left = match_phrase(left_phrase, index);
+  const auto right = match_phrase(right_phrase, index);
+  std::vector<size_t> documents;
+  size_t cursor = 0;
+  for (const auto &[document, starts] : left) {
+    cursor = gallop(right, cursor, document,
+                    [](const auto &match) { return match.first; });
+    if (cursor == right.size()) {
+      break;
+    }
+    if (right[cursor].first == document &&
+        span_distance(starts, left_phrase.length(), right[cursor].second,
+                      right_phrase.length()) <= near.distance) {
+      documents.push_back(document);
+    }
+  }
+  return documents;
+}
+
+static std::vector<size_t> phrase_documents(const PhraseQuery &phrase,
+                                            const IndexAccessor &index) {
+  std::vector<size_t> documents;
+  for (const auto &match : match_phrase(phrase, index)) {
+    documents.push_back(match.first);
+  }
+  return documents;
+}
+
+// Builds the iterator over the documents matching `node`. Phrases and NEAR
+// are matched up front, since their positions have to be compared anyway.
+// Words match in the first `fields` fields; phrases only in the title.
+static DocIteratorPtr query_documents(const QueryNode &node,
+                                      const IndexAccessor &index,
+                                      size_t doc_count, size_t fields) {
+  std::vector<DocIteratorPtr> children;
+  switch (node.kind) {
+  case QueryNode::Kind::Word:
+    for (const auto &term : node.terms) {
+      children.push_back(
+          std::make_unique<PostingDocs>(index.iteratePostings(term)));
+      for (size_t f = 1; f < fields; ++f) {
+        children.push_back(std::make_unique<PostingDocs>(
+            index.iteratePostings(fieldTerm(static_cast<Field>(f), term))));
+      }
+    }
+    return std::make_unique<OrDocs>(std::move(children));
+  case QueryNode::Kind::Phrase:
+    return std::make_unique<ListDocs>(
+        phrase_documents(node.phrases.front(), index));
+  case QueryNode::Kind::Near:
+    return std::make_unique<ListDocs>(match_near(node, index));
+  case QueryNode::Kind::Or:
+    for (const auto &child : node.children) {
+      children.push_back(query_documents(child, index, doc_count, fields));
+    }
+    return std::make_unique<OrDocs>(std::move(children));
+  case QueryNode::Kind::Not:
+    children.push_back(
+        query_documents(node.children.front(), index, doc_count, fields));
+    break;
+  case QueryNode::Kind::And: {
+    std::vector<DocIteratorPtr> required;
+    for (const auto &child : node.children) {
+      if (child.kind == QueryNode::Kind::Not) {
+        children.push_back(query_documents(child.children.front(), index,
+                                           doc_count, fields));
+      } else {
+        required.push_back(query_documents(child, index, doc_count, fields));
+      }
+    }
+    if (!required.empty()) {
+      return std::make_unique<AndDocs>(std::move(required),
+                                       std::move(children));
+    }
+    break;
+  }
+  }
+  std::vector<DocIteratorPtr> all;
+  all.push_back(std::make_unique<AllDocs>(doc_count));
+  return std::make_unique<AndDocs>(std::move(all), std::move(children));
+}
+
+// Adds weight / distance for every pair of neighbouring query words found
+// in a scored document, where distance is their closest approach in words.
+static void add_proximity(const Query &query, double weight,
+                          const IndexAccessor &index,
+                          ScoreAccumulator &accumulator) {
+  std::vector<size_t> left_positions;
+  std::vector<size_t> right_positions;
+  for (size_t i = 0; i + 1 < query.words.size(); ++i) {
+    if (query.words[i] == query.words[i + 1]) {
+      continue;
+    }
+    auto left = index.iteratePostings(query.words[i]);
+    auto right = index.iteratePostings(query.words[i + 1]);
+    while (left.next()) {
+      const size_t document = left.document();
+      if (!accumulator.isTouched(document)) {
+        continue;
+      }
+      if (!right.advance(document)) {
+        break;
+      }
+      if (right.document() == document) {
+        left.positions(left_positions);
+        right.positions(right_positions);
+        const size_t distance =
+            span_distance(left_positions, 1, right_positions, 1);
+        accumulator.add(document, weight / static_cast<double>(
+                                               std::max<size_t>(distance, 1)));
+      }
+    }
+  }
+}
+
+// Postings of a query term in the first `Fields` fields, the title term and
+// its field terms, merged in document order. A document is current while
+// any field holds it; the frequencies of the other fields are then 0.
+template <size_t Fields> class FieldPostings {
+private:
+  std::array<PostingIterator, Fields> postings;
+  std::array<bool, Fields> active{};
+  size_t current = 0;
+  bool started = false;
+
+  bool settle() {
+    started = true;
+    current = std::numeric_limits<size_t>::max();
+    for (size_t f = 0; f < Fields; ++f) {
+      if (active[f]) {
+        current = std::min(current, postings[f].document());
+      }
+    }
+    return current != std::numeric_limits<size_t>::max();
+  }
+
+public:
+  explicit FieldPostings(std::array<PostingIterator, Fields> p)
+      : postings(std::move(p)) {}
+  bool hasBounds() const {
+    return std::all_of(postings.begin(), postings.end(),
+                       [](const auto &field) { return field.hasBounds(); });
+  }
+  FieldFrequencies maxFrequencies() const {
+    FieldFrequencies frequencies{};
+    for (size_t f = 0; f < Fields; ++f) {
+      frequencies[f] = postings[f].maxFrequency();
+    }
+    return frequencies;
+  }
+  // Every field ends its current block at or after `target`, and the
+  // documents up to the first block end hold at most the block maxima.
+  std::optional<std::pair<size_t, FieldFrequencies>>
+  blockBound(size_t target) const {
+    std::optional<std::pair<size_t, FieldFrequencies>> bound;
+    for (size_t f = 0; f < Fields; ++f) {
+      if (started && !active[f]) {
+        continue;
+      }
+      const auto block = postings[f].blockBound(target);
+      if (!block) {
+        continue;
+      }
+      if (!bound) {
+        bound.emplace(block->last_document, FieldFrequencies{});
+      }
+      bound->first = std::min(bound->first, block->last_document);
+      bound->second[f] = block->max_frequency;
+    }
+    return bound;
+  }
+  bool next() {
+    for (size_t f = 0; f < Fields; ++f) {
+      if (!started) {
+        active[f] = postings[f].next();
+      } else if (active[f] && postings[f].document() == current) {
+        active[f] = postings[f].next();
+      }
+    }
+    return settle();
+  }
+  bool advance(size_t target) {
+    for (size_t f = 0; f < Fields; ++f) {
+      if (!started || active[f]) {
+        active[f] = postings[f].advance(target);
+      }
+    }
+    return settle();
+  }
+  size_t document() const { return current; }
+  FieldFrequencies frequencies() const {
+    FieldFrequencies frequencies{};
+    for (size_t f = 0; f < Fields; ++f) {
+      if (active[f] && postings[f].document() == current) {
+        frequencies[f] = postings[f].frequency();
+      }
+    }
+    return frequencies;
+  }
+};
+
+// A query term during scoring: its postings, its weight and, for pruning,
+// the bound of its score over all documents.
+template <class Policy> struct TermCursor {
+  FieldPostings<Policy::fields> postings;
+  double weight;
+  double max_score;
+  // Position in the query; scores are summed in query order so that every
+  // evaluation strategy rounds them the same way.
+  size_t order;
+};
+
+// Relative margin added to score bounds, so that rounding of sums taken in
+// another order never prunes a document that belongs in the top-k.
+constexpr double score_bound_margin = 1e-9;
+
+template <class Policy>
+static double score_bound(const Policy &ranking,
+                          const FieldFrequencies &frequencies, double weight) {
+  return ranking.bound(frequencies, weight) * (1.0 + score_bound_margin);
+}
+
+// Block-Max WAND over a disjunction of terms. The cursors are kept in
+// document order and the pivot is the first document at which the bounds of
+// the terms up to it could beat the worst of the `limit` best scores so far;
+// every document before it is skipped. If the bounds of the blocks holding
+// the pivot still cannot beat it, the cursors jump past those blocks
+// without decoding them. Returns the `limit` best live documents; ties go
+// to the lower ordinal, as in exhaustive scoring.
+template <class Policy>
+static std::vector<std::pair<size_t, double>>
+top_documents(std::vector<TermCursor<Policy>> &terms, size_t limit,
+              const Policy &ranking, const DeletedDocuments &deleted) {
+  using Cursor = TermCursor<Policy>;
+  using Scored = std::pair<double, size_t>;
+  const auto worse_on_top = [](const Scored &lhs, const Scored &rhs) {
+    return better_result(lhs.second, lhs.first, rhs.second, rhs.first);
+  };
+  std::vector<Scored> heap;
+  double threshold = -std::numeric_limits<double>::infinity();
+
+  std::vector<Cursor *> cursors;
+  for (auto &term : terms) {
+    if (term.postings.next()) {
+      cursors.push_back(&term);
+    }
+  }
+  const auto by_document = [](const Cursor *lhs, const Cursor *rhs) {
+    return lhs->postings.document() < rhs->postings.document();
+  };
+  const auto by_order = [](const Cursor *lhs, const Cursor *rhs) {
+    return lhs->order < rhs->order;
+  };
+
+  while (limit != 0 && !cursors.empty()) {
+    std::sort(cursors.begin(), cursors.end(), by_document);
+    double bound = 0.0;
+    size_t pivot = 0;
+    for (; pivot < cursors.size(); ++pivot) {
+      bound += cursors[pivot]->max_score;
+      if (bound > threshold) {
+        break;
+      }
+    }
+    if (pivot == cursors.size()) {
+      break;
+    }
+    const size_t document = cursors[pivot]->postings.document();
+    while (pivot + 1 < cursors.size() &&
+           cursors[pivot + 1]->postings.document() == document) {
+      ++pivot;
+    }
+
+    // Documents up to the first block end or the next cursor can only hold
+    // the terms up to the pivot, all within their current blocks.
+    double block_bound = 0.0;
+    size_t skip_target = pivot + 1 < cursors.size()
+                             ? cursors[pivot + 1]->postings.document()
+                             : std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i <= pivot; ++i) {
+      const auto block = cursors[i]->postings.blockBound(document);
+      if (block) {
+        block_bound +=
+            score_bound(ranking, block->second, cursors[i]->weight);
+        skip_target = std::min(skip_target, block->first + 1);
+      }
+    }
+
+    const auto ended = [](Cursor *cursor) { return cursor == nullptr; };
+    if (block_bound <= threshold) {
+      for (size_t i = 0; i <= pivot; ++i) {
+        if (!cursors[i]->postings.advance(skip_target)) {
+          cursors[i] = nullptr;
+        }
+      }
+    } else if (cursors.front()->postings.document() == document) {
+      std::sort(cursors.begin(),
+                cursors.begin() + static_cast<std::ptrdiff_t>(pivot) + 1,
+                by_order);
+      const bool live = !deleted.contains(document);
+      double score = 0.0;
+      for (size_t i = 0; i <= pivot; ++i) {
+        auto &postings = cursors[i]->postings;
+        if (live) {
+          score += ranking.score(postings.frequencies(), cursors[i]->weight,
+                                 document);
+        }
+        if (!postings.next()) {
+          cursors[i] = nullptr;
+        }
+      }
+      if (live && heap.size() < limit) {
+        heap.emplace_back(score, document);
+        std::push_heap(heap.begin(), heap.end(), worse_on_top);
+      } else if (live && better_result(document, score, heap.front().second,
+                                       heap.front().first)) {
+        std::pop_heap(heap.begin(), heap.end(), worse_on_top);
+        heap.back() = {score, document};
+        std::push_heap(heap.begin(), heap.end(), worse_on_top);
+      }
+      if (heap.size() == limit) {
+        threshold = heap.front().first;
+      }
+    } else {
+      for (size_t i = 0; i < pivot; ++i) {
+        if (cursors[i]->postings.document() < document &&
+            !cursors[i]->postings.advance(document)) {
+          cursors[i] = nullptr;
+        }
+      }
+    }
+    cursors.erase(std::remove_if(cursors.begin(), cursors.end(), ended),
+                  cursors.end());
+  }
+
+  std::vector<std::pair<size_t, double>> result;
+  result.reserve(heap.size());
+  for (const auto &[score, identifier] : heap) {
+    result.emplace_back(identifier, score);
+  }
+  return result;
+}
+
+// Returns (document ordinal, score) for every document matching the query.
+// A query that only joins words with OR is scored straight off the posting
+// lists; any other query is matched first, and then every term advances
+// through the matched documents only. With a `limit`, a disjunction whose
+// postings carry score bounds only returns the `limit` best documents and
+// skips the ones that cannot be among them.
+template <class Policy>
+static std::vector<std::pair<size_t, double>>
+rank_documents(const Config &config, const IndexAccessor &index,
+               const Query &query, double N, size_t limit) {
+  const Policy ranking(config, index);
+  const double corpus_docs = index.corpusDocs();
+  const DeletedDocuments deleted = index.deletedDocuments();
+  std::vector<TermCursor<Policy>> terms;
+  bool bounded = true;
+  for (size_t i = 0; i < query.terms.size(); ++i) {
+    FieldStats stats{};
+    std::array<PostingIterator, Policy::fields> postings;
+    bool found = false;
+    for (size_t f = 0; f < Policy::fields; ++f) {
+      const auto term =
+          f == 0 ? query.terms[i]
+                 : fieldTerm(static_cast<Field>(f), query.terms[i]);
+      stats[f] = index.termStats(term);
+      if (stats[f].df != 0) {
+        postings[f] = index.iteratePostings(term);
+        found = true;
+      }
+    }
+    if (!found) {
+      continue;
+    }
+    FieldPostings<Policy::fields> field_postings(std::move(postings));
+    const double weight = ranking.weight(stats, corpus_docs);
+    const double max_score =
+        score_bound(ranking, field_postings.maxFrequencies(), weight);
+    bounded = bounded && field_postings.hasBounds();
+    terms.push_back({std::move(field_postings), weight, max_score, i});
+  }
+  const bool filtered = !query.isDisjunction();
+  if (!filtered && bounded && limit < static_cast<size_t>(N) &&
+      config.getProximityWeight() <= 0.0) {
+    return top_documents(terms, limit, ranking, deleted);
+  }
+
+  thread_local ScoreAccumulator accumulator;
+  accumulator.reset(static_cast<size_t>(N));
+  std::vector<size_t> matched;
+  if (filtered) {
+    const auto documents = query_documents(*query.root, index,
+                                           static_cast<size_t>(N),
+                                           Policy::fields);
+    while (documents->next()) {
+      if (deleted.contains(documents->document())) {
+        continue;
+      }
+      matched.push_back(documents->document());
+      accumulator.add(documents->document(), 0.0);
+    }
+  }
+
+  for (auto &[postings, weight, max_score, order] : terms) {
+    const auto add = [&]() {
+      accumulator.add(postings.document(),
+                      ranking.score(postings.frequencies(), weight,
+                                    postings.document()));
+    };
+    if (!filtered) {
+      while (postings.next()) {
+        add();
+      }
+      continue;
+    }
+    for (const auto document : matched) {
+      if (!postings.advance(document)) {
+        break;
+      }
+      if (postings.document() == document) {
+        add();
+      }
+    }
+  }
+
+  if (config.getProximityWeight() > 0.0) {
+    add_proximity(query, config.getProximityWeight(), index, accumulator);
+  }
+
+  std::vector<std::pair<size_t, double>> result;
+  result.reserve(accumulator.touchedDocuments().size());
+  for (const auto identifier : accumulator.touchedDocuments()) {
+    if (!deleted.contains(identifier)) {
+      result.emplace_back(identifier, accumulator.score(identifier));
+    }
+  }
+  return result;
+}
+
+// Picks the ranking once per query; everything below runs on the
+// instantiation for it.
+static std::vector<std::pair<size_t, double>>
+score_documents(const Config &config, const IndexAccessor &index,
+                const std::string &query_text,
+                size_t limit = std::numeric_limits<size_t>::max()) {
   double N = 0.0;
   if (!index.totalDocs(N)) {
     throw ConfigurationException(
         "There no files in directory you choose. Forgot index.");
   }
-  for (const auto &word : parsed_query) {
-    for (const auto &term : word.word_ngrams) {
-      std::vector<size_t> docs;
+  const Query query = parseQuery(query_text, config);
+  switch (config.getRanking()) {
+  case Ranking::Bm25:
+    return rank_documents<Bm25Ranking>(config, index, query, N, limit);
+  case Ranking::Bm25F:
+    return rank_documents<Bm25FRanking>(config, index, query, N, limit);
+  case Ranking::TfIdf:
+    break;
+  }
+  return rank_documents<TfIdfRanking>(config, index, query, N, limit);
+}
 
-      docs = index.getDocByTerm(term);
+std::vector<Result> search(const Config &config,
+                           const fts::IndexAccessor &index,
+                           const std::string &query) {
+  const auto result = score_documents(config, index, query);
+  std::vector<Result> results;
 
-      const auto df = static_cast<double>(docs.size());
-      for (const auto &identifier : docs) {
-        const auto tf =
-            static_cast<double>(index.getCountTermsInDoc(term, identifier));
-        result[identifier] += tf * log(N / df);
-      }
+  for (const auto &[identifier, score] : result) {
+    results.push_back({identifier, score, {}});
+  }
+  sortResults(results);
+  for (auto &[document_id, score, text] : results) {
+    text = index.loadDocument(document_id);
+    document_id = index.externalId(document_id);
+  }
+  return results;
+}
+
+std::vector<Result> search(const Config &config,
+                           const fts::IndexAccessor &index,
+                           const std::string &query, size_t k, size_t offset) {
+  const auto result = score_documents(config, index, query, offset + k);
+
+  // The heap keeps the offset + k best documents with the worst on top, so
+  // only those are ever compared again and titles are loaded for one page.
+  using Scored = std::pair<double, size_t>;
+  const auto worse_on_top = [](const Scored &lhs, const Scored &rhs) {
+    return better_result(lhs.second, lhs.first, rhs.second, rhs.first);
+  };
+  std::vector<Scored> heap;
+  const size_t limit = offset + k;
+  heap.reserve(std::min(limit, result.size()));
+  for (const auto &[identifier, score] : result) {
+    if (heap.size() < limit) {
+      heap.emplace_back(score, identifier);
+      std::push_heap(heap.begin(), heap.end(), worse_on_top);
+    } else if (limit != 0 && better_result(identifier, score,
+                                           heap.front().second,
+                                           heap.front().first)) {
+      std::pop_heap(heap.begin(), heap.end(), worse_on_top);
+      heap.back() = {score, identifier};
+      std::push_heap(heap.begin(), heap.end(), worse_on_top);
     }
   }
-  std::vector<Result> results;
+  std::sort_heap(heap.begin(), heap.end(), worse_on_top);
 
-  for (const auto &[document_id, score] : result) {
-    const auto text = index.loadDocument(document_id);
-    results.push_back({document_id, score, text});
+  std::vector<Result> results;
+  for (size_t i = offset; i < heap.size(); ++i) {
+    const auto &[score, identifier] = heap[i];
+    results.push_back({index.externalId(identifier), score,
+                       index.loadDocument(identifier)});
   }
-  sort_by_score(results);
   return results;
 }
 
@@ -63,7 +859,7 @@ void printResult(const std::vector<Result> &result) {
     std::cout << "\t" << i << "\t" << id << "\t" << score << "\t" << text
               << "\n";
     ++i;
-    if (i == 20) {
+    if (i > printed_results_count) {
       break;
     }
   }
@@ -78,7 +874,7 @@ std::string getStringSearchResult(const std::vector<Result> &search_result) {
     result += ("\t" + std::to_string(i) + "\t" + std::to_string(document_id) +
                "\t" + std::to_string(score) + "\t" + text + "\n");
     ++i;
-    if (i == 20) {
+    if (i > printed_results_count) {
       break;
     }
   }
@@ -121,16 +917,24 @@ void parseBinaryEntry(
     const std::string &term,
     std::map<size_t, std::vector<size_t>> &entry) {
 
-  const auto *index_data = fts::mmap_bin_file(path_of_doc);
-  fts::Header header(index_data);
-  BinaryReader reader(index_data);
+  const MappedIndex index_file(path_of_doc);
+  const auto &header = index_file.header();
+  BinaryReader reader(index_file.data());
   reader.move(header.sectionOffset("dictionary"));
-  DictionaryAccessor dictionary(reader.current());
+  const DictionaryAccessor dictionary(
+      reader.current(),
+      static_cast<DictionaryVersion>(header.sectionVersion("dictionary")));
   const auto entry_offset = dictionary.retrieve(term);
+  if (!entry_offset) {
+    return;
+  }
   reader.moveBack();
   reader.move(header.sectionOffset("entries"));
-  EntryAccessor entries(reader.current());
-  std::map<size_t, std::vector<size_t>> buf = entries.getTermInfos(entry_offset);
+  const EntryAccessor entries(
+      reader.current(), header.section("entries").size,
+      static_cast<EntriesVersion>(header.sectionVersion("entries")));
+  std::map<size_t, std::vector<size_t>> buf =
+      entries.getTermInfos(*entry_offset);
   for (auto &[id, pos] : buf) {
     entry[id].push_back(pos.size());
     for (auto p : pos) {
@@ -141,6 +945,57 @@ void parseBinaryEntry(
 
 // TextIndexAccessor
 
+// Counts the document files of an index written without a stats file.
+static size_t count_documents(const std::string &path) {
+  size_t file_count = 0;
+  DIR *dirp = opendir(path.c_str());
+  if (dirp == nullptr) {
+    return 0;
+  }
+  struct dirent *entry = nullptr;
+
+  while ((entry = readdir(dirp)) != nullptr) {
+    if (entry->d_type == DT_REG) {
+      file_count++;
+    }
+  }
+  closedir(dirp);
+  return file_count;
+}
+
+TextIndexAccessor::TextIndexAccessor(std::filesystem::path new_path)
+    : path_of_docs(std::move(new_path)) {
+  std::ifstream file(path_of_docs / "ids");
+  size_t external_id = 0;
+  while (file >> external_id) {
+    external_ids.push_back(external_id);
+  }
+
+  std::ifstream stats_file(path_of_docs / "stats");
+  if (!(stats_file >> docs_count)) {
+    docs_count = count_documents(path_of_docs.string() + "/docs");
+    return;
+  }
+  for (size_t field = 0; field < field_count; ++field) {
+    std::uint64_t total_length = 0;
+    if (!(stats_file >> total_length)) {
+      break;
+    }
+    lengths[field].resize(docs_count);
+    for (auto &length : lengths[field]) {
+      stats_file >> length;
+    }
+    if (docs_count != 0 && total_length != 0) {
+      average_lengths[field] =
+          static_cast<double>(total_length) / static_cast<double>(docs_count);
+    }
+  }
+}
+
+size_t TextIndexAccessor::externalId(size_t identifier) const {
+  return external_ids.at(identifier);
+}
+
 std::string TextIndexAccessor::loadDocument(size_t identifier) const {
   std::string document;
   std::ifstream file(path_of_docs / "docs" / std::to_string(identifier));
@@ -149,23 +1004,31 @@ std::string TextIndexAccessor::loadDocument(size_t identifier) const {
 }
 
 bool TextIndexAccessor::totalDocs(double &file_count) const {
-  const std::string path = path_of_docs.string() + "/docs";
-  if (!std::filesystem::exists(path)) {
-    return false;
-  }
-  DIR *dirp = opendir(path.c_str());
-  struct dirent *entry = nullptr;
+  file_count = static_cast<double>(docs_count);
+  return docs_count != 0;
+}
 
-  while ((entry = readdir(dirp)) != nullptr) {
-    if (entry->d_type == DT_REG) {
-      file_count++;
-    }
+TermStats TextIndexAccessor::termStats(std::string_view term) const {
+  const std::string key(term);
+  std::string hash_hex_term;
+  picosha2::hash256_hex_string(key, hash_hex_term);
+  std::ifstream file(path_of_docs / "entries" / hash_hex_term.substr(0, 6));
+  std::string entry_term;
+  size_t df = 0;
+  if (!(file >> entry_term >> df) || entry_term != key || df == 0) {
+    return {0, 0.0};
   }
-  closedir(dirp);
-  if (file_count == 0) {
-    return false;
+  return {df, log(static_cast<double>(docs_count) / static_cast<double>(df))};
+}
+
+DocumentLengths TextIndexAccessor::documentLengths(Field field) const {
+  const auto &field_lengths = lengths[static_cast<size_t>(field)];
+  const double average = average_lengths[static_cast<size_t>(field)];
+  if (field_lengths.empty()) {
+    return DocumentLengths(nullptr, average);
   }
-  return true;
+  return DocumentLengths(reinterpret_cast<const char *>(field_lengths.data()),
+                         average);
 }
 
 std::vector<size_t>
@@ -193,44 +1056,280 @@ size_t TextIndexAccessor::getCountTermsInDoc(const std::string &term,
   return entries[term][identifier].size();
 }
 
+std::vector<Posting>
+TextIndexAccessor::getPostings(std::string_view term) const {
+  std::vector<Posting> postings;
+  std::map<std::string, std::map<size_t, std::vector<size_t>>> entries;
+  const std::string key(term);
+  std::string hash_hex_term;
+  picosha2::hash256_hex_string(key, hash_hex_term);
+  parseTextEntry(path_of_docs / "entries" / hash_hex_term.substr(0, 6), entries);
+
+  for (auto &[docs_id, info] : entries[key]) {
+    // parseTextEntry stores the position count in front of the positions
+    const size_t pos_count = info.front();
+    info.erase(info.begin());
+    postings.push_back({docs_id, pos_count, std::move(info)});
+  }
+
+  return postings;
+}
+
 // Header
 
-Header::Header(const char *data) {
+Header::Header(const char *data, std::size_t size) {
+  if (size < file_header_size ||
+      std::memcmp(data, index_magic, sizeof(index_magic)) != 0) {
+    throw IndexFormatException("Not a binary index");
+  }
   BinaryReader reader(data);
+  reader.move(sizeof(index_magic));
+  std::uint32_t version = 0;
+  std::uint32_t section_count = 0;
+  reader.readBinary(&version, sizeof(version));
   reader.readBinary(&section_count, sizeof(section_count));
-  for (std::size_t i = 0; i < section_count; ++i) {
-    std::uint8_t length = 0;
-    reader.readBinary(&length, sizeof(length));
-    std::string name(length - 1, ' ');
-    reader.readBinary(name.data(), name.length());
-    std::uint32_t section_offset = 0;
-    reader.readBinary(&section_offset, sizeof(section_offset));
-    sections[name] = section_offset;
+  reader.readBinary(&table_checksum, sizeof(table_checksum));
+  reader.move(sizeof(std::uint32_t));
+  if (version != container_version) {
+    throw IndexFormatException("Unsupported index container version " +
+                               std::to_string(version));
+  }
+  if (section_count > (size - file_header_size) / section_entry_size) {
+    throw IndexFormatException("Section table exceeds the index file");
+  }
+  const std::uint64_t table_end =
+      file_header_size + std::uint64_t{section_count} * section_entry_size;
+  if (crc32(reader.current(), table_end - file_header_size) !=
+      table_checksum) {
+    throw IndexFormatException("Section table checksum mismatch");
+  }
+
+  for (std::uint32_t i = 0; i < section_count; ++i) {
+    char name[section_name_size] = {};
+    reader.readBinary(name, sizeof(name));
+    SectionInfo info{};
+    reader.readBinary(&info.version, sizeof(info.version));
+    reader.readBinary(&info.checksum, sizeof(info.checksum));
+    reader.readBinary(&info.offset, sizeof(info.offset));
+    reader.readBinary(&info.size, sizeof(info.size));
+    const std::string section_name(name, strnlen(name, sizeof(name)));
+    if (info.offset % section_alignment != 0 || info.offset < table_end ||
+        info.offset > size || info.size > size - info.offset) {
+      throw IndexFormatException("Section " + section_name +
+                                 " is out of bounds");
+    }
+    if (!sections.emplace(section_name, info).second) {
+      throw IndexFormatException("Duplicate section " + section_name);
+    }
   }
 }
 
+const SectionInfo &Header::section(const std::string &name) const {
+  const auto info = sections.find(name);
+  if (info == sections.end()) {
+    throw IndexFormatException("Index has no section " + name);
+  }
+  return info->second;
+}
+
 // DocumentAccessor
 
-std::string DocumentAccessor::loadDocument(size_t identifier) const {
+DocumentAccessor::DocumentAccessor(const char *d, std::uint8_t version)
+    : document_data(d) {
+  if (version != docs_version) {
+    throw IndexFormatException("Unsupported docs version " +
+                               std::to_string(version));
+  }
   BinaryReader reader(document_data);
-  reader.move(identifier);
-  std::uint8_t length = 0;
-  reader.readBinary(&length, sizeof(length));
-  std::string document(length - 1, ' ');
-  reader.readBinary(document.data(), document.length());
-  return document;
+  reader.readBinary(&docs_count, sizeof(docs_count));
 }
 
-size_t DocumentAccessor::totalDocs() const {
+size_t DocumentAccessor::externalId(size_t identifier) const {
+  BinaryReader reader(document_data);
+  reader.move(sizeof(docs_count) + identifier * sizeof(std::uint64_t));
+  std::uint64_t book_id = 0;
+  reader.readBinary(&book_id, sizeof(book_id));
+  return book_id;
+}
+
+std::string DocumentAccessor::loadDocument(size_t identifier) const {
   BinaryReader reader(document_data);
-  std::uint32_t titles_count = 0;
-  reader.readBinary(&titles_count, sizeof(titles_count));
-  return titles_count;
+  reader.move(sizeof(docs_count) + docs_count * sizeof(std::uint64_t) +
+              identifier * sizeof(std::uint32_t));
+  std::uint32_t title_begin = 0;
+  std::uint32_t title_end = 0;
+  reader.readBinary(&title_begin, sizeof(title_begin));
+  reader.readBinary(&title_end, sizeof(title_end));
+  return {document_data + title_begin, document_data + title_end};
+}
+
+// StatsAccessor
+
+StatsAccessor::StatsAccessor(const char *d, std::uint32_t version) {
+  if (version != 1 && version != stats_version) {
+    throw IndexFormatException("Unsupported stats version " +
+                               std::to_string(version));
+  }
+  BinaryReader reader(d);
+  reader.readBinary(&docs_count, sizeof(docs_count));
+  reader.readBinary(&terms_count, sizeof(terms_count));
+  if (version == stats_version) {
+    reader.readBinary(&fields_count, sizeof(fields_count));
+    reader.move(sizeof(std::uint32_t));
+  }
+  for (std::uint32_t field = 0; field < fields_count; ++field) {
+    std::uint64_t total_length = 0;
+    reader.readBinary(&total_length, sizeof(total_length));
+    if (field < field_count) {
+      total_lengths[field] = total_length;
+    }
+  }
+  lengths_data = reader.current();
+  terms_data = lengths_data +
+               static_cast<size_t>(fields_count) * docs_count *
+                   sizeof(std::uint32_t);
+}
+
+DocumentLengths StatsAccessor::lengths(Field field) const {
+  const auto field_index = static_cast<size_t>(field);
+  const auto total_length = total_lengths[field_index];
+  if (field_index >= fields_count) {
+    return DocumentLengths();
+  }
+  const double average =
+      docs_count == 0 || total_length == 0
+          ? 1.0
+          : static_cast<double>(total_length) /
+                static_cast<double>(docs_count);
+  return DocumentLengths(lengths_data + field_index * docs_count *
+                                            sizeof(std::uint32_t),
+                         average);
+}
+
+std::optional<TermStats>
+StatsAccessor::term(std::uint32_t entry_offset) const {
+  const auto offset_of = [&](std::uint32_t record) {
+    std::uint32_t offset = 0;
+    std::memcpy(&offset, terms_data + record * stats_term_size,
+                sizeof(offset));
+    return offset;
+  };
+  std::uint32_t low = 0;
+  std::uint32_t high = terms_count;
+  while (low < high) {
+    const std::uint32_t middle = low + (high - low) / 2;
+    if (offset_of(middle) < entry_offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == terms_count || offset_of(low) != entry_offset) {
+    return std::nullopt;
+  }
+  BinaryReader reader(terms_data + low * stats_term_size);
+  reader.move(sizeof(std::uint32_t));
+  std::uint32_t df = 0;
+  double idf = 0.0;
+  reader.readBinary(&df, sizeof(df));
+  reader.readBinary(&idf, sizeof(idf));
+  return TermStats{df, idf};
 }
 
 // DictionaryAccessor
 
-std::uint32_t DictionaryAccessor::retrieve(const std::string &word) {
+DictionaryAccessor::DictionaryAccessor(const char *d, DictionaryVersion v)
+    : dictionary_data(d), version(v) {
+  if (version == DictionaryVersion::Trie) {
+    return;
+  }
+  if (version != DictionaryVersion::FrontCoded) {
+    throw IndexFormatException("Unsupported dictionary version " +
+                               std::to_string(static_cast<int>(version)));
+  }
+  BinaryReader reader(dictionary_data);
+  std::uint32_t block_count = 0;
+  reader.readBinary(&terms_count, sizeof(terms_count));
+  reader.readBinary(&block_count, sizeof(block_count));
+  block_offsets.resize(block_count);
+  reader.readBinary(block_offsets.data(),
+                    block_count * sizeof(std::uint32_t));
+
+  // The first term of every block is stored whole, so the in-memory skip
+  // index can point straight into the mapped section.
+  block_first_terms.reserve(block_count);
+  for (const auto block_offset : block_offsets) {
+    const auto length = static_cast<std::uint8_t>(
+        dictionary_data[block_offset + sizeof(std::uint8_t)]);
+    block_first_terms.emplace_back(
+        dictionary_data + block_offset + 2 * sizeof(std::uint8_t), length);
+  }
+}
+
+std::optional<std::uint32_t>
+DictionaryAccessor::retrieve(std::string_view word) const {
+  if (version == DictionaryVersion::Trie) {
+    return retrieveTrie(word);
+  }
+  return retrieveFrontCoded(word);
+}
+
+void DictionaryAccessor::forEachTerm(
+    const std::function<void(std::string_view, std::uint32_t)> &visit) const {
+  if (version == DictionaryVersion::Trie) {
+    std::string term;
+    visitTrie(0, term, visit);
+    return;
+  }
+  std::string term;
+  BinaryReader reader(dictionary_data);
+  for (std::uint32_t i = 0; i < terms_count; ++i) {
+    if (i % dictionary_block_size == 0) {
+      reader.moveBack();
+      reader.move(block_offsets[i / dictionary_block_size]);
+    }
+    std::uint8_t shared = 0;
+    std::uint8_t suffix_size = 0;
+    reader.readBinary(&shared, sizeof(shared));
+    reader.readBinary(&suffix_size, sizeof(suffix_size));
+    term.resize(shared);
+    term.append(reader.current(), suffix_size);
+    reader.move(suffix_size);
+    std::uint32_t entry_offset = 0;
+    reader.readBinary(&entry_offset, sizeof(entry_offset));
+    visit(term, entry_offset);
+  }
+}
+
+// Children are stored in character order, so terms come out sorted.
+void DictionaryAccessor::visitTrie(
+    std::uint32_t node_offset, std::string &term,
+    const std::function<void(std::string_view, std::uint32_t)> &visit) const {
+  BinaryReader reader(dictionary_data);
+  reader.move(node_offset);
+  std::uint32_t children_count = 0;
+  reader.readBinary(&children_count, sizeof(children_count));
+  const char *letters = reader.current();
+  reader.move(children_count);
+  std::vector<std::uint32_t> child_offsets(children_count);
+  reader.readBinary(child_offsets.data(),
+                    children_count * sizeof(std::uint32_t));
+  std::uint8_t is_leaf = 0;
+  reader.readBinary(&is_leaf, sizeof(is_leaf));
+  if (is_leaf == 1) {
+    std::uint32_t entry_offset = 0;
+    reader.readBinary(&entry_offset, sizeof(entry_offset));
+    visit(term, entry_offset);
+  }
+  for (std::uint32_t i = 0; i < children_count; ++i) {
+    term.push_back(letters[i]);
+    visitTrie(child_offsets[i], term, visit);
+    term.pop_back();
+  }
+}
+
+std::optional<std::uint32_t>
+DictionaryAccessor::retrieveTrie(std::string_view word) const {
   BinaryReader reader(dictionary_data);
   std::uint32_t children_count = 0;
   std::uint8_t is_leaf = 0;
@@ -246,50 +1345,466 @@ std::uint32_t DictionaryAccessor::retrieve(const std::string &word) {
         child_pos = i;
       }
     }
+    if (child_pos == children_count) {
+      return std::nullopt;
+    }
     reader.move(sizeof(child_offset) * child_pos);
     reader.readBinary(&child_offset, sizeof(child_offset));
-    reader.move(sizeof(child_offset) * (children_count - child_pos - 1));
-    reader.readBinary(&is_leaf, sizeof(is_leaf));
-    if (is_leaf == 1) {
-      reader.readBinary(&entry_offset, sizeof(entry_offset));
-    }
-    if (child_offset != 0) {
-      reader.moveBack();
-      reader.move(child_offset);
-    }
+    reader.moveBack();
+    reader.move(child_offset);
   }
   reader.readBinary(&children_count, sizeof(children_count));
   reader.move(static_cast<size_t>(children_count * 5));
   reader.readBinary(&is_leaf, sizeof(is_leaf));
+  if (is_leaf != 1) {
+    return std::nullopt;
+  }
   reader.readBinary(&entry_offset, sizeof(entry_offset));
   return entry_offset;
 }
 
-// EntryAccessor
+std::optional<std::uint32_t>
+DictionaryAccessor::retrieveFrontCoded(std::string_view key) const {
+  const auto block_it = std::upper_bound(block_first_terms.begin(),
+                                         block_first_terms.end(), key);
+  if (block_it == block_first_terms.begin()) {
+    return std::nullopt;
+  }
+  const auto block = block_it - block_first_terms.begin() - 1;
+  const auto block_end = static_cast<std::size_t>(block) + 1 <
+                                 block_first_terms.size()
+                             ? dictionary_data + block_offsets[block + 1]
+                             : nullptr;
 
-std::map<size_t, std::vector<size_t>>
-EntryAccessor::getTermInfos(std::uint32_t entry_offset) {
-  BinaryReader reader(entry_data);
-  std::map<size_t, std::vector<size_t>> term_infos;
-  reader.move(entry_offset);
-  std::uint32_t doc_count = 0;
-  reader.readBinary(&doc_count, sizeof(doc_count));
-  for (size_t i = 0; i < doc_count; ++i) {
-    std::uint32_t doc_offset = 0;
-    reader.readBinary(&doc_offset, sizeof(doc_offset));
-    std::uint32_t pos_count = 0;
-    reader.readBinary(&pos_count, sizeof(pos_count));
-    std::vector<size_t> positions;
-    for (size_t j = 0; j < pos_count; ++j) {
+  // Every term in the block is compared against the query without
+  // rebuilding it: `matched` is the common prefix of the query and the
+  // previous term, which was smaller than the query.
+  BinaryReader reader(dictionary_data);
+  reader.move(block_offsets[block]);
+  std::size_t matched = 0;
+  for (std::uint32_t i = 0; i < dictionary_block_size; ++i) {
+    if (reader.current() == block_end) {
+      break;
+    }
+    std::uint8_t shared = 0;
+    std::uint8_t suffix_size = 0;
+    reader.readBinary(&shared, sizeof(shared));
+    reader.readBinary(&suffix_size, sizeof(suffix_size));
+    const std::string_view suffix(reader.current(), suffix_size);
+    reader.move(suffix_size);
+    std::uint32_t entry_offset = 0;
+    reader.readBinary(&entry_offset, sizeof(entry_offset));
+
+    if (shared > matched) {
+      continue;
+    }
+    if (shared < matched) {
+      return std::nullopt;
+    }
+    const auto rest = key.substr(matched);
+    const auto common = static_cast<std::size_t>(
+        std::mismatch(suffix.begin(), suffix.end(), rest.begin(), rest.end())
+            .first -
+        suffix.begin());
+    if (common == suffix.size() && common == rest.size()) {
+      return entry_offset;
+    }
+    if (common == rest.size() ||
+        (common < suffix.size() &&
+         static_cast<unsigned char>(suffix[common]) >
+             static_cast<unsigned char>(rest[common]))) {
+      return std::nullopt;
+    }
+    matched += common;
+  }
+  return std::nullopt;
+}
+
+// PostingCursor
+
+PostingCursor::PostingCursor(const char *term_data, const char *section_end,
+                             EntriesVersion v)
+    : version(v), next_block(term_data), entries_end(section_end) {
+  if (version == EntriesVersion::Raw) {
+    BinaryReader reader(next_block);
+    reader.readBinary(&doc_count, sizeof(doc_count));
+    next_block = reader.current();
+  } else {
+    next_block = decodeVarint(next_block, doc_count);
+  }
+  block_count = (doc_count + posting_block_size - 1) / posting_block_size;
+  if (version == EntriesVersion::BlockMax) {
+    next_block = decodeVarint(next_block, max_frequency);
+    skip_fields = 3;
+  }
+  if (version == EntriesVersion::Skipped ||
+      version == EntriesVersion::BlockMax) {
+    skip_table = next_block;
+    blocks_data = skip_table;
+    if (block_count > 1) {
+      blocks_data += block_count * skip_fields * sizeof(std::uint32_t);
+    }
+  }
+}
+
+// Field 0 is the last doc id of the block, field 1 its offset and field 2,
+// for BlockMax terms, its largest term frequency.
+std::uint32_t PostingCursor::skipEntry(std::uint32_t block,
+                                       size_t field) const {
+  std::uint32_t value = 0;
+  std::memcpy(&value,
+              skip_table +
+                  (skip_fields * block + field) * sizeof(std::uint32_t),
+              sizeof(value));
+  return value;
+}
+
+std::optional<BlockBound>
+PostingCursor::blockBound(std::uint32_t target) const {
+  if (at_end) {
+    return std::nullopt;
+  }
+  if (block_count <= 1) {
+    return BlockBound{std::numeric_limits<std::uint32_t>::max(),
+                      max_frequency};
+  }
+  // The decoded block may still hold the target.
+  std::uint32_t low = block_docs_count > 0 ? blocks_read - 1 : blocks_read;
+  std::uint32_t high = block_count;
+  while (low < high) {
+    const std::uint32_t middle = low + (high - low) / 2;
+    if (skipEntry(middle, 0) < target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == block_count) {
+    return std::nullopt;
+  }
+  return BlockBound{skipEntry(low, 0), skipEntry(low, 2)};
+}
+
+bool PostingCursor::next() {
+  if (at_end) {
+    return false;
+  }
+  if (index + 1 < block_docs_count) {
+    ++index;
+    return true;
+  }
+  if (blocks_read == block_count) {
+    at_end = true;
+    return false;
+  }
+  decodeNextBlock();
+  return true;
+}
+
+bool PostingCursor::advance(std::uint32_t target) {
+  if (at_end) {
+    return false;
+  }
+  if (block_docs_count == 0 || docs[block_docs_count - 1] < target) {
+    if (!skipBlocks(target)) {
+      at_end = true;
+      return false;
+    }
+  }
+  while (docs[index] < target) {
+    ++index;
+  }
+  return true;
+}
+
+// Leaves the cursor at the start of the first unread block that ends at or
+// after `target`, or returns false if there is none.
+bool PostingCursor::skipBlocks(std::uint32_t target) {
+  if (skip_table != nullptr && block_count > 1) {
+    std::uint32_t low = blocks_read;
+    std::uint32_t high = block_count;
+    while (low < high) {
+      const std::uint32_t middle = low + (high - low) / 2;
+      if (skipEntry(middle, 0) < target) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    if (low == block_count) {
+      return false;
+    }
+    blocks_read = low;
+    decodeNextBlock();
+    return true;
+  }
+
+  while (blocks_read < block_count) {
+    if (version == EntriesVersion::Compressed) {
+      std::uint32_t block_last_doc = 0;
+      std::uint32_t payload_size = 0;
+      const char *block = decodeVarint(next_block, block_last_doc);
+      block = decodeVarint(block, payload_size);
+      if (block_last_doc < target) {
+        next_block = block + payload_size;
+        last_doc = block_last_doc;
+        ++blocks_read;
+        continue;
+      }
+    }
+    decodeNextBlock();
+    if (docs[block_docs_count - 1] >= target) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PostingCursor::decodeNextBlock() {
+  block_docs_count =
+      std::min(doc_count - blocks_read * posting_block_size,
+               posting_block_size);
+  if (version == EntriesVersion::Raw) {
+    decodeRawBlock();
+  } else if (version == EntriesVersion::Compressed) {
+    decodeCompressedBlock();
+  } else {
+    const bool has_skip_table = block_count > 1;
+    const char *block =
+        has_skip_table ? blocks_data + skipEntry(blocks_read, 1) : blocks_data;
+    const std::uint32_t base =
+        blocks_read > 0 ? skipEntry(blocks_read - 1, 0) : 0;
+    decodePayload(block, base);
+  }
+  ++blocks_read;
+  index = 0;
+}
+
+void PostingCursor::decodeRawBlock() {
+  positions_data = next_block;
+  positions_index = 0;
+  BinaryReader reader(next_block);
+  for (std::uint32_t i = 0; i < block_docs_count; ++i) {
+    reader.readBinary(&docs[i], sizeof(docs[i]));
+    reader.readBinary(&freqs[i], sizeof(freqs[i]));
+    reader.move(freqs[i] * sizeof(std::uint32_t));
+  }
+  next_block = reader.current();
+}
+
+void PostingCursor::decodeCompressedBlock() {
+  std::uint32_t block_last_doc = 0;
+  std::uint32_t payload_size = 0;
+  const char *block = decodeVarint(next_block, block_last_doc);
+  block = decodeVarint(block, payload_size);
+  next_block = block + payload_size;
+  decodePayload(block, last_doc);
+  last_doc = block_last_doc;
+}
+
+// Decodes the doc ids and frequencies of a block whose doc id gaps start
+// from `base`, leaving the positions to positions(). The block offset and
+// bit width come from the file, whose checksums may not have been checked,
+// so they are checked before they size any copy.
+void PostingCursor::decodePayload(const char *block, std::uint32_t base) {
+  if (block >= entries_end) {
+    throw IndexFormatException("Posting block exceeds the entries section");
+  }
+  if (block_docs_count == posting_block_size) {
+    const auto bit_width = static_cast<std::uint8_t>(*block++);
+    if (bit_width > 32) {
+      throw IndexFormatException("Bad posting block bit width " +
+                                 std::to_string(bit_width));
+    }
+    if (static_cast<size_t>(entries_end - block) <
+        4 * bit_width * sizeof(std::uint32_t)) {
+      throw IndexFormatException("Posting block exceeds the entries section");
+    }
+    std::array<std::uint32_t, posting_block_size> packed{};
+    std::memcpy(packed.data(), block, 4 * bit_width * sizeof(std::uint32_t));
+    block += 4 * bit_width * sizeof(std::uint32_t);
+    unpackBlock(packed.data(), bit_width, docs.data());
+  } else {
+    for (std::uint32_t i = 0; i < block_docs_count; ++i) {
+      block = decodeVarint(block, docs[i]);
+    }
+  }
+  prefixSum(docs.data(), block_docs_count, base);
+
+  for (std::uint32_t i = 0; i < block_docs_count; ++i) {
+    block = decodeVarint(block, freqs[i]);
+  }
+  positions_data = block;
+  positions_index = 0;
+}
+
+void PostingCursor::positions(std::vector<size_t> &out) {
+  if (version == EntriesVersion::Raw) {
+    for (; positions_index < index; ++positions_index) {
+      positions_data += 2 * sizeof(std::uint32_t) +
+                        freqs[positions_index] * sizeof(std::uint32_t);
+    }
+    BinaryReader reader(positions_data);
+    reader.move(2 * sizeof(std::uint32_t));
+    out.resize(freqs[index]);
+    for (auto &position : out) {
       std::uint32_t pos = 0;
       reader.readBinary(&pos, sizeof(pos));
-      positions.push_back(pos);
+      position = pos;
+    }
+    return;
+  }
+
+  for (; positions_index < index; ++positions_index) {
+    for (std::uint32_t i = 0; i < freqs[positions_index]; ++i) {
+      while ((static_cast<std::uint8_t>(*positions_data++) & 0x80) != 0) {
+      }
+    }
+  }
+  const char *data = positions_data;
+  out.resize(freqs[index]);
+  size_t position = 0;
+  for (auto &pos : out) {
+    std::uint32_t gap = 0;
+    data = decodeVarint(data, gap);
+    position += gap;
+    pos = position;
+  }
+}
+
+// DecodedPostings
+
+DecodedPostings::DecodedPostings(std::vector<Posting> p)
+    : postings(std::move(p)) {
+  for (size_t i = 0; i < postings.size(); ++i) {
+    if (i % posting_block_size == 0) {
+      blocks.push_back({0, 0});
+    }
+    blocks.back().last_document = postings[i].document_id;
+    blocks.back().max_frequency =
+        std::max(blocks.back().max_frequency, postings[i].term_frequency);
+    max_frequency = std::max(max_frequency, postings[i].term_frequency);
+  }
+}
+
+size_t DecodedPostings::bytes() const {
+  size_t total = sizeof(DecodedPostings) +
+                 postings.capacity() * sizeof(Posting) +
+                 blocks.capacity() * sizeof(BlockBound);
+  for (const auto &posting : postings) {
+    total += posting.positions.capacity() * sizeof(size_t);
+  }
+  return total;
+}
+
+size_t DecodedPostings::minimumBytes(size_t count) {
+  return sizeof(DecodedPostings) + count * (sizeof(Posting) + sizeof(size_t)) +
+         (count + posting_block_size - 1) / posting_block_size *
+             sizeof(BlockBound);
+}
+
+// PostingIterator
+
+PostingIterator::PostingIterator(std::vector<Posting> p)
+    : decoded(std::make_shared<const DecodedPostings>(std::move(p))) {}
+
+std::optional<BlockBound> PostingIterator::blockBound(size_t target) const {
+  if (cursor) {
+    if (target > std::numeric_limits<std::uint32_t>::max()) {
+      return std::nullopt;
     }
-    term_infos[doc_offset] = positions;
+    return cursor->blockBound(static_cast<std::uint32_t>(target));
+  }
+  if (!decoded) {
+    return std::nullopt;
+  }
+  // The current block may still hold the target.
+  const auto &blocks = decoded->blocks;
+  const auto block = std::partition_point(
+      blocks.begin() +
+          static_cast<std::ptrdiff_t>(
+              std::min(current / posting_block_size, blocks.size())),
+      blocks.end(),
+      [target](const BlockBound &bound) {
+        return bound.last_document < target;
+      });
+  if (block == blocks.end()) {
+    return std::nullopt;
+  }
+  return *block;
+}
+
+bool PostingIterator::next() {
+  if (cursor) {
+    return cursor->next();
+  }
+  if (!decoded) {
+    return false;
+  }
+  if (started && current < decoded->postings.size()) {
+    ++current;
+  }
+  started = true;
+  return current < decoded->postings.size();
+}
+
+bool PostingIterator::advance(size_t target) {
+  if (cursor) {
+    return target <= std::numeric_limits<std::uint32_t>::max() &&
+           cursor->advance(static_cast<std::uint32_t>(target));
+  }
+  if (!decoded) {
+    return false;
+  }
+  started = true;
+  current = gallop(decoded->postings, current, target, posting_document);
+  return current < decoded->postings.size();
+}
+
+void PostingIterator::positions(std::vector<size_t> &out) {
+  if (cursor) {
+    cursor->positions(out);
+    return;
+  }
+  out = decoded->postings[current].positions;
+}
+
+// EntryAccessor
+
+EntryAccessor::EntryAccessor(const char *d, std::uint64_t size,
+                             EntriesVersion v)
+    : entry_data(d), entry_size(size), version(v) {
+  if (version != EntriesVersion::Raw && version != EntriesVersion::Compressed &&
+      version != EntriesVersion::Skipped &&
+      version != EntriesVersion::BlockMax) {
+    throw IndexFormatException("Unsupported entries version " +
+                               std::to_string(static_cast<int>(version)));
+  }
+}
+
+std::map<size_t, std::vector<size_t>>
+EntryAccessor::getTermInfos(std::uint32_t entry_offset) const {
+  std::map<size_t, std::vector<size_t>> term_infos;
+  auto postings = cursor(entry_offset);
+  while (postings.next()) {
+    postings.positions(term_infos[postings.document()]);
   }
   return term_infos;
 }
 
+std::vector<Posting>
+EntryAccessor::getPostings(std::uint32_t entry_offset) const {
+  auto postings_cursor = cursor(entry_offset);
+  std::vector<Posting> postings(postings_cursor.size());
+  for (auto &posting : postings) {
+    postings_cursor.next();
+    posting.document_id = postings_cursor.document();
+    posting.term_frequency = postings_cursor.frequency();
+    postings_cursor.positions(posting.positions);
+  }
+  return postings;
+}
+
 // BinaryReader
 
 void BinaryReader::readBinary(void *dest, size_t size) {
@@ -299,18 +1814,122 @@ void BinaryReader::readBinary(void *dest, size_t size) {
 
 // BinaryIndexAccessor
 
+BinaryIndexAccessor::BinaryIndexAccessor(const char *d, const Header &h,
+                                         std::shared_ptr<TermCache> cache)
+    : binary_index_data(d), header(h),
+      dictionary(
+          d + h.sectionOffset("dictionary"),
+          static_cast<DictionaryVersion>(h.sectionVersion("dictionary"))),
+      entries(d + h.sectionOffset("entries"), h.section("entries").size,
+              static_cast<EntriesVersion>(h.sectionVersion("entries"))),
+      documents(d + h.sectionOffset("docs"), h.sectionVersion("docs")) {
+  if (h.hasSection("stats")) {
+    stats.emplace(d + h.sectionOffset("stats"), h.sectionVersion("stats"));
+  }
+  term_cache = std::move(cache);
+}
+
+// The first lookup of a term caches its entry offset. Its postings are
+// decoded once a second query iterates them, so the terms of one-off
+// queries cost no decoding and no cache space for their postings.
+CachedTerm BinaryIndexAccessor::lookup(std::string_view term,
+                                       bool iterating) const {
+  if (!term_cache) {
+    CachedTerm resolved;
+    resolved.entry_offset = dictionary.retrieve(term);
+    return resolved;
+  }
+  auto cached = term_cache->find(term);
+  if (!cached) {
+    CachedTerm resolved;
+    resolved.entry_offset = dictionary.retrieve(term);
+    resolved.iterated = iterating;
+    term_cache->insert(term, resolved);
+    return resolved;
+  }
+  if (iterating && cached->entry_offset && !cached->postings &&
+      !cached->too_large) {
+    if (cached->iterated) {
+      decodeCached(term, *cached);
+    }
+    cached->iterated = true;
+    term_cache->insert(term, *cached);
+  }
+  return *cached;
+}
+
+// A list that can't fit in the cache would otherwise be decoded again by
+// every query, so it is only decoded if even its smallest possible size
+// fits, and kept out for good if its actual size does not.
+void BinaryIndexAccessor::decodeCached(std::string_view term,
+                                       CachedTerm &cached) const {
+  const size_t df = entries.cursor(*cached.entry_offset).size();
+  if (term_cache->fits(term, DecodedPostings::minimumBytes(df))) {
+    cached.postings = std::make_shared<const DecodedPostings>(
+        entries.getPostings(*cached.entry_offset));
+    if (term_cache->fits(term, cached.postings->bytes())) {
+      return;
+    }
+    cached.postings = nullptr;
+  }
+  cached.too_large = true;
+}
+
+size_t BinaryIndexAccessor::documentFrequency(
+    std::uint32_t entry_offset) const {
+  if (stats) {
+    const auto term_stats = stats->term(entry_offset);
+    if (term_stats) {
+      return term_stats->df;
+    }
+  }
+  return entries.cursor(entry_offset).size();
+}
+
+void BinaryIndexAccessor::warmTermCache(size_t count) const {
+  if (!term_cache || count == 0) {
+    return;
+  }
+  // (df, term, entry offset) of the most frequent terms so far, the least
+  // frequent on top.
+  using Frequent = std::tuple<size_t, std::string, std::uint32_t>;
+  std::vector<Frequent> heap;
+  const auto more_frequent = [](const Frequent &lhs, const Frequent &rhs) {
+    return std::get<0>(lhs) > std::get<0>(rhs);
+  };
+  dictionary.forEachTerm([&](std::string_view term,
+                             std::uint32_t entry_offset) {
+    const size_t df = documentFrequency(entry_offset);
+    if (heap.size() == count) {
+      if (df <= std::get<0>(heap.front())) {
+        return;
+      }
+      std::pop_heap(heap.begin(), heap.end(), more_frequent);
+      heap.pop_back();
+    }
+    heap.emplace_back(df, term, entry_offset);
+    std::push_heap(heap.begin(), heap.end(), more_frequent);
+  });
+  std::sort_heap(heap.begin(), heap.end(), more_frequent);
+  for (auto frequent = heap.rbegin(); frequent != heap.rend(); ++frequent) {
+    CachedTerm cached;
+    cached.entry_offset = std::get<2>(*frequent);
+    cached.iterated = true;
+    decodeCached(std::get<1>(*frequent), cached);
+    term_cache->insert(std::get<1>(*frequent), std::move(cached));
+  }
+}
+
 std::string BinaryIndexAccessor::loadDocument(size_t identifier) const {
-  BinaryReader reader(binary_index_data);
-  reader.move(header.sectionOffset("docs"));
-  DocumentAccessor doc(reader.current());
-  return doc.loadDocument(identifier);
+  return documents.loadDocument(identifier);
+}
+
+size_t BinaryIndexAccessor::externalId(size_t identifier) const {
+  return documents.externalId(identifier);
 }
 
 bool BinaryIndexAccessor::totalDocs(double &file_count) const {
-  BinaryReader reader(binary_index_data);
-  reader.move(header.sectionOffset("docs"));
-  DocumentAccessor doc(reader.current());
-  file_count = static_cast<double>(doc.totalDocs());
+  file_count = static_cast<double>(documents.totalDocs());
   if (file_count == 0.0) {
     return false;
   }
@@ -319,15 +1938,12 @@ bool BinaryIndexAccessor::totalDocs(double &file_count) const {
 
 std::vector<size_t>
 BinaryIndexAccessor::getDocByTerm(const std::string &term) const {
-  BinaryReader reader(binary_index_data);
-  reader.move(header.sectionOffset("dictionary"));
-  DictionaryAccessor dictionary(reader.current());
-  const auto entry_offset = dictionary.retrieve(term);
-  reader.moveBack();
-  reader.move(header.sectionOffset("entries"));
-  EntryAccessor entry(reader.current());
-  const auto term_infos = entry.getTermInfos(entry_offset);
   std::vector<size_t> docs;
+  const auto entry_offset = lookup(term, false).entry_offset;
+  if (!entry_offset) {
+    return docs;
+  }
+  const auto term_infos = entries.getTermInfos(*entry_offset);
   for (const auto &[offset, positions] : term_infos) {
     docs.push_back(offset);
   }
@@ -336,30 +1952,133 @@ BinaryIndexAccessor::getDocByTerm(const std::string &term) const {
 
 size_t BinaryIndexAccessor::getCountTermsInDoc(const std::string &term,
                                                size_t identifier) const {
-  BinaryReader reader(binary_index_data);
-  reader.move(header.sectionOffset("dictionary"));
-  DictionaryAccessor dictionary(reader.current());
-  const auto entry_offset = dictionary.retrieve(term);
-  reader.moveBack();
-  reader.move(header.sectionOffset("entries"));
-  EntryAccessor entry(reader.current());
-  auto term_infos = entry.getTermInfos(entry_offset);
+  const auto entry_offset = lookup(term, false).entry_offset;
+  if (!entry_offset) {
+    return 0;
+  }
+  auto term_infos = entries.getTermInfos(*entry_offset);
   return term_infos[identifier].size();
 }
 
-// mmap_bin_file
+PostingIterator IndexAccessor::iteratePostings(std::string_view term) const {
+  return PostingIterator(getPostings(term));
+}
+
+TermStats IndexAccessor::termStats(std::string_view term) const {
+  double N = 0.0;
+  const size_t df = iteratePostings(term).size();
+  if (!totalDocs(N) || df == 0) {
+    return {0, 0.0};
+  }
+  return {df, log(N / static_cast<double>(df))};
+}
 
-const char *mmap_bin_file(const std::filesystem::path &file_path) {
-  int file = open((file_path).c_str(), O_CLOEXEC);
-  if (file == -1) {
-        perror("Can`t open binfile");
-        exit(255);
+double IndexAccessor::corpusDocs() const {
+  double N = 0.0;
+  totalDocs(N);
+  return N;
+}
+
+TermStats BinaryIndexAccessor::termStats(std::string_view term) const {
+  const auto entry_offset = lookup(term, false).entry_offset;
+  if (!entry_offset) {
+    return {0, 0.0};
+  }
+  if (stats) {
+    const auto term_stats = stats->term(*entry_offset);
+    if (term_stats) {
+      return *term_stats;
+    }
+  }
+  const size_t df = documentFrequency(*entry_offset);
+  return {df, log(static_cast<double>(documents.totalDocs()) /
+                  static_cast<double>(df))};
+}
+
+DocumentLengths BinaryIndexAccessor::documentLengths(Field field) const {
+  return stats ? stats->lengths(field) : DocumentLengths();
+}
+
+void BinaryIndexAccessor::forEachTerm(
+    const std::function<void(std::string_view, PostingIterator)> &visit)
+    const {
+  dictionary.forEachTerm([&](std::string_view term,
+                             std::uint32_t entry_offset) {
+    visit(term, PostingIterator(entries.cursor(entry_offset)));
+  });
+}
+
+PostingIterator
+BinaryIndexAccessor::iteratePostings(std::string_view term) const {
+  auto cached = lookup(term, true);
+  if (!cached.entry_offset) {
+    return PostingIterator();
+  }
+  if (cached.postings) {
+    return PostingIterator(std::move(cached.postings));
+  }
+  return PostingIterator(entries.cursor(*cached.entry_offset));
+}
+
+std::vector<Posting>
+BinaryIndexAccessor::getPostings(std::string_view term) const {
+  const auto cached = lookup(term, false);
+  if (!cached.entry_offset) {
+    return {};
+  }
+  if (cached.postings) {
+    return cached.postings->postings;
+  }
+  return entries.getPostings(*cached.entry_offset);
+}
+
+// ShardAccessor
+
+static TermStats
+sum_term_stats(const std::vector<BinaryIndexAccessor> &shards,
+               std::string_view term, double docs) {
+  size_t df = 0;
+  for (const auto &shard : shards) {
+    df += shard.termStats(term).df;
+  }
+  if (df == 0) {
+    return {0, 0.0};
+  }
+  return {df, log(docs / static_cast<double>(df))};
+}
+
+TermStats ShardAccessor::termStats(std::string_view term) const {
+  const auto found = corpus.terms.find(std::string(term));
+  if (found != corpus.terms.end()) {
+    return found->second;
+  }
+  return sum_term_stats(shards, term, corpus.docs);
+}
+
+// Averages are taken from the summed integer totals, so they match the ones
+// of an unsharded index exactly.
+CorpusStats corpusStats(const std::vector<BinaryIndexAccessor> &shards,
+                        const std::vector<std::string> &terms) {
+  CorpusStats corpus;
+  std::array<std::uint64_t, field_count> total_lengths{};
+  for (const auto &shard : shards) {
+    double shard_docs = 0.0;
+    shard.totalDocs(shard_docs);
+    corpus.docs += shard_docs;
+    for (size_t f = 0; f < field_count; ++f) {
+      total_lengths[f] += shard.totalLength(static_cast<Field>(f));
+    }
+  }
+  for (size_t f = 0; f < field_count; ++f) {
+    if (corpus.docs != 0.0 && total_lengths[f] != 0) {
+      corpus.average_lengths[f] =
+          static_cast<double>(total_lengths[f]) / corpus.docs;
+    }
+  }
+  for (const auto &term : terms) {
+    corpus.terms.emplace(term, sum_term_stats(shards, term, corpus.docs));
   }
-  size_t size = std::filesystem::file_size(file_path);
-  const char *src = nullptr;
-  src =
-      static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0));
-  return src;
+  return corpus;
 }
 
 } // namespace fts
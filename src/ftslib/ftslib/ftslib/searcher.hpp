@@ -1,13 +1,84 @@
 #pragma once
 
+#include <array>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <ftslib/format.hpp>
 #include <ftslib/parser.hpp>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 namespace fts {
 
+struct Posting {
+  size_t document_id;
+  size_t term_frequency;
+  std::vector<size_t> positions;
+};
+
+class PostingIterator;
+struct CachedTerm;
+class TermCache;
+
+// Document frequency and idf, log(N / df), of a term; df is 0 for terms not
+// in the index.
+struct TermStats {
+  size_t df;
+  double idf;
+};
+
+// Lengths in words of one field of every document, by ordinal. Without
+// stored lengths every document has the average length.
+class DocumentLengths {
+private:
+  const char *lengths_data = nullptr;
+  double average_length = 1.0;
+
+public:
+  explicit DocumentLengths() = default;
+  explicit DocumentLengths(const char *d, double average)
+      : lengths_data(d), average_length(average) {}
+  // The same lengths against another average.
+  explicit DocumentLengths(const DocumentLengths &lengths, double average)
+      : lengths_data(lengths.lengths_data), average_length(average) {}
+  double length(size_t identifier) const {
+    if (lengths_data == nullptr) {
+      return average_length;
+    }
+    std::uint32_t length = 0;
+    std::memcpy(&length, lengths_data + identifier * sizeof(length),
+                sizeof(length));
+    return length;
+  }
+  double average() const { return average_length; }
+};
+
+// Bitmap of deleted document ordinals, bit i of byte i / 8 for ordinal i.
+// Ordinals past its end are live.
+class DeletedDocuments {
+private:
+  const unsigned char *bits = nullptr;
+  size_t bytes = 0;
+
+public:
+  explicit DeletedDocuments() = default;
+  explicit DeletedDocuments(const char *d, size_t size)
+      : bits(reinterpret_cast<const unsigned char *>(d)), bytes(size) {}
+  bool contains(size_t identifier) const {
+    return identifier / 8 < bytes &&
+           ((bits[identifier / 8] >> (identifier % 8)) & 1U) != 0;
+  }
+  bool empty() const { return bytes == 0; }
+};
+
+// Accessors never change after construction: every member is const and
+// keeps no caches of its own, so one accessor can serve concurrent
+// searches. A binary accessor may share a TermCache, which locks itself.
 class IndexAccessor {
 public:
   virtual std::string loadDocument(size_t identifier) const = 0;
@@ -15,79 +86,377 @@ public:
   virtual std::vector<size_t> getDocByTerm(const std::string &term) const = 0;
   virtual size_t getCountTermsInDoc(const std::string &term,
                                     size_t identifier) const = 0;
+  virtual std::vector<Posting>
+  getPostings(std::string_view term) const = 0;
+  virtual PostingIterator iteratePostings(std::string_view term) const;
+  virtual size_t externalId(size_t identifier) const = 0;
+  virtual TermStats termStats(std::string_view term) const;
+  // Number of documents term statistics are taken over, which is the whole
+  // index even when the accessor reads only a shard of it.
+  virtual double corpusDocs() const;
+  // For length normalization; read once per query, so scoring loops look
+  // lengths up without a virtual call.
+  virtual DocumentLengths documentLengths(Field field) const = 0;
+  // Documents still stored but never returned; read once per query too.
+  virtual DeletedDocuments deletedDocuments() const {
+    return DeletedDocuments();
+  }
 };
 
+// The document count and lengths are read once, from the stats file.
 class TextIndexAccessor : public IndexAccessor {
 private:
   std::filesystem::path path_of_docs;
+  std::vector<size_t> external_ids;
+  size_t docs_count = 0;
+  std::array<std::vector<std::uint32_t>, field_count> lengths;
+  std::array<double, field_count> average_lengths{1.0, 1.0};
 
 public:
-  explicit TextIndexAccessor(std::filesystem::path new_path)
-      : path_of_docs(std::move(new_path)) {}
+  explicit TextIndexAccessor(std::filesystem::path new_path);
   std::string loadDocument(size_t identifier) const override;
   bool totalDocs(double &file_count) const override;
   std::vector<size_t> getDocByTerm(const std::string &term) const override;
   size_t getCountTermsInDoc(const std::string &term,
                             size_t identifier) const override;
+  std::vector<Posting> getPostings(std::string_view term) const override;
+  size_t externalId(size_t identifier) const override;
+  TermStats termStats(std::string_view term) const override;
+  DocumentLengths documentLengths(Field field) const override;
+};
+
+struct SectionInfo {
+  std::uint64_t offset;
+  std::uint64_t size;
+  std::uint32_t version;
+  std::uint32_t checksum;
 };
 
+// File header and section table of a binary index. The constructor checks
+// the magic, the container version and the table checksum, and that every
+// section lies inside the `size` bytes at `data`.
 class Header {
 private:
-  std::uint8_t section_count;
-  std::unordered_map<std::string, std::uint32_t> sections;
+  std::unordered_map<std::string, SectionInfo> sections;
+  std::uint32_t table_checksum = 0;
 
 public:
-  explicit Header(const char *data);
-  const std::uint32_t &sectionOffset(const std::string &name) const {
-    const auto offset = sections.find(name);
-    return offset->second;
+  explicit Header(const char *data, std::size_t size);
+  // The table checksum covers the checksum, offset and size of every
+  // section, so it changes with the contents of the file.
+  std::uint32_t generation() const { return table_checksum; }
+  std::uint64_t sectionOffset(const std::string &name) const {
+    return section(name).offset;
+  }
+  std::uint32_t sectionVersion(const std::string &name) const {
+    return section(name).version;
+  }
+  const SectionInfo &section(const std::string &name) const;
+  bool hasSection(const std::string &name) const {
+    return sections.count(name) != 0;
+  }
+  const std::unordered_map<std::string, SectionInfo> &getSections() const {
+    return sections;
   }
 };
 
 class DocumentAccessor {
 private:
   const char *document_data;
+  std::uint32_t docs_count = 0;
 
 public:
-  explicit DocumentAccessor(const char *d) : document_data(d) {}
+  explicit DocumentAccessor(const char *d, std::uint8_t version = docs_version);
   std::string loadDocument(size_t identifier) const;
-  size_t totalDocs() const;
+  size_t externalId(size_t identifier) const;
+  size_t totalDocs() const { return docs_count; }
+};
+
+// Corpus statistics section. Term records are found by the offset of the
+// term's entry, which the dictionary already returns.
+class StatsAccessor {
+private:
+  const char *lengths_data = nullptr;
+  const char *terms_data = nullptr;
+  std::uint32_t docs_count = 0;
+  std::uint32_t terms_count = 0;
+  std::uint32_t fields_count = 1;
+  std::array<std::uint64_t, field_count> total_lengths{};
+
+public:
+  explicit StatsAccessor(const char *d, std::uint32_t version = stats_version);
+  size_t totalDocs() const { return docs_count; }
+  DocumentLengths lengths(Field field) const;
+  std::uint64_t totalLength(Field field) const {
+    return total_lengths[static_cast<size_t>(field)];
+  }
+  std::optional<TermStats> term(std::uint32_t entry_offset) const;
 };
 
 class DictionaryAccessor {
 private:
   const char *dictionary_data;
+  DictionaryVersion version;
+  std::uint32_t terms_count = 0;
+  std::vector<std::string_view> block_first_terms;
+  std::vector<std::uint32_t> block_offsets;
+
+  std::optional<std::uint32_t> retrieveTrie(std::string_view word) const;
+  void visitTrie(std::uint32_t node_offset, std::string &term,
+                 const std::function<void(std::string_view, std::uint32_t)>
+                     &visit) const;
+  std::optional<std::uint32_t>
+  retrieveFrontCoded(std::string_view word) const;
 
 public:
-  explicit DictionaryAccessor(const char *d) : dictionary_data(d) {}
-  std::uint32_t retrieve(const std::string &word);
+  explicit DictionaryAccessor(const char *d,
+                              DictionaryVersion v = DictionaryVersion::Trie);
+  std::optional<std::uint32_t> retrieve(std::string_view word) const;
+  // Calls visit(term, entry offset) for every term in term order.
+  void forEachTerm(const std::function<void(std::string_view, std::uint32_t)>
+                       &visit) const;
+};
+
+// Bound of the term frequencies in a block of postings that ends at
+// last_document.
+struct BlockBound {
+  size_t last_document;
+  size_t max_frequency;
+};
+
+// Streams the posting list of one term straight from the entries section,
+// decoding one block of up to posting_block_size postings at a time.
+// Positions are only decoded for the postings they are asked for.
+class PostingCursor {
+private:
+  EntriesVersion version;
+  // Next unread block of Raw and Compressed terms.
+  const char *next_block;
+  // End of the entries section; blocks must lie before it.
+  const char *entries_end;
+  // Skip table and first block of Skipped and BlockMax terms.
+  const char *skip_table = nullptr;
+  const char *blocks_data = nullptr;
+  std::uint32_t skip_fields = 2;
+  std::uint32_t max_frequency = 0;
+  std::uint32_t doc_count = 0;
+  std::uint32_t block_count = 0;
+  // Blocks decoded or skipped so far.
+  std::uint32_t blocks_read = 0;
+  std::uint32_t block_docs_count = 0;
+  std::uint32_t index = 0;
+  std::uint32_t last_doc = 0;
+  bool at_end = false;
+  const char *positions_data = nullptr;
+  std::uint32_t positions_index = 0;
+  std::array<std::uint32_t, posting_block_size> docs{};
+  std::array<std::uint32_t, posting_block_size> freqs{};
+
+  std::uint32_t skipEntry(std::uint32_t block, size_t field) const;
+  void decodeNextBlock();
+  void decodeRawBlock();
+  void decodeCompressedBlock();
+  void decodePayload(const char *block, std::uint32_t base);
+  bool skipBlocks(std::uint32_t target);
+
+public:
+  explicit PostingCursor(const char *term_data, const char *section_end,
+                         EntriesVersion v);
+  std::uint32_t size() const { return doc_count; }
+  // True for BlockMax terms, the only ones with stored frequency bounds.
+  bool hasBounds() const { return version == EntriesVersion::BlockMax; }
+  std::uint32_t maxFrequency() const { return max_frequency; }
+  // Bound of the first block at or after the current one that ends at or
+  // after `target`, read from the skip table without decoding the block,
+  // or nothing if the postings end before the target. A term with a single
+  // block has a bound that never ends.
+  std::optional<BlockBound> blockBound(std::uint32_t target) const;
+  // Moves to the next posting; the cursor starts before the first one.
+  bool next();
+  // Moves to the first posting whose doc id is not below `target`, never
+  // backwards. Blocks that end before the target are not decoded.
+  bool advance(std::uint32_t target);
+  std::uint32_t document() const { return docs[index]; }
+  std::uint32_t frequency() const { return freqs[index]; }
+  void positions(std::vector<size_t> &out);
+};
+
+// Every posting of one term, decoded at once, with the bound of each
+// posting_block_size of them as the skip table of a BlockMax term holds.
+struct DecodedPostings {
+  std::vector<Posting> postings;
+  std::vector<BlockBound> blocks;
+  size_t max_frequency = 0;
+
+  explicit DecodedPostings(std::vector<Posting> p);
+  // Estimate of the memory held, for caches.
+  size_t bytes() const;
+  // Least bytes() of `count` postings, each with one position.
+  static size_t minimumBytes(size_t count);
+};
+
+// Postings of one term in document order, starting before the first one.
+// Binary indexes stream them from the entries section through a cursor;
+// other indexes and term caches hand over decoded postings, which one
+// iterator shares with any others.
+class PostingIterator {
+private:
+  std::optional<PostingCursor> cursor;
+  std::shared_ptr<const DecodedPostings> decoded;
+  size_t current = 0;
+  bool started = false;
+
+public:
+  explicit PostingIterator() = default;
+  explicit PostingIterator(const PostingCursor &c) : cursor(c) {}
+  explicit PostingIterator(std::vector<Posting> p);
+  explicit PostingIterator(std::shared_ptr<const DecodedPostings> d)
+      : decoded(std::move(d)) {}
+  size_t size() const {
+    return cursor ? cursor->size() : decoded ? decoded->postings.size() : 0;
+  }
+  bool hasBounds() const { return !cursor || cursor->hasBounds(); }
+  size_t maxFrequency() const {
+    return cursor ? cursor->maxFrequency()
+                  : decoded ? decoded->max_frequency : 0;
+  }
+  std::optional<BlockBound> blockBound(size_t target) const;
+  bool next();
+  bool advance(size_t target);
+  size_t document() const {
+    return cursor ? cursor->document()
+                  : decoded->postings[current].document_id;
+  }
+  size_t frequency() const {
+    return cursor ? cursor->frequency()
+                  : decoded->postings[current].term_frequency;
+  }
+  void positions(std::vector<size_t> &out);
 };
 
 class EntryAccessor {
 private:
   const char *entry_data;
+  std::uint64_t entry_size;
+  EntriesVersion version;
 
 public:
-  explicit EntryAccessor(const char *d) : entry_data(d) {}
+  explicit EntryAccessor(const char *d, std::uint64_t size, EntriesVersion v);
+  PostingCursor cursor(std::uint32_t entry_offset) const {
+    return PostingCursor(entry_data + entry_offset, entry_data + entry_size,
+                         version);
+  }
   std::map<size_t, std::vector<size_t>>
-  getTermInfos(std::uint32_t entry_offset);
+  getTermInfos(std::uint32_t entry_offset) const;
+  std::vector<Posting> getPostings(std::uint32_t entry_offset) const;
 };
 
+// With a term cache, terms are looked up in the dictionary once and the
+// postings of the terms iterated by more than one query are decoded once;
+// the cache must serve this index file only.
 class BinaryIndexAccessor : public IndexAccessor {
 private:
   const char *binary_index_data;
   Header header;
+  DictionaryAccessor dictionary;
+  EntryAccessor entries;
+  DocumentAccessor documents;
+  std::optional<StatsAccessor> stats;
+  std::shared_ptr<TermCache> term_cache;
+
+  CachedTerm lookup(std::string_view term, bool iterating) const;
+  // Decodes the postings of a term into `cached`, or marks it too_large.
+  void decodeCached(std::string_view term, CachedTerm &cached) const;
+  size_t documentFrequency(std::uint32_t entry_offset) const;
 
 public:
-  explicit BinaryIndexAccessor(const char *d, Header &h)
-      : binary_index_data(d), header(h) {}
+  explicit BinaryIndexAccessor(const char *d, const Header &h,
+                               std::shared_ptr<TermCache> cache = nullptr);
   std::string loadDocument(size_t identifier) const override;
   bool totalDocs(double &file_count) const override;
   std::vector<size_t> getDocByTerm(const std::string &term) const override;
   size_t getCountTermsInDoc(const std::string &term,
                             size_t identifier) const override;
+  std::vector<Posting> getPostings(std::string_view term) const override;
+  PostingIterator iteratePostings(std::string_view term) const override;
+  size_t externalId(size_t identifier) const override;
+  TermStats termStats(std::string_view term) const override;
+  DocumentLengths documentLengths(Field field) const override;
+  // Sum of the lengths of the field over every document; 0 without stats.
+  std::uint64_t totalLength(Field field) const {
+    return stats ? stats->totalLength(field) : 0;
+  }
+  // Calls visit(term, postings) for every term in term order.
+  void forEachTerm(
+      const std::function<void(std::string_view, PostingIterator)> &visit)
+      const;
+  // Decodes the postings of the `count` terms with the most documents into
+  // the term cache, the most frequent ones last so they are evicted last.
+  void warmTermCache(size_t count) const;
+  const std::shared_ptr<TermCache> &termCache() const { return term_cache; }
+};
+
+// Corpus statistics of a whole sharded index: its document count, the
+// average length of every field and the statistics of the terms of one
+// query, summed over the shards.
+struct CorpusStats {
+  double docs = 0.0;
+  std::array<double, field_count> average_lengths{1.0, 1.0};
+  std::unordered_map<std::string, TermStats> terms;
 };
 
+// One shard or segment of an index that reads its own documents and
+// postings but scores them with the statistics of the whole index, so that
+// every part ranks as one unsplit index would. Terms missing from the
+// corpus statistics are counted over all `shards`.
+class ShardAccessor : public IndexAccessor {
+private:
+  const std::vector<BinaryIndexAccessor> &shards;
+  const BinaryIndexAccessor &shard;
+  const CorpusStats &corpus;
+  DeletedDocuments deleted;
+
+public:
+  explicit ShardAccessor(const std::vector<BinaryIndexAccessor> &all,
+                         size_t index, const CorpusStats &stats,
+                         DeletedDocuments d = DeletedDocuments())
+      : shards(all), shard(all[index]), corpus(stats), deleted(d) {}
+  std::string loadDocument(size_t identifier) const override {
+    return shard.loadDocument(identifier);
+  }
+  bool totalDocs(double &file_count) const override {
+    return shard.totalDocs(file_count);
+  }
+  std::vector<size_t> getDocByTerm(const std::string &term) const override {
+    return shard.getDocByTerm(term);
+  }
+  size_t getCountTermsInDoc(const std::string &term,
+                            size_t identifier) const override {
+    return shard.getCountTermsInDoc(term, identifier);
+  }
+  std::vector<Posting> getPostings(std::string_view term) const override {
+    return shard.getPostings(term);
+  }
+  PostingIterator iteratePostings(std::string_view term) const override {
+    return shard.iteratePostings(term);
+  }
+  size_t externalId(size_t identifier) const override {
+    return shard.externalId(identifier);
+  }
+  TermStats termStats(std::string_view term) const override;
+  double corpusDocs() const override { return corpus.docs; }
+  DocumentLengths documentLengths(Field field) const override {
+    return DocumentLengths(
+        shard.documentLengths(field),
+        corpus.average_lengths[static_cast<size_t>(field)]);
+  }
+  DeletedDocuments deletedDocuments() const override { return deleted; }
+};
+
+// Sums the statistics of `terms` over `shards`.
+CorpusStats corpusStats(const std::vector<BinaryIndexAccessor> &shards,
+                        const std::vector<std::string> &terms);
+
 class BinaryReader {
 private:
   const char *binary_data;
@@ -102,22 +471,56 @@ public:
   void moveBack() { current_data = binary_data; }
 };
 
+// Per-query score table indexed by dense document ordinal. Reading and
+// resetting it only visits the documents the query touched, so one
+// accumulator is reused across queries.
+class ScoreAccumulator {
+private:
+  std::vector<double> scores;
+  std::vector<bool> is_touched;
+  std::vector<size_t> touched;
+
+public:
+  void reset(size_t doc_count);
+  void add(size_t identifier, double score) {
+    if (!is_touched[identifier]) {
+      is_touched[identifier] = true;
+      touched.push_back(identifier);
+    }
+    scores[identifier] += score;
+  }
+  bool isTouched(size_t identifier) const { return is_touched[identifier]; }
+  const std::vector<size_t> &touchedDocuments() const { return touched; }
+  double score(size_t identifier) const { return scores[identifier]; }
+};
+
 struct Result {
   size_t document_id;
   double score;
   std::string name_of_doc;
 };
 
+// Number of rows shown by printResult and getStringSearchResult.
+constexpr size_t printed_results_count = 19;
+
 std::vector<Result> search(const Config &config,
                            const fts::IndexAccessor &index,
                            const std::string &query);
 
+// Returns results offset + 1 .. offset + k of the ranking above, loading
+// document titles only for the returned page.
+std::vector<Result> search(const Config &config,
+                           const fts::IndexAccessor &index,
+                           const std::string &query, size_t k,
+                           size_t offset = 0);
+
+// Orders results by descending score, then ascending document id.
+void sortResults(std::vector<Result> &results);
+
 void printResult(const std::vector<Result> &result);
 
 std::string getStringSearchResult(const std::vector<Result> &search_result);
 
-const char *mmap_bin_file(const std::filesystem::path &file_path);
-
 void parseTextEntry(
     const std::filesystem::path &path_of_doc,
     std::map<std::string, std::map<size_t, std::vector<size_t>>> &entry);
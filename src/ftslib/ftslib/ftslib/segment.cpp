@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <fstream>
+#include <ftslib/handle.hpp>
+#include <ftslib/segment.hpp>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace fts {
+
+namespace {
+
+std::vector<char> read_bitmap(const std::filesystem::path &directory,
+                              const SegmentInfo &segment) {
+  std::vector<char> bits((segment.docs + 7) / 8, 0);
+  if (!segment.deletions.empty()) {
+    std::ifstream file(directory / segment.deletions, std::ios::binary);
+    file.read(bits.data(), static_cast<std::streamsize>(bits.size()));
+    if (!file) {
+      throw IndexFormatException("Can`t read deletions " + segment.deletions);
+    }
+  }
+  return bits;
+}
+
+bool bit_set(const std::vector<char> &bits, size_t ordinal) {
+  return ((static_cast<unsigned char>(bits[ordinal / 8]) >> (ordinal % 8)) &
+          1U) != 0;
+}
+
+// Ordinal of the document with book id `id`; documents of a segment are
+// stored in book id order.
+std::optional<size_t> find_document(const BinaryIndexAccessor &segment,
+                                    size_t docs, size_t id) {
+  size_t low = 0;
+  size_t high = docs;
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    if (segment.externalId(middle) < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < docs && segment.externalId(low) == id) {
+    return low;
+  }
+  return std::nullopt;
+}
+
+BinaryIndexWriter segment_writer(size_t threads) {
+  return BinaryIndexWriter(DictionaryVersion::FrontCoded,
+                           EntriesVersion::BlockMax, threads);
+}
+
+} // namespace
+
+// Manifest
+
+std::vector<SegmentInfo> readManifest(const std::filesystem::path &directory,
+                                      size_t &next_generation) {
+  next_generation = 1;
+  std::ifstream file(directory / manifest_file);
+  if (!file) {
+    return {};
+  }
+  std::vector<SegmentInfo> segments;
+  std::string line;
+  if (!std::getline(file, line) ||
+      !(std::istringstream(line) >> next_generation)) {
+    throw IndexFormatException("Broken segment manifest");
+  }
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    SegmentInfo segment;
+    if (!(fields >> segment.name >> segment.docs >> segment.deleted >>
+          segment.deletions) ||
+        segment.deleted > segment.docs) {
+      throw IndexFormatException("Broken segment manifest");
+    }
+    if (segment.deletions == "-") {
+      segment.deletions.clear();
+    }
+    segments.push_back(std::move(segment));
+  }
+  return segments;
+}
+
+void writeManifest(const std::filesystem::path &directory,
+                   const std::vector<SegmentInfo> &segments,
+                   size_t next_generation) {
+  const auto temporary = directory / (std::string(manifest_file) + ".tmp");
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    file << next_generation << '\n';
+    for (const auto &segment : segments) {
+      file << segment.name << ' ' << segment.docs << ' ' << segment.deleted
+           << ' ' << (segment.deletions.empty() ? "-" : segment.deletions)
+           << '\n';
+    }
+    if (!file.flush()) {
+      throw std::runtime_error("Can`t write " + temporary.string());
+    }
+  }
+  std::filesystem::rename(temporary, directory / manifest_file);
+}
+
+// TieredMergePolicy
+
+std::vector<size_t>
+TieredMergePolicy::pick(const std::vector<SegmentInfo> &segments) const {
+  std::map<size_t, std::vector<size_t>> tiers;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    size_t tier = 0;
+    for (size_t bound = floor_docs; segments[i].liveDocs() > bound; ++tier) {
+      if (bound > std::numeric_limits<size_t>::max() / segments_per_tier) {
+        break;
+      }
+      bound *= segments_per_tier;
+    }
+    tiers[tier].push_back(i);
+  }
+  for (auto &[tier, members] : tiers) {
+    if (members.size() >= segments_per_tier) {
+      std::stable_sort(members.begin(), members.end(),
+                       [&segments](size_t lhs, size_t rhs) {
+                         return segments[lhs].liveDocs() <
+                                segments[rhs].liveDocs();
+                       });
+      members.resize(segments_per_tier);
+      std::sort(members.begin(), members.end());
+      return members;
+    }
+  }
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (segments[i].deleted != 0 &&
+        static_cast<double>(segments[i].deleted) >
+            max_deleted * static_cast<double>(segments[i].docs)) {
+      return {i};
+    }
+  }
+  return {};
+}
+
+// SegmentedIndex
+
+SegmentedIndex::SegmentedIndex(const std::filesystem::path &index_path,
+                               Config c, TieredMergePolicy p,
+                               size_t threads_count)
+    : directory(index_path / segments_directory), config(std::move(c)),
+      policy(p), threads(std::max<size_t>(1, threads_count)) {
+  if (policy.segments_per_tier < 2) {
+    throw ConfigurationException("Merge at least two segments per tier");
+  }
+  std::filesystem::create_directories(directory);
+  if (std::filesystem::exists(directory / manifest_file)) {
+    segments_ = readManifest(directory, next_generation);
+  } else {
+    importBinary(index_path / "binary");
+  }
+}
+
+SegmentedIndex::~SegmentedIndex() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (merger.joinable()) {
+    merger.join();
+  }
+}
+
+// Once the manifest exists the handle opens only the segments, so the index
+// files of a full build, one or one per shard, become the first segments.
+// They are copied, as the next full build rewrites them.
+void SegmentedIndex::importBinary(const std::filesystem::path &binary_dir) {
+  std::vector<std::filesystem::path> files;
+  if (std::filesystem::exists(binary_dir / "binary")) {
+    files.push_back(binary_dir / "binary");
+  } else {
+    for (size_t shard = 0;
+         std::filesystem::exists(binary_dir / shardFileName(shard));
+         ++shard) {
+      files.push_back(binary_dir / shardFileName(shard));
+    }
+  }
+  if (files.empty()) {
+    return;
+  }
+  std::vector<SegmentInfo> segments;
+  for (const auto &file : files) {
+    const MappedIndex mapping(file);
+    const DocumentAccessor documents(mapping.section("docs").data(),
+                                     mapping.header().sectionVersion("docs"));
+    const auto name = newFile("segment");
+    std::filesystem::copy_file(
+        file, directory / name,
+        std::filesystem::copy_options::overwrite_existing);
+    segments.push_back({name, documents.totalDocs(), 0, ""});
+  }
+  const std::lock_guard<std::mutex> lock(mutex);
+  commit(std::move(segments));
+}
+
+// Called with the mutex held. The generation is saved by the next commit.
+std::string SegmentedIndex::newFile(const std::string &prefix) {
+  return prefix + "." + std::to_string(next_generation++);
+}
+
+// Called with the mutex held. Writes a new bitmap if any of `ids` is a
+// live document of the segment.
+void SegmentedIndex::deleteFrom(SegmentInfo &segment,
+                                const std::vector<size_t> &ids) {
+  if (segment.liveDocs() == 0) {
+    return;
+  }
+  const MappedIndex mapping(directory / segment.name);
+  const BinaryIndexAccessor accessor(mapping.data(), mapping.header());
+  auto bits = read_bitmap(directory, segment);
+  size_t deleted = 0;
+  for (const auto id : ids) {
+    const auto ordinal = find_document(accessor, segment.docs, id);
+    if (ordinal && !bit_set(bits, *ordinal)) {
+      bits[*ordinal / 8] = static_cast<char>(
+          static_cast<unsigned char>(bits[*ordinal / 8]) |
+          (1U << (*ordinal % 8)));
+      ++deleted;
+    }
+  }
+  if (deleted == 0) {
+    return;
+  }
+  const auto name = newFile("deleted");
+  std::ofstream file(directory / name, std::ios::binary | std::ios::trunc);
+  file.write(bits.data(), static_cast<std::streamsize>(bits.size()));
+  if (!file.flush()) {
+    throw std::runtime_error("Can`t write " + (directory / name).string());
+  }
+  segment.deletions = name;
+  segment.deleted += deleted;
+}
+
+// Called with the mutex held. Files only the previous manifest refers to
+// are removed; readers that mapped them keep their mappings.
+void SegmentedIndex::commit(std::vector<SegmentInfo> segments) {
+  writeManifest(directory, segments, next_generation);
+  std::set<std::string> kept;
+  for (const auto &segment : segments) {
+    kept.insert(segment.name);
+    kept.insert(segment.deletions);
+  }
+  for (const auto &segment : segments_) {
+    for (const auto &name : {segment.name, segment.deletions}) {
+      if (!name.empty() && kept.count(name) == 0) {
+        std::error_code error;
+        std::filesystem::remove(directory / name, error);
+      }
+    }
+  }
+  segments_ = std::move(segments);
+  changed.notify_all();
+}
+
+void SegmentedIndex::addDocuments(const std::vector<Document> &documents) {
+  IndexBuilder builder;
+  builder.addDocuments(documents, config, threads);
+  const auto &index = builder.getIndex();
+  if (index.docCount() == 0) {
+    return;
+  }
+  std::vector<size_t> ids;
+  for (std::uint32_t slot = 0; slot < index.docCount(); ++slot) {
+    ids.push_back(index.document(slot).document_id);
+  }
+  std::string name;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    name = newFile("segment");
+  }
+  segment_writer(threads).writeFile(directory / name, index);
+
+  const std::lock_guard<std::mutex> lock(mutex);
+  auto segments = segments_;
+  for (auto &segment : segments) {
+    deleteFrom(segment, ids);
+  }
+  segments.push_back({name, index.docCount(), 0, ""});
+  commit(std::move(segments));
+}
+
+void SegmentedIndex::deleteDocuments(const std::vector<size_t> &document_ids) {
+  const std::lock_guard<std::mutex> lock(mutex);
+  auto segments = segments_;
+  for (auto &segment : segments) {
+    deleteFrom(segment, document_ids);
+  }
+  commit(std::move(segments));
+}
+
+// The live documents of the picked segments are copied into a new segment
+// without holding the mutex, so documents can be added and deleted
+// meanwhile. Deletions committed to the picked segments during the merge
+// are applied to the new one before it replaces them: their bitmaps are
+// compared with the ones the merge started from, as the commits removed
+// those files.
+bool SegmentedIndex::merge() {
+  const std::lock_guard<std::mutex> merge_lock(merge_mutex);
+  std::vector<SegmentInfo> picked;
+  std::vector<std::vector<char>> picked_bits;
+  std::string name;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    for (const auto position : policy.pick(segments_)) {
+      picked.push_back(segments_[position]);
+      picked_bits.push_back(read_bitmap(directory, picked.back()));
+    }
+    if (picked.empty()) {
+      return false;
+    }
+    name = newFile("segment");
+  }
+
+  try {
+    mergeInto(name, picked, picked_bits);
+  } catch (...) {
+    std::error_code error;
+    std::filesystem::remove(directory / name, error);
+    throw;
+  }
+  return true;
+}
+
+void SegmentedIndex::mergeInto(const std::string &name,
+                               const std::vector<SegmentInfo> &picked,
+                               const std::vector<std::vector<char>> &bits) {
+  std::vector<std::unique_ptr<MappedIndex>> mappings;
+  std::vector<BinaryIndexAccessor> accessors;
+  Index merged;
+  std::vector<size_t> positions;
+  for (size_t i = 0; i < picked.size(); ++i) {
+    const auto &segment = picked[i];
+    mappings.push_back(std::make_unique<MappedIndex>(directory / segment.name));
+    accessors.emplace_back(mappings.back()->data(),
+                           mappings.back()->header());
+    const auto &accessor = accessors.back();
+    std::vector<std::optional<std::uint32_t>> slots(segment.docs);
+    for (size_t ordinal = 0; ordinal < segment.docs; ++ordinal) {
+      if (!bit_set(bits[i], ordinal)) {
+        slots[ordinal] = merged.addDocument(accessor.externalId(ordinal),
+                                            accessor.loadDocument(ordinal));
+      }
+    }
+    accessor.forEachTerm([&](std::string_view term, PostingIterator postings) {
+      std::optional<std::uint32_t> term_id;
+      while (postings.next()) {
+        const auto slot = slots[postings.document()];
+        if (!slot) {
+          continue;
+        }
+        if (!term_id) {
+          term_id = merged.internTerm(term);
+        }
+        postings.positions(positions);
+        for (const auto position : positions) {
+          merged.addOccurrence(*term_id, *slot,
+                               static_cast<std::uint32_t>(position));
+        }
+      }
+    });
+  }
+  if (merged.docCount() != 0) {
+    segment_writer(threads).writeFile(directory / name, merged);
+  }
+
+  const std::lock_guard<std::mutex> lock(mutex);
+  std::vector<size_t> deleted_meanwhile;
+  std::vector<SegmentInfo> segments;
+  for (const auto &segment : segments_) {
+    const auto found = std::find_if(
+        picked.begin(), picked.end(),
+        [&segment](const auto &p) { return p.name == segment.name; });
+    if (found == picked.end()) {
+      segments.push_back(segment);
+      continue;
+    }
+    if (segment.deletions != found->deletions) {
+      const auto position = static_cast<size_t>(found - picked.begin());
+      const auto &before = bits[position];
+      const auto after = read_bitmap(directory, segment);
+      for (size_t ordinal = 0; ordinal < segment.docs; ++ordinal) {
+        if (bit_set(after, ordinal) && !bit_set(before, ordinal)) {
+          deleted_meanwhile.push_back(accessors[position].externalId(ordinal));
+        }
+      }
+    }
+  }
+  if (merged.docCount() != 0) {
+    SegmentInfo segment{name, merged.docCount(), 0, ""};
+    deleteFrom(segment, deleted_meanwhile);
+    segments.push_back(std::move(segment));
+  }
+  commit(std::move(segments));
+}
+
+void SegmentedIndex::mergeInBackground() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping) {
+    if (policy.pick(segments_).empty()) {
+      changed.wait(lock);
+      continue;
+    }
+    lock.unlock();
+    try {
+      merge();
+    } catch (const std::exception &error) {
+      // Retried after the next change; the index stays as it was.
+      std::cerr << "Segment merge failed: " << error.what() << '\n';
+      lock.lock();
+      if (!stopping) {
+        changed.wait(lock);
+      }
+      continue;
+    }
+    lock.lock();
+  }
+}
+
+void SegmentedIndex::startMerging() {
+  const std::lock_guard<std::mutex> lock(mutex);
+  if (!merger.joinable()) {
+    merger = std::thread([this]() { mergeInBackground(); });
+  }
+}
+
+std::vector<SegmentInfo> SegmentedIndex::segments() const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return segments_;
+}
+
+} // namespace fts
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <ftslib/indexer.hpp>
+#include <ftslib/parser.hpp>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fts {
+
+// Incremental index: immutable segments in <index>/segments, each a binary
+// index container of its own, listed by the manifest file there. The
+// manifest holds the next file generation on its first line, then one line
+// per segment: its file, its document count, its deleted document count
+// and the file of its deletion bitmap (see DeletedDocuments), or "-". Files
+// are never changed once written: a change writes new files and then
+// replaces the manifest by a rename, so readers always see a consistent
+// set of segments.
+
+constexpr std::string_view segments_directory = "segments";
+constexpr std::string_view manifest_file = "manifest";
+
+struct SegmentInfo {
+  std::string name;
+  size_t docs = 0;
+  size_t deleted = 0;
+  // Deletion bitmap file; empty if no document is deleted.
+  std::string deletions;
+
+  size_t liveDocs() const { return docs - deleted; }
+};
+
+// Segments of the manifest in `directory`, none if there is no manifest.
+std::vector<SegmentInfo> readManifest(const std::filesystem::path &directory,
+                                      size_t &next_generation);
+void writeManifest(const std::filesystem::path &directory,
+                   const std::vector<SegmentInfo> &segments,
+                   size_t next_generation);
+
+// Segments are grouped in tiers by live document count, the first tier up
+// to floor_docs and each next one segments_per_tier times larger. Once a
+// tier holds segments_per_tier segments, its smallest ones are merged into
+// one of a higher tier. A segment with more than max_deleted of its
+// documents deleted is rewritten on its own.
+struct TieredMergePolicy {
+  size_t segments_per_tier = 10;
+  size_t floor_docs = 1000;
+  double max_deleted = 0.5;
+
+  // Positions in `segments` of the segments to merge next, in order; empty
+  // if nothing needs merging.
+  std::vector<size_t> pick(const std::vector<SegmentInfo> &segments) const;
+};
+
+// Writer of a segmented index. An index built in full beforehand becomes
+// its first segments when the manifest is created. Adding documents writes
+// one new segment; documents already indexed under the same id are
+// deleted, so adding a document again updates it. Deleted documents are
+// dropped when their segment is merged. Merges run on the caller's thread
+// with merge(), or on a background thread after every change once
+// startMerging() is called. One writer per index directory; its methods may
+// be called concurrently.
+class SegmentedIndex {
+private:
+  std::filesystem::path directory;
+  Config config;
+  TieredMergePolicy policy;
+  size_t threads;
+
+  // Guards the manifest and the segment list.
+  mutable std::mutex mutex;
+  std::vector<SegmentInfo> segments_;
+  size_t next_generation = 1;
+  // Held for the whole of a merge, so merges never pick the same segment.
+  std::mutex merge_mutex;
+
+  std::thread merger;
+  std::condition_variable changed;
+  bool stopping = false;
+
+  void importBinary(const std::filesystem::path &binary_dir);
+  std::string newFile(const std::string &prefix);
+  void deleteFrom(SegmentInfo &segment, const std::vector<size_t> &ids);
+  void commit(std::vector<SegmentInfo> segments);
+  void mergeInto(const std::string &name,
+                 const std::vector<SegmentInfo> &picked,
+                 const std::vector<std::vector<char>> &bits);
+  void mergeInBackground();
+
+public:
+  explicit SegmentedIndex(const std::filesystem::path &index_path, Config c,
+                          TieredMergePolicy p = TieredMergePolicy(),
+                          size_t threads_count = 1);
+  ~SegmentedIndex();
+  SegmentedIndex(const SegmentedIndex &) = delete;
+  SegmentedIndex &operator=(const SegmentedIndex &) = delete;
+
+  void addDocuments(const std::vector<Document> &documents);
+  void deleteDocuments(const std::vector<size_t> &document_ids);
+  // Runs the next merge the policy picks; returns false if there was none.
+  bool merge();
+  void startMerging();
+  std::vector<SegmentInfo> segments() const;
+};
+
+} // namespace fts
@@ -0,0 +1,228 @@
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <ftslib/server.hpp>
+#include <future>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace fts {
+
+// QueryServer
+
+// Splits what is read from a descriptor into lines, without the line end.
+class LineReader {
+private:
+  int input;
+  std::string buffer;
+  size_t start = 0;
+  bool ended = false;
+
+public:
+  explicit LineReader(int i) : input(i) {}
+  bool next(std::string &line) {
+    while (true) {
+      const auto end = buffer.find('\n', start);
+      if (end != std::string::npos || (ended && start < buffer.size())) {
+        const auto stop = end == std::string::npos ? buffer.size() : end;
+        line.assign(buffer, start, stop - start);
+        if (!line.empty() && line.back() == '\r') {
+          line.pop_back();
+        }
+        start = end == std::string::npos ? buffer.size() : end + 1;
+        return true;
+      }
+      if (ended) {
+        return false;
+      }
+      buffer.erase(0, start);
+      start = 0;
+      char chunk[4096];
+      const auto count = read(input, chunk, sizeof(chunk));
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count <= 0) {
+        ended = true;
+      } else {
+        buffer.append(chunk, static_cast<size_t>(count));
+      }
+    }
+  }
+};
+
+static bool write_all(int output, const std::string &text) {
+  size_t written = 0;
+  while (written < text.size()) {
+    const auto count =
+        write(output, text.data() + written, text.size() - written);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    written += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+QueryServer::QueryServer(const IndexHandle &i, ThreadPool &p, size_t results)
+    : index(i), pool(p), results_count(results),
+      max_in_flight(2 * p.size()) {}
+
+std::string QueryServer::answer(const std::string &query) const {
+  try {
+    return getStringSearchResult(index.search(query, results_count)) + "\n";
+  } catch (const std::exception &e) {
+    return std::string(e.what()) + "\n\n";
+  }
+}
+
+void QueryServer::serve(int input, int output) const {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::future<std::string>> answers;
+  bool done = false;
+
+  // Answers are written in query order while later queries still run.
+  std::thread writer([&]() {
+    bool open = true;
+    while (true) {
+      std::future<std::string> next;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return done || !answers.empty(); });
+        if (answers.empty()) {
+          return;
+        }
+        next = std::move(answers.front());
+        answers.pop_front();
+      }
+      changed.notify_all();
+      const auto text = next.get();
+      open = open && write_all(output, text);
+    }
+  });
+
+  LineReader reader(input);
+  std::string line;
+  while (reader.next(line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto next = pool.submit([this, query = line]() { return answer(query); });
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return answers.size() < max_in_flight; });
+      answers.push_back(std::move(next));
+    }
+    changed.notify_all();
+  }
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  changed.notify_all();
+  writer.join();
+}
+
+void QueryServer::reapConnections() {
+  for (auto it = connections.begin(); it != connections.end();) {
+    if (it->finished->load()) {
+      it->thread.join();
+      it = connections.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void QueryServer::listen(const std::filesystem::path &socket_path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path.native().size() >= sizeof(address.sun_path)) {
+    throw std::system_error(ENAMETOOLONG, std::generic_category(),
+                            "Can`t listen on " + socket_path.string());
+  }
+  std::strcpy(address.sun_path, socket_path.c_str());
+
+  const int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (server == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Can`t create socket");
+  }
+  unlink(socket_path.c_str());
+  if (bind(server, reinterpret_cast<const sockaddr *>(&address),
+           sizeof(address)) == -1 ||
+      ::listen(server, SOMAXCONN) == -1) {
+    const int error = errno;
+    close(server);
+    throw std::system_error(error, std::generic_category(),
+                            "Can`t listen on " + socket_path.string());
+  }
+  {
+    const std::lock_guard<std::mutex> lock(connections_mutex);
+    listening_socket = server;
+    if (stopped) {
+      shutdown(server, SHUT_RDWR);
+    }
+  }
+
+  while (true) {
+    const int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break;
+    }
+    const std::lock_guard<std::mutex> lock(connections_mutex);
+    reapConnections();
+    if (stopped) {
+      close(client);
+      break;
+    }
+    client_sockets.insert(client);
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    connections.push_back({std::thread([this, client, finished]() {
+                             serve(client, client);
+                             {
+                               const std::lock_guard<std::mutex> lock(
+                                   connections_mutex);
+                               client_sockets.erase(client);
+                             }
+                             close(client);
+                             finished->store(true);
+                           }),
+                           finished});
+  }
+
+  std::list<Connection> remaining;
+  {
+    const std::lock_guard<std::mutex> lock(connections_mutex);
+    listening_socket = -1;
+    remaining.swap(connections);
+  }
+  for (auto &connection : remaining) {
+    connection.thread.join();
+  }
+  close(server);
+  unlink(socket_path.c_str());
+}
+
+void QueryServer::stop() {
+  const std::lock_guard<std::mutex> lock(connections_mutex);
+  stopped = true;
+  if (listening_socket != -1) {
+    shutdown(listening_socket, SHUT_RDWR);
+  }
+  for (const auto client : client_sockets) {
+    shutdown(client, SHUT_RD);
+  }
+}
+
+} // namespace fts
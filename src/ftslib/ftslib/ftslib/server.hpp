@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <ftslib/handle.hpp>
+#include <ftslib/pool.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace fts {
+
+// Serves queries against one shared index handle. Every connection reads
+// queries one per line and gets one answer per query, in the order the
+// queries came in: the results formatted by getStringSearchResult, or the
+// error message, followed by an empty line. Queries of every connection are
+// answered concurrently on the pool, with at most max_in_flight of them
+// queued per connection.
+class QueryServer {
+private:
+  struct Connection {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> finished;
+  };
+
+  const IndexHandle &index;
+  ThreadPool &pool;
+  size_t results_count;
+  size_t max_in_flight;
+
+  std::mutex connections_mutex;
+  int listening_socket = -1;
+  bool stopped = false;
+  std::set<int> client_sockets;
+  std::list<Connection> connections;
+
+  void reapConnections();
+
+public:
+  explicit QueryServer(const IndexHandle &i, ThreadPool &p,
+                       size_t results = printed_results_count);
+  QueryServer(const QueryServer &) = delete;
+  QueryServer &operator=(const QueryServer &) = delete;
+
+  std::string answer(const std::string &query) const;
+  // Answers the queries read from `input` on `output` until the end of
+  // input, then waits for the queued answers.
+  void serve(int input, int output) const;
+  // Accepts connections on a Unix socket at `socket_path`, each served on
+  // its own reader thread, until stop(). Returns when every connection has
+  // been answered, and removes the socket file.
+  void listen(const std::filesystem::path &socket_path);
+  // Stops accepting connections and reading queries; queries already read
+  // are still answered. Safe to call from any thread.
+  void stop();
+};
+
+} // namespace fts
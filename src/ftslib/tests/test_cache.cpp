@@ -0,0 +1,214 @@
+#include <ftslib/cache.hpp>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+
+static std::vector<fts::Result> results_of(size_t document_id) {
+  return {{document_id, 1.0, "Book " + std::to_string(document_id)}};
+}
+
+TEST(CacheTest, CacheTest1Lru) {
+  // One shard, room for about three entries.
+  fts::ResultCache cache(3 * 200, 1);
+  EXPECT_FALSE(cache.find(1, "a").has_value());
+  cache.insert(1, "a", results_of(1));
+  cache.insert(1, "b", results_of(2));
+  cache.insert(1, "c", results_of(3));
+  ASSERT_TRUE(cache.find(1, "a").has_value());
+  EXPECT_EQ(cache.find(1, "a")->front().document_id, 1U);
+
+  // "b" is now the least recently used entry.
+  cache.insert(1, "d", results_of(4));
+  EXPECT_FALSE(cache.find(1, "b").has_value());
+  EXPECT_TRUE(cache.find(1, "a").has_value());
+  EXPECT_TRUE(cache.find(1, "d").has_value());
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 4U);
+  EXPECT_EQ(stats.misses, 2U);
+  EXPECT_EQ(stats.evictions, 1U);
+  EXPECT_EQ(stats.entries, 3U);
+
+  // Generations are cached apart, and handles of different generations
+  // using the cache in turn keep each other's entries; the older ones age
+  // out as any other entry.
+  EXPECT_FALSE(cache.find(2, "a").has_value());
+  cache.insert(2, "a", results_of(5));
+  EXPECT_EQ(cache.find(1, "a")->front().document_id, 1U);
+  EXPECT_EQ(cache.find(2, "a")->front().document_id, 5U);
+  EXPECT_EQ(cache.stats().entries, 3U);
+  EXPECT_FALSE(cache.find(1, "c").has_value());
+
+  cache.insert(3, "a", std::vector<fts::Result>(100, results_of(6).front()));
+  EXPECT_EQ(cache.stats().entries, 3U);
+  cache.insert(3, "a", results_of(7));
+  cache.clear();
+  stats = cache.stats();
+  EXPECT_EQ(stats.entries, 0U);
+  EXPECT_EQ(stats.bytes, 0U);
+}
+
+TEST(CacheTest, CacheTest2Handle) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "cachetest";
+
+    fts::IndexBuilder idx;
+    idx.addDocument(199903, "The Matrix: 1", config);
+    idx.addDocument(200305, "Matrix Reloaded: Matrix 2", config);
+    idx.addDocument(200311, "Reloaded", config);
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+
+    const auto cache = std::make_shared<fts::ResultCache>(1 << 20);
+    const fts::IndexHandle uncached(config, index_dir);
+    const fts::IndexHandle handle(config, index_dir, cache);
+    EXPECT_EQ(handle.generation(), uncached.generation());
+
+    const auto expected = uncached.search("matrix reloaded");
+    for (const auto &query : {"matrix reloaded", "Matrix  RELOADED",
+                              "matrix, reloaded!"}) {
+      const auto results = handle.search(query);
+      ASSERT_EQ(results.size(), expected.size());
+      for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].document_id, expected[i].document_id);
+        EXPECT_EQ(results[i].score, expected[i].score);
+      }
+    }
+    EXPECT_EQ(cache->stats().misses, 1U);
+    EXPECT_EQ(cache->stats().hits, 2U);
+    // Pages and phrases are cached apart.
+    EXPECT_EQ(handle.search("matrix reloaded", 1).size(), 1U);
+    EXPECT_EQ(handle.search("\"matrix reloaded\"").size(), 1U);
+    EXPECT_EQ(cache->stats().misses, 3U);
+
+    // The same index reopened keeps its cached results.
+    EXPECT_EQ(fts::IndexHandle(config, index_dir, cache)
+                  .search("matrix reloaded")
+                  .size(),
+              expected.size());
+    EXPECT_EQ(cache->stats().hits, 3U);
+
+    // A rebuilt index does not.
+    idx.addDocument(200312, "Reloaded Again", config);
+    writer.write(index_dir, idx.getIndex());
+    const fts::IndexHandle rebuilt(config, index_dir, cache);
+    EXPECT_NE(rebuilt.generation(), handle.generation());
+    EXPECT_EQ(rebuilt.search("reloaded").size(), 3U);
+    EXPECT_EQ(cache->stats().hits, 3U);
+    // The handle still open on the previous build keeps its results.
+    EXPECT_EQ(handle.search("matrix reloaded").size(), expected.size());
+    EXPECT_EQ(cache->stats().hits, 4U);
+
+    // Handles share the cache across query threads.
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+      threads.emplace_back([&rebuilt, t]() {
+        for (size_t i = 0; i < 200; ++i) {
+          const auto results =
+              rebuilt.search((i + t) % 2 == 0 ? "reloaded" : "matrix");
+          EXPECT_EQ(results.size(), (i + t) % 2 == 0 ? 3U : 2U);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    // Each thread misses each query at most once.
+    EXPECT_GE(cache->stats().hits, 3U + 4 * 200 - 4 * 2);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(CacheTest, CacheTest3Terms) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "cachetest";
+
+    fts::IndexBuilder idx;
+    for (size_t i = 0; i < 300; ++i) {
+      idx.addDocument(i, i % 3 == 0 ? "Harry Potter" : "Harry Hole", config);
+    }
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+
+    const fts::IndexHandle uncached(config, index_dir);
+    EXPECT_EQ(uncached.termCacheStats().entries, 0U);
+    // Warming decodes two ngrams of "harry", found in every document.
+    const fts::IndexHandle handle(config, index_dir, nullptr, {1 << 20, 2});
+    EXPECT_EQ(handle.termCacheStats().entries, 2U);
+    const fts::IndexHandle tiny(config, index_dir, nullptr, {4096, 0});
+
+    for (size_t pass = 0; pass < 3; ++pass) {
+      for (const auto &query : {"harry", "potter hole", "\"harry potter\""}) {
+        const auto expected = uncached.search(query);
+        for (const auto *cached : {&handle, &tiny}) {
+          const auto results = cached->search(query);
+          ASSERT_EQ(results.size(), expected.size());
+          for (size_t i = 0; i < results.size(); ++i) {
+            EXPECT_EQ(results[i].document_id, expected[i].document_id);
+            EXPECT_EQ(results[i].score, expected[i].score);
+          }
+          EXPECT_EQ(cached->search(query, 5).size(),
+                    std::min<size_t>(5, expected.size()));
+        }
+      }
+    }
+    const auto stats = handle.termCacheStats();
+    EXPECT_GT(stats.hits, stats.misses);
+    EXPECT_LE(tiny.termCacheStats().bytes, 4096U);
+    EXPECT_GT(tiny.termCacheStats().evictions, 0U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(CacheTest, CacheTest4LongPostings) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "cachetest";
+
+    fts::IndexBuilder idx;
+    for (size_t i = 0; i < 2000; ++i) {
+      idx.addDocument(i, i % 100 == 0 ? "Dragon Book" : "Dragon", config);
+    }
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+
+    // Shards of 4 KiB hold the lists of "book" but none of "dragon".
+    const auto cache = std::make_shared<fts::TermCache>(64 << 10);
+    const fts::MappedIndex index(index_dir / "binary" / "binary");
+    const fts::BinaryIndexAccessor cached(index.data(), index.header(), cache);
+    const fts::BinaryIndexAccessor uncached(index.data(), index.header());
+    for (size_t pass = 0; pass < 3; ++pass) {
+      for (const auto &query : {"dragon", "dragon book", "book"}) {
+        const auto expected = fts::search(config, uncached, query, 10);
+        const auto results = fts::search(config, cached, query, 10);
+        ASSERT_EQ(results.size(), expected.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+          EXPECT_EQ(results[i].document_id, expected[i].document_id);
+          EXPECT_EQ(results[i].score, expected[i].score);
+        }
+      }
+    }
+    // The long list is streamed and never decoded again.
+    const auto dragon = cache->find("dragon");
+    ASSERT_TRUE(dragon.has_value());
+    EXPECT_TRUE(dragon->too_large);
+    EXPECT_EQ(dragon->postings, nullptr);
+    const auto book = cache->find("book");
+    ASSERT_TRUE(book.has_value());
+    EXPECT_FALSE(book->too_large);
+    EXPECT_NE(book->postings, nullptr);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
@@ -0,0 +1,80 @@
+#include <ftslib/codec.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(CodecTest, CodecTest1Varint) {
+  const std::vector<std::uint32_t> values = {0,      1,       127,     128,
+                                             16383,  16384,   2097151, 2097152,
+                                             1U << 31, 0xffffffff};
+  for (const auto value : values) {
+    std::uint8_t bytes[fts::max_varint_size];
+    const auto size = fts::encodeVarint(value, bytes);
+    std::uint32_t decoded = 0;
+    const char *end =
+        fts::decodeVarint(reinterpret_cast<const char *>(bytes), decoded);
+    EXPECT_EQ(decoded, value);
+    EXPECT_EQ(end, reinterpret_cast<const char *>(bytes) + size);
+  }
+}
+
+TEST(CodecTest, CodecTest2PackUnpack) {
+  for (std::uint8_t bit_width = 0; bit_width <= 32; ++bit_width) {
+    std::vector<std::uint32_t> values(fts::packed_block_size);
+    const std::uint64_t limit = std::uint64_t{1} << bit_width;
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = static_cast<std::uint32_t>((i * 2654435761U) % limit);
+    }
+    values[7] = static_cast<std::uint32_t>(limit - 1);
+    EXPECT_EQ(fts::maxBitWidth(values.data()), bit_width);
+
+    std::vector<std::uint32_t> packed(4 * static_cast<size_t>(bit_width) + 1);
+    fts::packBlock(values.data(), bit_width, packed.data());
+    std::vector<std::uint32_t> unpacked(fts::packed_block_size);
+    fts::unpackBlock(packed.data(), bit_width, unpacked.data());
+    EXPECT_EQ(unpacked, values) << int(bit_width);
+  }
+}
+
+TEST(CodecTest, CodecTest3PrefixSum) {
+  std::vector<std::uint32_t> values = {3, 1, 0, 4, 10};
+  fts::prefixSum(values.data(), values.size(), 100);
+  EXPECT_EQ(values, std::vector<std::uint32_t>({103, 104, 104, 108, 118}));
+}
+
+TEST(CodecTest, CodecTest4SimdKernels) {
+  const auto &scalar = fts::codecKernels(fts::SimdLevel::Scalar);
+  for (const auto level : {fts::SimdLevel::Sse41, fts::SimdLevel::Avx2}) {
+    if (!fts::simdSupported(level)) {
+      continue;
+    }
+    const auto &kernels = fts::codecKernels(level);
+    for (std::uint8_t bit_width = 0; bit_width <= 32; ++bit_width) {
+      std::vector<std::uint32_t> packed(4 * static_cast<size_t>(bit_width));
+      for (size_t i = 0; i < packed.size(); ++i) {
+        packed[i] = static_cast<std::uint32_t>(i * 2246822519U + 374761393U);
+      }
+      std::vector<std::uint32_t> expected(fts::packed_block_size);
+      std::vector<std::uint32_t> actual(fts::packed_block_size);
+      scalar.unpack_block(packed.data(), bit_width, expected.data());
+      kernels.unpack_block(packed.data(), bit_width, actual.data());
+      EXPECT_EQ(actual, expected) << int(bit_width);
+    }
+    for (size_t count = 0; count <= 130; ++count) {
+      std::vector<std::uint32_t> expected(count);
+      for (size_t i = 0; i < count; ++i) {
+        expected[i] = static_cast<std::uint32_t>(i * 7 % 13);
+      }
+      auto actual = expected;
+      scalar.prefix_sum(expected.data(), count, 42);
+      kernels.prefix_sum(actual.data(), count, 42);
+      EXPECT_EQ(actual, expected) << count;
+    }
+  }
+}
+
+TEST(CodecTest, CodecTest5Crc32) {
+  const char check[] = "123456789";
+  EXPECT_EQ(fts::crc32(check, 9), 0xCBF43926U);
+  EXPECT_EQ(fts::crc32(check, 0), 0U);
+  EXPECT_EQ(fts::crc32(check + 4, 5, fts::crc32(check, 4)), 0xCBF43926U);
+}
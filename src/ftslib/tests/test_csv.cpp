@@ -0,0 +1,67 @@
+#include <fstream>
+#include <ftslib/csv.hpp>
+#include <gtest/gtest.h>
+
+TEST(CsvTest, CsvTest1Rows) {
+  const auto csv_path = std::filesystem::current_path() / "csvtest.csv";
+  {
+    std::ofstream file(csv_path, std::ios_base::binary);
+    file << "bookID,title,  num_pages\r\n"
+         << "1,\"Dune, Messiah\",336\r\n"
+         << "\n"
+         << "2,\"The \"\"Hobbit\"\"\",\n"
+         << "3,\"Two\nlines\",12,extra\n"
+         << "4,Last,1";
+  }
+  // A chunk this small splits every row between reads.
+  for (const size_t chunk_size : {1U, 7U, 1U << 20}) {
+    fts::CsvReader csv(csv_path, chunk_size);
+    EXPECT_EQ(csv.column("title"), 1U);
+    EXPECT_EQ(csv.column("  num_pages"), 2U);
+    EXPECT_THROW(csv.column("authors"), std::runtime_error);
+
+    std::vector<std::vector<std::string>> rows;
+    while (csv.next()) {
+      rows.emplace_back(csv.row().begin(), csv.row().end());
+    }
+    EXPECT_EQ(rows, (std::vector<std::vector<std::string>>{
+                        {"1", "Dune, Messiah", "336"},
+                        {"2", "The \"Hobbit\"", ""},
+                        {"3", "Two\nlines", "12", "extra"},
+                        {"4", "Last", "1"}}));
+  }
+}
+
+TEST(CsvTest, CsvTest2Catalog) {
+  const auto csv_path = std::filesystem::current_path() / "catalogtest.csv";
+  const size_t books = fts::CatalogReader::batch_size + 10;
+  {
+    std::ofstream file(csv_path, std::ios_base::binary);
+    file << "bookID,title,authors,average_rating,language_code\n"
+         << "1,\"Dune, Messiah\",Frank Herbert/Brian Herbert,4.2,eng\n"
+         << "2,Le Petit Prince,Antoine de Saint-Exupery,4.3,fre\n"
+         << "3,Short\n";
+    for (size_t id = 4; id < books + 3; ++id) {
+      file << id << ",Book " << id << ",,3.0,en-US\n";
+    }
+  }
+  fts::CatalogReader catalog(csv_path);
+  std::vector<fts::Document> batch;
+  ASSERT_TRUE(catalog.read(batch));
+  EXPECT_EQ(batch.size(), fts::CatalogReader::batch_size);
+  EXPECT_EQ(batch[0].document_id, 1U);
+  EXPECT_EQ(batch[0].name_of_doc, "Dune, Messiah");
+  EXPECT_EQ(batch[0].authors, "Frank Herbert Brian Herbert");
+  EXPECT_EQ(batch[1].document_id, 4U);
+
+  const auto documents = fts::readCatalog(csv_path);
+  ASSERT_EQ(documents.size(), books);
+  EXPECT_EQ(documents.back().document_id, books + 2);
+
+  {
+    std::ofstream file(csv_path, std::ios_base::binary);
+    file << "bookID,title,authors,language_code\n"
+         << "1x,Dune,Frank Herbert,eng\n";
+  }
+  EXPECT_THROW(fts::readCatalog(csv_path), std::runtime_error);
+}
@@ -1,3 +1,5 @@
+#include <fstream>
+#include <ftslib/handle.hpp>
 #include <ftslib/indexer.hpp>
 #include <ftslib/searcher.hpp>
 #include <gtest/gtest.h>
@@ -78,7 +80,7 @@ TEST(IndexerTest, IndexTest3AddDoc) {
 
     std::map<std::string, std::map<size_t, std::vector<size_t>>> expected_entry;
     expected_entry.insert(
-        {"matrix", {{199903, {1, 0}}, {200305, {1, 0}}, {200311, {1, 0}}}});
+        {"matrix", {{0, {1, 0}}, {1, {1, 0}}, {2, {1, 0}}}});
     EXPECT_EQ(entry, expected_entry);
 
   } catch (fts::ConfigurationException &e) {
@@ -105,10 +107,219 @@ TEST(IndexerTest, IndexTest4BinAdd) {
 
     std::map<size_t, std::vector<size_t>> expected_entry;
     expected_entry.insert(
-        {{4, {1, 0}}, {18, {1, 0}}, {32, {1, 0}}});
+        {{0, {1, 0}}, {1, {1, 0}}, {2, {1, 0}}});
     EXPECT_EQ(entry, expected_entry);
 
+    const fts::MappedIndex index_file(
+        std::filesystem::current_path() / "indextest" / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+    EXPECT_EQ(accessor.externalId(0), 199903U);
+    EXPECT_EQ(accessor.externalId(2), 200311U);
+    EXPECT_EQ(accessor.loadDocument(1), "The Matrix: 2");
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(IndexerTest, IndexTest5LongTitle) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    const std::string long_title(300, 'x');
+    fts::IndexBuilder idx;
+    idx.addDocument(7, long_title, config);
+    idx.addDocument(8, "Short", config);
+
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "indextest", idx.getIndex());
+
+    const fts::MappedIndex index_file(
+        std::filesystem::current_path() / "indextest" / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+    EXPECT_EQ(accessor.loadDocument(0), long_title);
+    EXPECT_EQ(accessor.loadDocument(1), "Short");
+    EXPECT_EQ(accessor.externalId(1), 8U);
+
   } catch (fts::ConfigurationException &e) {
     std::cerr << e.what() << "\n";
   };
 }
+
+TEST(IndexerTest, IndexTest6Parallel) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    std::vector<fts::Document> documents;
+    for (size_t i = 0; i < 200; ++i) {
+      documents.push_back({i % 150,
+                           "Book number " + std::to_string(i) +
+                               (i % 3 == 0 ? " Matrix" : " Reload"),
+                           i % 5 == 0 ? "Neo Anderson" : ""});
+    }
+
+    fts::IndexBuilder sequential;
+    for (const auto &[document_id, name_of_doc, authors] : documents) {
+      sequential.addDocument(document_id, name_of_doc, config, authors);
+    }
+    fts::IndexBuilder parallel;
+    parallel.addDocuments(documents, config, 4);
+
+    EXPECT_EQ(parallel.getIndex().getDocs(), sequential.getIndex().getDocs());
+    EXPECT_EQ(parallel.getIndex().getEntries(),
+              sequential.getIndex().getEntries());
+
+    const auto index_dir = std::filesystem::current_path() / "indextest";
+    fts::BinaryIndexWriter sequential_writer;
+    sequential_writer.write(index_dir / "sequential", sequential.getIndex());
+    fts::BinaryIndexWriter parallel_writer(fts::DictionaryVersion::FrontCoded,
+                                           fts::EntriesVersion::BlockMax, 3);
+    parallel_writer.write(index_dir / "parallel", parallel.getIndex());
+
+    std::ifstream sequential_file(index_dir / "sequential/binary/binary",
+                                  std::ios_base::binary);
+    std::ifstream parallel_file(index_dir / "parallel/binary/binary",
+                                std::ios_base::binary);
+    const std::string sequential_data(
+        (std::istreambuf_iterator<char>(sequential_file)),
+        std::istreambuf_iterator<char>());
+    const std::string parallel_data(
+        (std::istreambuf_iterator<char>(parallel_file)),
+        std::istreambuf_iterator<char>());
+    EXPECT_EQ(parallel_data, sequential_data);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(IndexerTest, IndexTest7Arena) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder shuffled;
+    shuffled.addDocument(300, "Matrix Revolutions", config);
+    shuffled.addDocument(100, "The Matrix", config);
+    shuffled.addDocument(200, "Matrix Reloaded", config);
+    shuffled.addDocument(100, "Duplicate", config);
+    fts::IndexBuilder ordered;
+    ordered.addDocument(100, "The Matrix", config);
+    ordered.addDocument(200, "Matrix Reloaded", config);
+    ordered.addDocument(300, "Matrix Revolutions", config);
+
+    EXPECT_EQ(shuffled.getIndex().docCount(), 3);
+    EXPECT_EQ(shuffled.getIndex().getDocs(), ordered.getIndex().getDocs());
+    EXPECT_EQ(shuffled.getIndex().getEntries(),
+              ordered.getIndex().getEntries());
+
+    const auto index_dir = std::filesystem::current_path() / "indextest";
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir / "shuffled", shuffled.getIndex());
+    writer.write(index_dir / "ordered", ordered.getIndex());
+    std::ifstream shuffled_file(index_dir / "shuffled/binary/binary",
+                                std::ios_base::binary);
+    std::ifstream ordered_file(index_dir / "ordered/binary/binary",
+                               std::ios_base::binary);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(shuffled_file), {}),
+              std::string(std::istreambuf_iterator<char>(ordered_file), {}));
+
+    shuffled.getIndex().clear();
+    EXPECT_EQ(shuffled.getIndex().docCount(), 0);
+    EXPECT_EQ(shuffled.getIndex().termCount(), 0);
+    shuffled.addDocument(100, "The Matrix", config);
+    EXPECT_EQ(shuffled.getIndex().getDocs(),
+              (std::map<size_t, std::string>{{100, "The Matrix"}}));
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  }
+}
+
+TEST(IndexerTest, IndexTest8Streaming) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    const auto index_dir = std::filesystem::current_path() / "indextest";
+    const auto read_file = [](const std::filesystem::path &path) {
+      std::ifstream file(path, std::ios_base::binary);
+      return std::string(std::istreambuf_iterator<char>(file), {});
+    };
+    for (const auto version :
+         {fts::EntriesVersion::Raw, fts::EntriesVersion::BlockMax}) {
+      // A budget this small spills a run every few documents.
+      fts::IndexBuilder idx;
+      fts::StreamingIndexBuilder streaming(index_dir / "streaming", 2000,
+                                           version);
+      for (size_t i = 0; i < 400; ++i) {
+        const size_t id = (i * 7919) % 1000;
+        std::string title = i % 3 == 0 ? "Dragon Saga" : "Knight Tale";
+        title += " " + std::to_string(i % 17) + " Dragon";
+        const std::string authors = i % 5 == 0 ? "Robin Hobb" : "Ursula";
+        idx.addDocument(id, title, config, authors);
+        streaming.addDocument(id, title, config, authors);
+      }
+      streaming.addDocument(0, "Duplicate", config);
+      EXPECT_TRUE(std::filesystem::exists(index_dir /
+                                          "streaming/binary/spill/terms.3"));
+      streaming.finish();
+      EXPECT_FALSE(
+          std::filesystem::exists(index_dir / "streaming/binary/spill"));
+
+      fts::BinaryIndexWriter writer(fts::DictionaryVersion::FrontCoded,
+                                    version);
+      writer.write(index_dir / "inmemory", idx.getIndex());
+      EXPECT_EQ(read_file(index_dir / "streaming/binary/binary"),
+                read_file(index_dir / "inmemory/binary/binary"));
+      fts::MappedIndex(index_dir / "streaming/binary/binary", true);
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  }
+}
+
+TEST(IndexerTest, IndexTest9Pipeline) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    std::vector<fts::Document> documents;
+    for (size_t i = 0; i < 3000; ++i) {
+      documents.push_back({(i * 7919) % 2000,
+                           "Dragon " + std::to_string(i % 97) + " Tale",
+                           i % 5 == 0 ? "Robin Hobb" : "Ursula"});
+    }
+    fts::IndexBuilder expected;
+    expected.addDocuments(documents, config, 1);
+
+    // Batches of every size, indexed while later ones are read; duplicate
+    // ids keep their first document.
+    size_t read = 0;
+    const auto source = [&](std::vector<fts::Document> &batch) {
+      for (size_t size = read % 37 + 1; size != 0 && read < documents.size();
+           --size) {
+        batch.push_back(documents[read++]);
+      }
+      return !batch.empty();
+    };
+    fts::IndexBuilder pipelined;
+    pipelined.addDocuments(source, config, 4, 2);
+    EXPECT_EQ(pipelined.getIndex().getDocs(), expected.getIndex().getDocs());
+    EXPECT_EQ(pipelined.getIndex().getEntries(),
+              expected.getIndex().getEntries());
+
+    const auto failing = [](std::vector<fts::Document> &) -> bool {
+      throw std::runtime_error("broken catalog");
+    };
+    fts::IndexBuilder failed;
+    EXPECT_THROW(failed.addDocuments(failing, config, 2),
+                 std::runtime_error);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  }
+}
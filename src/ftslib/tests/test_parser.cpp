@@ -64,3 +64,57 @@ TEST(ParserTest, ParseTest3NrmlExmpl) {
     std::cerr << e.what() << "\n";
   };
 }
+
+TEST(ParserTest, ParseTest4Tokenize) {
+  try {
+    const fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    fts::TokenizerContext context;
+    std::vector<std::pair<std::string, size_t>> terms;
+    const auto collect = [&](std::string_view term, size_t position) {
+      terms.emplace_back(term, position);
+    };
+
+    fts::tokenize("Dune: Messiah", config, context, collect);
+    const std::vector<std::pair<std::string, size_t>> expected = {
+        {"dun", 0}, {"dune", 0}, {"mes", 1}, {"mess", 1}, {"messi", 1},
+        {"messia", 1}};
+    EXPECT_EQ(terms, expected);
+
+    // The context is reused; its previous contents must not leak through.
+    terms.clear();
+    fts::tokenize("Go", config, context, collect);
+    EXPECT_TRUE(terms.empty());
+    fts::tokenize("Children of Dune", config, context, collect);
+    const std::vector<std::pair<std::string, size_t>> expected_reused = {
+        {"chi", 0}, {"chil", 0}, {"child", 0}, {"childr", 0}, {"dun", 1},
+        {"dune", 1}};
+    EXPECT_EQ(terms, expected_reused);
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(ParserTest, ParseTest5AdjacentStopWords) {
+  try {
+    const fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto result = fts::parse("The Lord of the Rings", config);
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0].word_ngrams,
+              (std::vector<std::string>{"lor", "lord"}));
+    EXPECT_EQ(result[0].word_position, 0);
+    EXPECT_EQ(result[1].word_ngrams,
+              (std::vector<std::string>{"rin", "ring", "rings"}));
+    EXPECT_EQ(result[1].word_position, 1);
+
+    const fts::StopWords stop_words({"of", "the", "a", "the"});
+    EXPECT_TRUE(stop_words.contains("the"));
+    EXPECT_TRUE(stop_words.contains("a"));
+    EXPECT_FALSE(stop_words.contains("then"));
+    EXPECT_FALSE(stop_words.contains(""));
+    EXPECT_FALSE(fts::StopWords().contains("the"));
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
@@ -0,0 +1,774 @@
+#include <cmath>
+#include <fstream>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <ftslib/query.hpp>
+#include <ftslib/searcher.hpp>
+#include <gtest/gtest.h>
+
+TEST(SearcherTest, SearchTest1BinPostings) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(199903, "The Matrix: 1", config);
+    idx.addDocument(200305, "Matrix Reloaded: Matrix 2", config);
+    idx.addDocument(200311, "The Matrix: 3", config);
+
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+
+    const fts::MappedIndex index_file(
+        std::filesystem::current_path() / "searchtest" / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+    const auto postings = accessor.getPostings("matrix");
+    ASSERT_EQ(postings.size(), 3U);
+    EXPECT_EQ(postings[0].document_id, 0U);
+    EXPECT_EQ(postings[0].term_frequency, 1U);
+    EXPECT_EQ(postings[1].document_id, 1U);
+    EXPECT_EQ(postings[1].term_frequency, 2U);
+    EXPECT_EQ(postings[1].positions, std::vector<size_t>({0, 2}));
+    EXPECT_EQ(postings[2].document_id, 2U);
+
+    const auto result = fts::search(config, accessor, "matrix reloaded");
+    ASSERT_EQ(result.size(), 3U);
+    EXPECT_EQ(result[0].document_id, 200305U);
+    EXPECT_EQ(result[0].name_of_doc, "Matrix Reloaded: Matrix 2");
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest2TextPostings) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(199903, "The Matrix: 1", config);
+    idx.addDocument(200305, "Matrix Reloaded: Matrix 2", config);
+
+    fts::TextIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+
+    fts::TextIndexAccessor accessor(std::filesystem::current_path() /
+                                    "searchtest" / "text");
+
+    const auto postings = accessor.getPostings("matrix");
+    ASSERT_EQ(postings.size(), 2U);
+    EXPECT_EQ(postings[0].document_id, 0U);
+    EXPECT_EQ(postings[0].positions, std::vector<size_t>({0}));
+    EXPECT_EQ(postings[1].document_id, 1U);
+    EXPECT_EQ(postings[1].term_frequency, 2U);
+    EXPECT_EQ(postings[1].positions, std::vector<size_t>({0, 2}));
+    EXPECT_EQ(accessor.externalId(1), 200305U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest3DictionaryVersions) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Harry Potter and the Chamber of Secrets", config);
+    idx.addDocument(2, "Harvest of Hares", config);
+    idx.addDocument(3, "Hardy Boys: The Tower Treasure", config);
+    idx.addDocument(4, "Potted Plants", config);
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    const std::vector<std::string> terms = {"har",  "harr", "harry", "harv",
+                                            "hare", "hares", "pot", "potte",
+                                            "tow",  "tower"};
+    const std::vector<std::string> missing = {"ha", "hax", "harrz", "aaa",
+                                              "zzz", "potterx", ""};
+
+    for (const auto version :
+         {fts::DictionaryVersion::Trie, fts::DictionaryVersion::FrontCoded}) {
+      fts::BinaryIndexWriter writer(version);
+      writer.write(index_dir, idx.getIndex());
+
+      const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+      EXPECT_EQ(index_file.header().sectionVersion("dictionary"),
+                static_cast<std::uint8_t>(version));
+      fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+      for (const auto &term : terms) {
+        const auto expected = idx.getIndex().getEntries().at(term);
+        const auto postings = accessor.getPostings(term);
+        ASSERT_EQ(postings.size(), expected.size()) << term;
+      }
+      for (const auto &term : missing) {
+        EXPECT_TRUE(accessor.getPostings(term).empty()) << term;
+      }
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest4IndexHandle) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(199903, "The Matrix: 1", config);
+    idx.addDocument(200305, "Matrix Reloaded: Matrix 2", config);
+    idx.addDocument(200311, "Reloaded", config);
+
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+
+    const fts::IndexHandle handle(
+        config, std::filesystem::current_path() / "searchtest");
+    const auto first = handle.search("matrix");
+    const auto second = handle.search("matrix");
+    ASSERT_EQ(first.size(), 2U);
+    EXPECT_EQ(first[0].name_of_doc, "Matrix Reloaded: Matrix 2");
+    EXPECT_EQ(second[0].score, first[0].score);
+
+    EXPECT_THROW(fts::IndexHandle(config, std::filesystem::current_path() /
+                                              "no_such_index"),
+                 std::system_error);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest5TopK) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Harry Potter and the Chamber of Secrets", config);
+    idx.addDocument(2, "Harry Potter and the Prisoner of Azkaban", config);
+    idx.addDocument(3, "Harry Harrison: Deathworld", config);
+    idx.addDocument(4, "Harvest Home", config);
+    idx.addDocument(5, "Potter's Field", config);
+    idx.addDocument(6, "Secrets of the Prisoner", config);
+    idx.addDocument(7, "Unrelated Title", config);
+
+    fts::TextIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+    fts::TextIndexAccessor accessor(std::filesystem::current_path() /
+                                    "searchtest" / "text");
+
+    const auto all = fts::search(config, accessor, "harry potter secrets");
+    ASSERT_EQ(all.size(), 6U);
+    for (size_t offset = 0; offset <= all.size(); ++offset) {
+      for (size_t k = 0; k <= all.size() + 1; ++k) {
+        const auto page =
+            fts::search(config, accessor, "harry potter secrets", k, offset);
+        const size_t expected_size =
+            std::min(k, all.size() - std::min(offset, all.size()));
+        ASSERT_EQ(page.size(), expected_size);
+        for (size_t i = 0; i < page.size(); ++i) {
+          EXPECT_EQ(page[i].document_id, all[offset + i].document_id);
+          EXPECT_EQ(page[i].score, all[offset + i].score);
+          EXPECT_EQ(page[i].name_of_doc, all[offset + i].name_of_doc);
+        }
+      }
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest6EntriesVersions) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    for (size_t i = 0; i < 300; ++i) {
+      std::string title = "Volume " + std::to_string(i);
+      for (size_t j = 0; j < i % 5; ++j) {
+        title += " Volume";
+      }
+      idx.addDocument(7 + i * i, title, config);
+    }
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    std::vector<std::vector<fts::Posting>> results;
+    for (const auto version :
+         {fts::EntriesVersion::Raw, fts::EntriesVersion::Compressed,
+          fts::EntriesVersion::Skipped}) {
+      fts::BinaryIndexWriter writer(fts::DictionaryVersion::FrontCoded,
+                                    version);
+      writer.write(index_dir, idx.getIndex());
+
+      const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+      fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+      results.push_back(accessor.getPostings("volume"));
+
+      // Skipping ahead lands on the same postings as reading them in order.
+      auto postings = accessor.iteratePostings("volume");
+      std::vector<size_t> positions;
+      ASSERT_TRUE(postings.advance(3));
+      EXPECT_EQ(postings.document(), 3U);
+      ASSERT_TRUE(postings.advance(203));
+      EXPECT_EQ(postings.frequency(), 4U);
+      postings.positions(positions);
+      EXPECT_EQ(positions, (std::vector<size_t>{0, 2, 3, 4}));
+      ASSERT_TRUE(postings.advance(150));
+      EXPECT_EQ(postings.document(), 203U);
+      ASSERT_TRUE(postings.next());
+      EXPECT_EQ(postings.document(), 204U);
+      ASSERT_TRUE(postings.advance(299));
+      EXPECT_EQ(postings.document(), 299U);
+      EXPECT_FALSE(postings.advance(300));
+    }
+
+    ASSERT_EQ(results[0].size(), 300U);
+    for (size_t version = 1; version < results.size(); ++version) {
+      ASSERT_EQ(results[version].size(), 300U);
+      for (size_t i = 0; i < 300; ++i) {
+        EXPECT_EQ(results[version][i].document_id, results[0][i].document_id);
+        EXPECT_EQ(results[version][i].term_frequency,
+                  results[0][i].term_frequency);
+        EXPECT_EQ(results[version][i].positions, results[0][i].positions);
+      }
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest7Container) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "The Matrix", config);
+    idx.addDocument(2, "Matrix Reloaded", config);
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+    const auto index_path = index_dir / "binary" / "binary";
+
+    std::string file_data;
+    {
+      const fts::MappedIndex index_file(index_path, true);
+      for (const auto &[name, info] : index_file.header().getSections()) {
+        EXPECT_EQ(info.offset % fts::section_alignment, 0U) << name;
+      }
+      EXPECT_EQ(index_file.header().sectionVersion("docs"), fts::docs_version);
+      EXPECT_EQ(index_file.header().sectionVersion("stats"),
+                fts::stats_version);
+      EXPECT_THROW(index_file.section("positions"), fts::IndexFormatException);
+      file_data.assign(index_file.data(), index_file.size());
+    }
+
+    const auto rewrite = [&](const std::string &data) {
+      std::ofstream file(index_path, std::ios_base::binary);
+      file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    };
+
+    // A flipped byte inside a section only shows up in the checksums.
+    std::string corrupted = file_data;
+    corrupted.back() ^= 1;
+    rewrite(corrupted);
+    {
+      const fts::MappedIndex corrupted_file(index_path);
+      EXPECT_THROW(corrupted_file.verifyChecksums(),
+                   fts::IndexFormatException);
+    }
+
+    // A damaged section table, a truncated file and a foreign file are
+    // rejected when the file is opened.
+    corrupted = file_data;
+    corrupted[fts::file_header_size] ^= 1;
+    rewrite(corrupted);
+    EXPECT_THROW(fts::MappedIndex{index_path}, fts::IndexFormatException);
+    rewrite(file_data.substr(0, file_data.size() - 1));
+    EXPECT_THROW(fts::MappedIndex{index_path}, fts::IndexFormatException);
+    rewrite("");
+    EXPECT_THROW(fts::MappedIndex{index_path}, fts::IndexFormatException);
+    rewrite(std::string(100, 'x'));
+    EXPECT_THROW(fts::MappedIndex{index_path}, fts::IndexFormatException);
+
+    // Files are mapped without checking the checksums, so a damaged bit
+    // width of a full posting block is rejected when the block is decoded.
+    fts::IndexBuilder full;
+    for (size_t id = 0; id < fts::posting_block_size; ++id) {
+      full.addDocument(id, "Matrix", config);
+    }
+    fts::BinaryIndexWriter(fts::DictionaryVersion::FrontCoded,
+                           fts::EntriesVersion::BlockMax)
+        .write(index_dir, full.getIndex());
+    size_t bit_width_at = 0;
+    {
+      const fts::MappedIndex index_file(index_path);
+      const fts::DictionaryAccessor dictionary(
+          index_file.section("dictionary").data(),
+          fts::DictionaryVersion::FrontCoded);
+      const auto offset = dictionary.retrieve("matrix");
+      ASSERT_TRUE(offset);
+      // A single block follows the document count, 128 as two varint
+      // bytes, and the largest frequency, 1.
+      bit_width_at =
+          index_file.header().sectionOffset("entries") + *offset + 3;
+      file_data.assign(index_file.data(), index_file.size());
+    }
+    // Gaps of one document need one bit.
+    ASSERT_EQ(file_data[bit_width_at], '\x01');
+    for (const char bit_width : {'\x21', '\xff'}) {
+      corrupted = file_data;
+      corrupted[bit_width_at] = bit_width;
+      rewrite(corrupted);
+      const fts::MappedIndex corrupted_file(index_path);
+      const fts::EntryAccessor entries(
+          corrupted_file.section("entries").data(),
+          corrupted_file.section("entries").size(),
+          fts::EntriesVersion::BlockMax);
+      const fts::DictionaryAccessor dictionary(
+          corrupted_file.section("dictionary").data(),
+          fts::DictionaryVersion::FrontCoded);
+      auto cursor = entries.cursor(*dictionary.retrieve("matrix"));
+      EXPECT_THROW(cursor.next(), fts::IndexFormatException);
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest8PhraseNear) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    const auto query =
+        fts::parseQuery("\"Harry the Potter\" dune NEAR/2 messiah", config);
+    EXPECT_EQ(query.words, (std::vector<std::string>{"harry", "potter", "dune",
+                                                      "messia"}));
+    EXPECT_EQ(query.terms.size(), 13U);
+    ASSERT_TRUE(query.root);
+    ASSERT_EQ(query.root->kind, fts::QueryNode::Kind::And);
+    ASSERT_EQ(query.root->children.size(), 2U);
+    const auto &phrase = query.root->children[0];
+    ASSERT_EQ(phrase.kind, fts::QueryNode::Kind::Phrase);
+    ASSERT_EQ(phrase.phrases[0].words.size(), 2U);
+    EXPECT_EQ(phrase.phrases[0].words[1].term, "potter");
+    EXPECT_EQ(phrase.phrases[0].words[1].offset, 1U);
+    const auto &near = query.root->children[1];
+    ASSERT_EQ(near.kind, fts::QueryNode::Kind::Near);
+    EXPECT_EQ(near.distance, 2U);
+    EXPECT_EQ(near.phrases[1].words[0].term, "messia");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Harry Potter and the Chamber of Secrets", config);
+    idx.addDocument(2, "Potter Harry", config);
+    idx.addDocument(3, "Harry the Potter", config);
+    idx.addDocument(4, "Harry Smith Potter", config);
+    idx.addDocument(5, "Harry Smith Jones Potter", config);
+    idx.addDocument(6, "Unrelated Title", config);
+
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+    const fts::MappedIndex index_file(
+        std::filesystem::current_path() / "searchtest" / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+    const auto ids = [&](const std::string &text) {
+      std::vector<size_t> result;
+      for (const auto &row : fts::search(config, accessor, text)) {
+        result.push_back(row.document_id);
+      }
+      std::sort(result.begin(), result.end());
+      return result;
+    };
+    EXPECT_EQ(ids("\"harry potter\""), (std::vector<size_t>{1, 3}));
+    EXPECT_EQ(ids("\"potter harry\""), (std::vector<size_t>{2}));
+    EXPECT_EQ(ids("\"harry potter\" chamber"), (std::vector<size_t>{1}));
+    EXPECT_EQ(ids("harry NEAR/1 potter"), (std::vector<size_t>{1, 2, 3}));
+    EXPECT_EQ(ids("harry NEAR/2 potter"), (std::vector<size_t>{1, 2, 3, 4}));
+    EXPECT_EQ(ids("harry NEAR/3 potter"),
+              (std::vector<size_t>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(ids("\"harry smith\" NEAR/1 jones"), (std::vector<size_t>{5}));
+    EXPECT_EQ(ids("jones NEAR/1 \"harry smith\""), (std::vector<size_t>{5}));
+    EXPECT_EQ(ids("\"harry smith\" NEAR/1 potter"), (std::vector<size_t>{4}));
+    EXPECT_TRUE(ids("\"chamber harry\"").empty());
+    EXPECT_EQ(ids("harry potter").size(), 5U);
+
+    // With a proximity weight, adjacent words outrank distant ones.
+    const auto boosted_path =
+        std::filesystem::current_path() / "searchtest" / "boosted.json";
+    {
+      std::ifstream base(std::filesystem::current_path() / "config.json");
+      auto json = std::string(std::istreambuf_iterator<char>(base), {});
+      json.insert(json.find('{') + 1, "\"proximity_weight\": 1.5,");
+      std::ofstream boosted(boosted_path);
+      boosted << json;
+    }
+    const fts::Config boosted_config(boosted_path);
+    const auto plain = fts::search(config, accessor, "harry potter");
+    const auto boosted = fts::search(boosted_config, accessor, "harry potter");
+    const auto score_of = [](const std::vector<fts::Result> &results,
+                             size_t document_id) {
+      for (const auto &row : results) {
+        if (row.document_id == document_id) {
+          return row.score;
+        }
+      }
+      return -1.0;
+    };
+    EXPECT_DOUBLE_EQ(score_of(boosted, 4), score_of(plain, 4) + 1.5 / 2);
+    EXPECT_DOUBLE_EQ(score_of(boosted, 5), score_of(plain, 5) + 1.5 / 3);
+    EXPECT_DOUBLE_EQ(score_of(boosted, 3), score_of(plain, 3) + 1.5);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest9Boolean) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Harry Potter and the Chamber of Secrets", config);
+    idx.addDocument(2, "Harry Potter and the Prisoner of Azkaban", config);
+    idx.addDocument(3, "Dune Messiah", config);
+    idx.addDocument(4, "Children of Dune", config);
+    idx.addDocument(5, "Chamber Music", config);
+    for (size_t i = 0; i < 400; ++i) {
+      idx.addDocument(100 + i, i % 2 == 0 ? "Dune Encyclopedia" : "Music Box",
+                      config);
+    }
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    for (const auto version :
+         {fts::EntriesVersion::Raw, fts::EntriesVersion::Compressed,
+          fts::EntriesVersion::Skipped}) {
+      fts::BinaryIndexWriter writer(fts::DictionaryVersion::FrontCoded,
+                                    version);
+      writer.write(index_dir, idx.getIndex());
+      const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+      fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+      const auto ids = [&](const std::string &text) {
+        std::vector<size_t> result;
+        for (const auto &row : fts::search(config, accessor, text)) {
+          if (row.document_id < 100) {
+            result.push_back(row.document_id);
+          }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+      };
+      EXPECT_EQ(ids("harry AND chamber"), (std::vector<size_t>{1}));
+      EXPECT_EQ(ids("harry chamber"), (std::vector<size_t>{1, 2, 5}));
+      EXPECT_EQ(ids("harry OR chamber"), (std::vector<size_t>{1, 2, 5}));
+      EXPECT_EQ(ids("chamber AND NOT harry"), (std::vector<size_t>{5}));
+      EXPECT_EQ(ids("dune AND (messiah OR children)"),
+                (std::vector<size_t>{3, 4}));
+      EXPECT_EQ(ids("dune AND NOT (messiah OR children)"),
+                (std::vector<size_t>{}));
+      EXPECT_EQ(ids("music AND chamber OR messiah"),
+                (std::vector<size_t>{3, 5}));
+      EXPECT_EQ(ids("NOT dune AND NOT music AND NOT harry"),
+                (std::vector<size_t>{}));
+      EXPECT_EQ(ids("\"harry potter\" NOT azkaban"), (std::vector<size_t>{1}));
+      EXPECT_EQ(ids("AND ) harry AND"), (std::vector<size_t>{1, 2}));
+      // Next to required operands, a document still needs one of the bare
+      // words, and groups are required.
+      EXPECT_EQ(ids("harry NOT azkaban"), (std::vector<size_t>{1}));
+      EXPECT_EQ(ids("(harry potter) dune"), (std::vector<size_t>{}));
+      EXPECT_EQ(ids("(harry potter) chamber"), (std::vector<size_t>{1}));
+      EXPECT_EQ(ids("(chamber) music"), (std::vector<size_t>{5}));
+      EXPECT_EQ(fts::search(config, accessor, "music AND dune").size(), 0U);
+      EXPECT_EQ(fts::search(config, accessor, "NOT dune").size(), 203U);
+
+      // Only the terms outside NOT score, and over matched documents only.
+      const auto plain = fts::search(config, accessor, "chamber music");
+      const auto filtered =
+          fts::search(config, accessor, "chamber AND music NOT harry");
+      ASSERT_EQ(filtered.size(), 1U);
+      EXPECT_EQ(filtered[0].document_id, 5U);
+      EXPECT_DOUBLE_EQ(filtered[0].score, plain[0].score);
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest10BlockMax) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    for (size_t i = 0; i < 1000; ++i) {
+      std::string title = "Saga";
+      for (size_t j = 0; j < (i * 7919) % 6; ++j) {
+        title += " Saga";
+      }
+      title += i % 3 == 0 ? " Dragon" : " Knight";
+      if (i % 250 == 17) {
+        title += " Dragon Dragon Dragon";
+      }
+      idx.addDocument(i, title, config);
+    }
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    std::vector<std::vector<std::vector<fts::Result>>> results;
+    for (const auto version :
+         {fts::EntriesVersion::Skipped, fts::EntriesVersion::BlockMax}) {
+      fts::BinaryIndexWriter writer(fts::DictionaryVersion::FrontCoded,
+                                    version);
+      writer.write(index_dir, idx.getIndex());
+      const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+      fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+      auto &pages = results.emplace_back();
+      for (const auto &query : {"dragon", "saga dragon", "knight saga dragon",
+                                "dra", "nothing"}) {
+        pages.push_back(fts::search(config, accessor, query, 5));
+        pages.push_back(fts::search(config, accessor, query, 3, 4));
+      }
+    }
+
+    // Pruning returns exactly the page exhaustive scoring ranks.
+    for (size_t page = 0; page < results[0].size(); ++page) {
+      ASSERT_EQ(results[1][page].size(), results[0][page].size());
+      for (size_t i = 0; i < results[0][page].size(); ++i) {
+        EXPECT_EQ(results[1][page][i].document_id,
+                  results[0][page][i].document_id);
+        EXPECT_EQ(results[1][page][i].score, results[0][page][i].score);
+      }
+    }
+    ASSERT_EQ(results[1][0].size(), 5U);
+    EXPECT_EQ(results[1][0][0].document_id, 267U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest11Stats) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Matrix", config);
+    idx.addDocument(2, "The Matrix Reloaded Again And Again", config);
+    idx.addDocument(3, "Matrix Revolutions", config);
+    idx.addDocument(4, "Dune", config);
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    fts::TextIndexWriter text_writer;
+    text_writer.write(index_dir, idx.getIndex());
+    fts::TextIndexAccessor text_accessor(index_dir / "text");
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+    const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+    for (const fts::IndexAccessor *index :
+         {static_cast<const fts::IndexAccessor *>(&accessor),
+          static_cast<const fts::IndexAccessor *>(&text_accessor)}) {
+      double N = 0.0;
+      ASSERT_TRUE(index->totalDocs(N));
+      EXPECT_EQ(N, 4.0);
+      const auto stats = index->termStats("matrix");
+      EXPECT_EQ(stats.df, 3U);
+      EXPECT_DOUBLE_EQ(stats.idf, std::log(4.0 / 3.0));
+      EXPECT_EQ(index->termStats("absent").df, 0U);
+      const auto lengths = index->documentLengths(fts::Field::Title);
+      EXPECT_EQ(lengths.length(0), 1.0);
+      EXPECT_EQ(lengths.length(1), 4.0);
+      EXPECT_DOUBLE_EQ(lengths.average(), 2.0);
+    }
+
+    // BM25 prefers the shorter title, and both indexes score alike.
+    const auto bm25_path = index_dir / "bm25.json";
+    {
+      std::ifstream base(std::filesystem::current_path() / "config.json");
+      auto json = std::string(std::istreambuf_iterator<char>(base), {});
+      json.insert(json.find('{') + 1, "\"ranking\": \"bm25\",");
+      std::ofstream bm25(bm25_path);
+      bm25 << json;
+    }
+    const fts::Config bm25_config(bm25_path);
+    const auto binary_results = fts::search(bm25_config, accessor, "matrix");
+    const auto text_results = fts::search(bm25_config, text_accessor, "matrix");
+    ASSERT_EQ(binary_results.size(), 3U);
+    EXPECT_EQ(binary_results[0].document_id, 1U);
+    EXPECT_EQ(binary_results[2].document_id, 2U);
+    ASSERT_EQ(text_results.size(), 3U);
+    for (size_t i = 0; i < binary_results.size(); ++i) {
+      EXPECT_EQ(text_results[i].document_id, binary_results[i].document_id);
+      EXPECT_DOUBLE_EQ(text_results[i].score, binary_results[i].score);
+    }
+    const auto page = fts::search(bm25_config, accessor, "matrix dune", 2);
+    ASSERT_EQ(page.size(), 2U);
+    EXPECT_EQ(page[0].document_id, 4U);
+    EXPECT_EQ(page[1].document_id, 1U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest12Bm25F) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Matrix", config, "Lana Wachowski");
+    idx.addDocument(2, "Dune", config, "Frank Herbert");
+    idx.addDocument(3, "Herbert West Reanimator", config, "Lovecraft");
+    idx.addDocument(4, "Children of Dune", config, "Frank Herbert");
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    fts::TextIndexWriter text_writer;
+    text_writer.write(index_dir, idx.getIndex());
+    fts::TextIndexAccessor text_accessor(index_dir / "text");
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+    const fts::MappedIndex index_file(index_dir / "binary" / "binary");
+    fts::BinaryIndexAccessor accessor(index_file.data(), index_file.header());
+
+    // Author words only match under BM25F.
+    EXPECT_TRUE(fts::search(config, accessor, "wachowski").empty());
+    EXPECT_EQ(fts::search(config, accessor, "herbert").size(), 1U);
+    config.setRanking(fts::Ranking::Bm25F);
+    const auto authors = fts::search(config, accessor, "wachowski");
+    ASSERT_EQ(authors.size(), 1U);
+    EXPECT_EQ(authors[0].document_id, 1U);
+    EXPECT_TRUE(fts::search(config, accessor, "wachowski dune -frank").size() >
+                authors.size());
+    EXPECT_EQ(accessor.documentLengths(fts::Field::Authors).length(0), 2.0);
+
+    // The title outweighs the authors by default, and both indexes agree.
+    const auto binary_results = fts::search(config, accessor, "herbert");
+    const auto text_results = fts::search(config, text_accessor, "herbert");
+    ASSERT_EQ(binary_results.size(), 3U);
+    EXPECT_EQ(binary_results[0].document_id, 3U);
+    ASSERT_EQ(text_results.size(), 3U);
+    for (size_t i = 0; i < binary_results.size(); ++i) {
+      EXPECT_EQ(text_results[i].document_id, binary_results[i].document_id);
+      EXPECT_DOUBLE_EQ(text_results[i].score, binary_results[i].score);
+    }
+    const auto page = fts::search(config, accessor, "herbert dune", 2);
+    const auto all = fts::search(config, accessor, "herbert dune");
+    ASSERT_EQ(page.size(), 2U);
+    for (size_t i = 0; i < page.size(); ++i) {
+      EXPECT_EQ(page[i].document_id, all[i].document_id);
+      EXPECT_EQ(page[i].score, all[i].score);
+    }
+
+    // A heavier author field ranks the author matches first.
+    const auto weighted_path = index_dir / "bm25f.json";
+    {
+      std::ifstream base(std::filesystem::current_path() / "config.json");
+      auto json = std::string(std::istreambuf_iterator<char>(base), {});
+      json.insert(json.find('{') + 1,
+                  "\"ranking\": \"bm25f\", \"author_weight\": 4.0,");
+      std::ofstream weighted(weighted_path);
+      weighted << json;
+    }
+    const fts::Config weighted_config(weighted_path);
+    const auto weighted = fts::search(weighted_config, accessor, "herbert");
+    ASSERT_EQ(weighted.size(), 3U);
+    EXPECT_NE(weighted[0].document_id, 3U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SearcherTest, SearchTest13Shards) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    for (size_t i = 0; i < 500; ++i) {
+      std::string title = i % 4 == 0 ? "Saga of the" : "Chronicle";
+      title += i % 3 == 0 ? " Dragon" : " Knight";
+      for (size_t j = 0; j < (i * 7919) % 4; ++j) {
+        title += " Dragon";
+      }
+      idx.addDocument(1000 - i, title, config,
+                      i % 5 == 0 ? "Ursula Dragon" : "Robin Hobb");
+    }
+
+    const auto index_dir = std::filesystem::current_path() / "searchtest";
+    const auto shards_dir = std::filesystem::current_path() / "shardtest";
+    fts::BinaryIndexWriter writer;
+    writer.write(index_dir, idx.getIndex());
+    fts::BinaryIndexWriter sharded_writer(fts::DictionaryVersion::FrontCoded,
+                                          fts::EntriesVersion::BlockMax, 1, 4);
+    sharded_writer.write(shards_dir, idx.getIndex());
+    EXPECT_FALSE(std::filesystem::exists(shards_dir / "binary" / "binary"));
+
+    // Every ranking scores sharded documents as the unsharded index does.
+    for (const auto ranking :
+         {fts::Ranking::TfIdf, fts::Ranking::Bm25, fts::Ranking::Bm25F}) {
+      config.setRanking(ranking);
+      const fts::IndexHandle single(config, index_dir);
+      const fts::IndexHandle sharded(config, shards_dir);
+      ASSERT_EQ(sharded.shardCount(), 4U);
+      for (const auto &query : {"dragon", "saga knight", "dragon -saga",
+                                "\"saga of\" OR hobb", "nothing"}) {
+        const auto expected = single.search(query);
+        const auto all = sharded.search(query);
+        ASSERT_EQ(all.size(), expected.size());
+        for (size_t i = 0; i < all.size(); ++i) {
+          EXPECT_EQ(all[i].document_id, expected[i].document_id);
+          EXPECT_EQ(all[i].score, expected[i].score);
+          EXPECT_EQ(all[i].name_of_doc, expected[i].name_of_doc);
+        }
+        const auto page = sharded.search(query, 7, 3);
+        const auto expected_page = single.search(query, 7, 3);
+        ASSERT_EQ(page.size(), expected_page.size());
+        for (size_t i = 0; i < page.size(); ++i) {
+          EXPECT_EQ(page[i].document_id, expected_page[i].document_id);
+          EXPECT_EQ(page[i].score, expected_page[i].score);
+        }
+      }
+    }
+
+    // A shard of another build is rejected.
+    fts::BinaryIndexWriter other_writer(fts::DictionaryVersion::FrontCoded,
+                                        fts::EntriesVersion::BlockMax, 1, 3);
+    other_writer.write(index_dir, idx.getIndex());
+    std::filesystem::copy_file(
+        index_dir / "binary" / "shard.1", shards_dir / "binary" / "shard.1",
+        std::filesystem::copy_options::overwrite_existing);
+    EXPECT_THROW(fts::IndexHandle(config, shards_dir), fts::IndexFormatException);
+
+    // Writing unsharded again removes the shards.
+    writer.write(index_dir, idx.getIndex());
+    EXPECT_FALSE(std::filesystem::exists(index_dir / "binary" / "shard.0"));
+    EXPECT_EQ(fts::IndexHandle(config, index_dir).shardCount(), 1U);
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
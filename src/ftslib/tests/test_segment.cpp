@@ -0,0 +1,273 @@
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <ftslib/segment.hpp>
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <thread>
+
+static std::vector<size_t> result_ids(const std::vector<fts::Result> &results) {
+  std::vector<size_t> ids;
+  for (const auto &result : results) {
+    ids.push_back(result.document_id);
+  }
+  return ids;
+}
+
+TEST(SegmentTest, SegmentTest1AddDeleteMerge) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "segmenttest";
+    std::filesystem::remove_all(index_dir);
+
+    fts::TieredMergePolicy policy;
+    policy.segments_per_tier = 3;
+    policy.floor_docs = 1;
+    fts::SegmentedIndex index(index_dir, config, policy);
+    index.addDocuments({{1, "Dragon Saga", "Robin Hobb"}, {2, "Knight", ""}});
+    index.addDocuments({{3, "Dragon Knight", ""}});
+    EXPECT_EQ(result_ids(fts::IndexHandle(config, index_dir).search("dragon")),
+              (std::vector<size_t>{1, 3}));
+
+    // Adding a document again replaces it.
+    index.addDocuments({{1, "Knight Tale", "Robin Hobb"}});
+    const fts::IndexHandle before_delete(config, index_dir);
+    EXPECT_EQ(before_delete.shardCount(), 3U);
+    EXPECT_EQ(result_ids(before_delete.search("dragon")),
+              (std::vector<size_t>{3}));
+    EXPECT_EQ(result_ids(before_delete.search("tale")),
+              (std::vector<size_t>{1}));
+
+    index.deleteDocuments({3, 42});
+    EXPECT_TRUE(fts::IndexHandle(config, index_dir).search("dragon").empty());
+    // A handle searches the segments as of its opening.
+    EXPECT_EQ(result_ids(before_delete.search("dragon")),
+              (std::vector<size_t>{3}));
+    EXPECT_EQ(index.segments()[1].deleted, 1U);
+
+    // Merging drops the deleted documents and scores the rest as an index
+    // built from them at once.
+    EXPECT_TRUE(index.merge());
+    EXPECT_FALSE(index.merge());
+    ASSERT_EQ(index.segments().size(), 1U);
+    EXPECT_EQ(index.segments()[0].docs, 2U);
+    EXPECT_EQ(std::distance(
+                  std::filesystem::directory_iterator(index_dir / "segments"),
+                  std::filesystem::directory_iterator()),
+              2);
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Knight Tale", config, "Robin Hobb");
+    idx.addDocument(2, "Knight", config);
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "searchtest",
+                 idx.getIndex());
+    for (const auto ranking :
+         {fts::Ranking::TfIdf, fts::Ranking::Bm25, fts::Ranking::Bm25F}) {
+      config.setRanking(ranking);
+      const fts::IndexHandle merged(config, index_dir);
+      const fts::IndexHandle single(
+          config, std::filesystem::current_path() / "searchtest");
+      for (const auto &query : {"knight", "tale hobb", "\"knight tale\""}) {
+        const auto expected = single.search(query);
+        const auto results = merged.search(query);
+        ASSERT_EQ(results.size(), expected.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+          EXPECT_EQ(results[i].document_id, expected[i].document_id);
+          EXPECT_EQ(results[i].score, expected[i].score);
+          EXPECT_EQ(results[i].name_of_doc, expected[i].name_of_doc);
+        }
+      }
+    }
+
+    index.deleteDocuments({1, 2});
+    EXPECT_TRUE(index.merge());
+    EXPECT_TRUE(index.segments().empty());
+    EXPECT_TRUE(fts::IndexHandle(config, index_dir).search("knight").empty());
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SegmentTest, SegmentTest2BackgroundMerges) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "segmenttest";
+    std::filesystem::remove_all(index_dir);
+
+    fts::TieredMergePolicy policy;
+    policy.segments_per_tier = 3;
+    policy.floor_docs = 4;
+    std::map<size_t, std::string> expected;
+    {
+      fts::SegmentedIndex index(index_dir, config, policy);
+      index.startMerging();
+      std::thread reader;
+      for (size_t batch = 0; batch < 30; ++batch) {
+        std::vector<fts::Document> documents;
+        for (size_t i = 0; i < 4; ++i) {
+          const size_t id = (batch * 4 + i) % 70;
+          const std::string title =
+              (id + batch) % 3 == 0 ? "Dragon Tale" : "Knight Tale";
+          documents.push_back({id, title, ""});
+          expected[id] = title;
+        }
+        index.addDocuments(documents);
+        if (batch % 5 == 4) {
+          index.deleteDocuments({batch, batch + 1});
+          expected.erase(batch);
+          expected.erase(batch + 1);
+        }
+        // Readers open and search the index while it changes.
+        if (batch == 0) {
+          reader = std::thread([&config, &index_dir]() {
+            for (size_t i = 0; i < 50; ++i) {
+              const fts::IndexHandle handle(config, index_dir);
+              handle.search("dragon");
+            }
+          });
+        }
+      }
+      reader.join();
+    }
+
+    fts::SegmentedIndex index(index_dir, config, policy);
+    while (index.merge()) {
+    }
+    size_t live = 0;
+    for (const auto &segment : index.segments()) {
+      live += segment.liveDocs();
+    }
+    EXPECT_EQ(live, expected.size());
+
+    std::set<size_t> dragons;
+    for (const auto &[id, title] : expected) {
+      if (title == "Dragon Tale") {
+        dragons.insert(id);
+      }
+    }
+    const auto results =
+        fts::IndexHandle(config, index_dir).search("dragon", 1000);
+    const auto ids = result_ids(results);
+    EXPECT_EQ(std::set<size_t>(ids.begin(), ids.end()), dragons);
+    EXPECT_EQ(ids.size(), dragons.size());
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SegmentTest, SegmentTest3AppendToBuiltIndex) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "segmenttest";
+    std::filesystem::remove_all(index_dir);
+
+    fts::IndexBuilder idx;
+    idx.addDocument(1, "Dragon Saga", config, "Robin Hobb");
+    idx.addDocument(2, "Dragon Knight", config);
+    idx.addDocument(3, "Knight Tale", config);
+    fts::BinaryIndexWriter().write(index_dir, idx.getIndex());
+    EXPECT_EQ(result_ids(fts::IndexHandle(config, index_dir).search("dragon")),
+              (std::vector<size_t>{1, 2}));
+
+    // The built index becomes the first segment, so appended documents
+    // update and delete its documents too.
+    fts::SegmentedIndex index(index_dir, config);
+    index.addDocuments({{4, "Dragon Tale", ""}, {2, "Knight", ""}});
+    ASSERT_EQ(index.segments().size(), 2U);
+    EXPECT_EQ(index.segments()[0].docs, 3U);
+    EXPECT_EQ(index.segments()[0].deleted, 1U);
+    EXPECT_EQ(
+        result_ids(fts::IndexHandle(config, index_dir).search("dragon")),
+        (std::vector<size_t>{1, 4}));
+
+    // Sharded builds are imported shard by shard.
+    std::filesystem::remove_all(index_dir);
+    fts::BinaryIndexWriter(fts::DictionaryVersion::FrontCoded,
+                           fts::EntriesVersion::BlockMax, 1, 2)
+        .write(index_dir, idx.getIndex());
+    fts::SegmentedIndex sharded(index_dir, config);
+    sharded.addDocuments({{4, "Dragon Tale", ""}});
+    EXPECT_EQ(sharded.segments().size(), 3U);
+    const auto ids = result_ids(
+        fts::IndexHandle(config, index_dir).search("dragon"));
+    EXPECT_EQ(std::set<size_t>(ids.begin(), ids.end()),
+              (std::set<size_t>{1, 2, 4}));
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
+
+TEST(SegmentTest, SegmentTest4DeleteDuringMerge) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+    const auto index_dir = std::filesystem::current_path() / "segmenttest";
+    std::filesystem::remove_all(index_dir);
+
+    fts::TieredMergePolicy policy;
+    policy.segments_per_tier = 3;
+    policy.floor_docs = 1000;
+    fts::SegmentedIndex index(index_dir, config, policy);
+    std::set<size_t> dragons;
+    size_t next_id = 0;
+    for (size_t round = 0; round < 10; ++round) {
+      std::vector<size_t> round_ids;
+      for (size_t segment = 0; segment < 3; ++segment) {
+        std::vector<fts::Document> documents;
+        for (size_t i = 0; i < 100; ++i) {
+          documents.push_back({next_id, "Dragon Tale", ""});
+          dragons.insert(next_id);
+          round_ids.push_back(next_id++);
+        }
+        index.addDocuments(documents);
+      }
+      // Documents of the segments being merged are deleted meanwhile.
+      std::exception_ptr failure;
+      std::thread merger([&index, &failure]() {
+        try {
+          index.merge();
+        } catch (...) {
+          failure = std::current_exception();
+        }
+      });
+      for (size_t i = 0; i < round_ids.size(); i += 30) {
+        index.deleteDocuments({round_ids[i]});
+        dragons.erase(round_ids[i]);
+      }
+      merger.join();
+      ASSERT_FALSE(failure);
+    }
+
+    // Only the segments of the manifest are left in the directory.
+    std::set<std::string> files;
+    for (const auto &segment : index.segments()) {
+      files.insert(segment.name);
+      if (!segment.deletions.empty()) {
+        files.insert(segment.deletions);
+      }
+    }
+    files.insert("manifest");
+    size_t file_count = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(index_dir / "segments")) {
+      EXPECT_EQ(files.count(entry.path().filename().string()), 1U);
+      ++file_count;
+    }
+    EXPECT_EQ(file_count, files.size());
+
+    const auto ids = result_ids(
+        fts::IndexHandle(config, index_dir).search("dragon", 10000));
+    EXPECT_EQ(std::set<size_t>(ids.begin(), ids.end()), dragons);
+    EXPECT_EQ(ids.size(), dragons.size());
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}
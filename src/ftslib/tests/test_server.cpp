@@ -0,0 +1,134 @@
+#include <atomic>
+#include <cstring>
+#include <ftslib/handle.hpp>
+#include <ftslib/indexer.hpp>
+#include <ftslib/pool.hpp>
+#include <ftslib/server.hpp>
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+static std::string read_until_closed(int input) {
+  std::string text;
+  char chunk[4096];
+  ssize_t count = 0;
+  while ((count = read(input, chunk, sizeof(chunk))) > 0) {
+    text.append(chunk, static_cast<size_t>(count));
+  }
+  return text;
+}
+
+static void write_text(int output, const std::string &text) {
+  ASSERT_EQ(write(output, text.data(), text.size()),
+            static_cast<ssize_t>(text.size()));
+}
+
+TEST(ServerTest, ServerTest1Pool) {
+  std::atomic<size_t> sum{0};
+  std::vector<std::future<size_t>> results;
+  {
+    fts::ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4U);
+    for (size_t i = 0; i < 1000; ++i) {
+      results.push_back(pool.submit([&sum, &pool, i]() {
+        // Tasks queued from a worker run too.
+        pool.submit([&sum]() { sum += 1; });
+        return i * i;
+      }));
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+      EXPECT_EQ(results[i].get(), i * i);
+    }
+    auto failed = pool.submit([]() -> int { throw std::runtime_error("x"); });
+    EXPECT_THROW(failed.get(), std::runtime_error);
+  }
+  EXPECT_EQ(sum.load(), 1000U);
+}
+
+TEST(ServerTest, ServerTest2Serve) {
+  try {
+    fts::Config config =
+        fts::Config(std::filesystem::current_path() / "config.json");
+
+    fts::IndexBuilder idx;
+    idx.addDocument(199903, "The Matrix: 1", config);
+    idx.addDocument(200305, "Matrix Reloaded: Matrix 2", config);
+    idx.addDocument(200311, "Reloaded", config);
+    fts::BinaryIndexWriter writer;
+    writer.write(std::filesystem::current_path() / "servertest",
+                 idx.getIndex());
+
+    const fts::IndexHandle handle(
+        config, std::filesystem::current_path() / "servertest");
+    fts::ThreadPool pool(3);
+    fts::QueryServer server(handle, pool);
+
+    // Answers keep the order of the queries.
+    std::string queries;
+    std::string expected;
+    for (size_t i = 0; i < 50; ++i) {
+      const std::string query = i % 2 == 0 ? "matrix" : "reloaded";
+      queries += query + "\n\n";
+      expected += fts::getStringSearchResult(handle.search(
+                      query, fts::printed_results_count)) +
+                  "\n";
+    }
+    queries += "\"\n";
+    expected += server.answer("\"");
+    EXPECT_EQ(expected.substr(expected.size() - 2), "\n\n");
+
+    int sockets[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    std::thread client([&]() {
+      write_text(sockets[1], queries);
+      shutdown(sockets[1], SHUT_WR);
+    });
+    std::string answers;
+    std::thread reader([&]() { answers = read_until_closed(sockets[1]); });
+    server.serve(sockets[0], sockets[0]);
+    shutdown(sockets[0], SHUT_WR);
+    client.join();
+    reader.join();
+    close(sockets[0]);
+    close(sockets[1]);
+    EXPECT_EQ(answers, expected);
+
+    // Connections on a Unix socket are served until stop().
+    const auto socket_path =
+        std::filesystem::current_path() / "servertest" / "socket";
+    std::thread listener([&]() { server.listen(socket_path); });
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socket_path.c_str());
+    std::vector<std::thread> clients;
+    std::vector<std::string> replies(4);
+    for (size_t i = 0; i < replies.size(); ++i) {
+      clients.emplace_back([&, i]() {
+        const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        while (connect(connection,
+                       reinterpret_cast<const sockaddr *>(&address),
+                       sizeof(address)) != 0) {
+          std::this_thread::yield();
+        }
+        write_text(connection, "matrix\nreloaded\n");
+        shutdown(connection, SHUT_WR);
+        replies[i] = read_until_closed(connection);
+        close(connection);
+      });
+    }
+    for (auto &connection : clients) {
+      connection.join();
+    }
+    server.stop();
+    listener.join();
+    EXPECT_FALSE(std::filesystem::exists(socket_path));
+    for (const auto &reply : replies) {
+      EXPECT_EQ(reply, server.answer("matrix") + server.answer("reloaded"));
+    }
+
+  } catch (fts::ConfigurationException &e) {
+    std::cerr << e.what() << "\n";
+  };
+}